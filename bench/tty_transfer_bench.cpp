@@ -0,0 +1,401 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include "tty_transfer/private/uuid.h"
+
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// for openpty
+#if defined(__APPLE__)
+#include <util.h>
+#elif defined(__linux__)
+#include <pty.h>
+#endif
+
+#include "tty_transfer.h"
+#include "tty_transfer/host.h"
+#include "tty_transfer/parser_pool.h"
+#include "tty_transfer/registry.h"
+
+#define UUID_KEY "68338148-030e-436c-89eb-9f905860f83b"
+#define UUID_VAL "f81d4fae-7dec-11d0-a765-00a0c91e6bf6"
+
+#define TOKEN_SEQ "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\"
+#define CPR "\e[24;80R"
+
+// Roughly 64KiB of traffic made by repeating unit, then the token reply
+static std::string make_corpus(const std::string &unit) {
+  std::string corpus;
+  while (corpus.size() < 64 * 1024)
+    corpus += unit;
+
+  return corpus + TOKEN_SEQ CPR;
+}
+
+static void feed_corpus(benchmark::State &state, const std::string &corpus) {
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+
+  for (auto _ : state) {
+    tty_transfer_parser_reset(p);
+    int n = tty_transfer_parser_feed(p, corpus.data(), corpus.size());
+    benchmark::DoNotOptimize(n);
+  }
+
+  if (!tty_transfer_parser_token_for_key(p, UUID_KEY))
+    state.SkipWithError("token was not parsed");
+
+  state.SetBytesProcessed(state.iterations() * corpus.size());
+  tty_transfer_parser_free(p);
+}
+
+static void BM_FeedPlainText(benchmark::State &state) {
+  feed_corpus(state,
+              make_corpus("The quick brown fox jumps over the lazy dog.\r\n"));
+}
+BENCHMARK(BM_FeedPlainText);
+
+static void BM_FeedSgrHeavy(benchmark::State &state) {
+  feed_corpus(state, make_corpus("\e[1;38;5;196mERR\e[0m \e[32mok\e[0m "
+                                 "\e[2K\e[10;1H\e[?25l"));
+}
+BENCHMARK(BM_FeedSgrHeavy);
+
+static void BM_FeedLargeOsc(benchmark::State &state) {
+  // Like an OSC 52 clipboard write with a 4KiB base64 payload
+  std::string osc = "\e]52;c;" + std::string(4096, 'Q') + "\e\\";
+  feed_corpus(state, make_corpus(osc));
+}
+BENCHMARK(BM_FeedLargeOsc);
+
+static void BM_FeedHugeOsc(benchmark::State &state) {
+  // A 1MiB OSC 8 hyperlink is skipped once it cannot be a token
+  std::string corpus = "\e]8;;https://example.com/" +
+                       std::string(1 << 20, 'u') + "\e\\" TOKEN_SEQ CPR;
+  feed_corpus(state, corpus);
+}
+BENCHMARK(BM_FeedHugeOsc);
+
+static void BM_FeedTokenSplitEverywhere(benchmark::State &state) {
+  const std::string seq = TOKEN_SEQ CPR;
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+
+  for (auto _ : state) {
+    for (size_t split = 1; split < seq.size(); ++split) {
+      tty_transfer_parser_reset(p);
+      tty_transfer_parser_feed(p, seq.data(), split);
+      int n = tty_transfer_parser_feed(p, seq.data() + split,
+                                       seq.size() - split);
+      benchmark::DoNotOptimize(n);
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations() * seq.size() * (seq.size() - 1));
+  tty_transfer_parser_free(p);
+}
+BENCHMARK(BM_FeedTokenSplitEverywhere);
+
+// One read's worth of output from each of many ttys, like a host process
+// watching every pty it owns
+#define STREAM_CHUNK "$ make\r\n\e[1;32mok\e[0m \e]0;~/src\a\e]1337;Curr"
+
+static void BM_FeedManyParsers(benchmark::State &state) {
+  const std::string chunk = STREAM_CHUNK;
+  std::vector<tty_transfer_parser *> parsers(state.range(0));
+  for (auto &p : parsers)
+    p = tty_transfer_parser_alloc();
+
+  for (auto _ : state) {
+    for (auto p : parsers) {
+      int n = tty_transfer_parser_feed(p, chunk.data(), chunk.size());
+      benchmark::DoNotOptimize(n);
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations() * parsers.size() * chunk.size());
+  for (auto p : parsers)
+    tty_transfer_parser_free(p);
+}
+BENCHMARK(BM_FeedManyParsers)->Arg(64)->Arg(4096)->Arg(65536);
+
+static void BM_PoolFeedManyStreams(benchmark::State &state) {
+  const std::string chunk = STREAM_CHUNK;
+  size_t nstreams = state.range(0);
+  tty_transfer_parser_pool *pool = tty_transfer_parser_pool_alloc(nstreams);
+
+  std::vector<tty_transfer_parser_pool_input> inputs(nstreams);
+  for (size_t i = 0; i < nstreams; ++i)
+    inputs[i] = {(uint32_t)i, chunk.data(), chunk.size()};
+
+  tty_transfer_parser_pool_event events[64];
+  for (auto _ : state) {
+    size_t n;
+    auto ret = tty_transfer_parser_pool_feed(pool, inputs.data(), nstreams,
+                                             events, 64, &n);
+    benchmark::DoNotOptimize(ret);
+  }
+
+  state.SetBytesProcessed(state.iterations() * nstreams * chunk.size());
+  tty_transfer_parser_pool_free(pool);
+}
+BENCHMARK(BM_PoolFeedManyStreams)->Arg(64)->Arg(4096)->Arg(65536);
+
+static void scan_host_corpus(benchmark::State &state,
+                             const std::string &corpus) {
+  tty_transfer_host_scanner *s = tty_transfer_host_scanner_alloc();
+  tty_transfer_host_request reqs[8];
+
+  for (auto _ : state) {
+    tty_transfer_host_scanner_reset(s);
+    size_t nreqs;
+    size_t n = tty_transfer_host_scanner_feed(s, corpus.data(), corpus.size(),
+                                              reqs, 8, &nreqs);
+    benchmark::DoNotOptimize(n);
+  }
+
+  state.SetBytesProcessed(state.iterations() * corpus.size());
+  tty_transfer_host_scanner_free(s);
+}
+
+static void BM_HostScanPlainText(benchmark::State &state) {
+  // Like cat of a large log
+  scan_host_corpus(state, make_corpus("2025-01-01T00:00:00Z INFO request ok "
+                                      "path=/index.html status=200\r\n"));
+}
+BENCHMARK(BM_HostScanPlainText);
+
+static void BM_HostScanSgrHeavy(benchmark::State &state) {
+  scan_host_corpus(state, make_corpus("\e[1;38;5;196mERR\e[0m \e[32mok\e[0m "
+                                      "\e[2K\e[10;1H\e[?25l"));
+}
+BENCHMARK(BM_HostScanSgrHeavy);
+
+static void BM_TokenForKey(benchmark::State &state) {
+  const std::string seq = TOKEN_SEQ CPR;
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+  tty_transfer_parser_set_mode(p, (tty_transfer_parser_mode)state.range(0));
+  tty_transfer_parser_feed(p, seq.data(), seq.size());
+
+  for (auto _ : state) {
+    const char *tok = tty_transfer_parser_token_for_key(p, UUID_KEY);
+    benchmark::DoNotOptimize(tok);
+  }
+
+  tty_transfer_parser_free(p);
+}
+BENCHMARK(BM_TokenForKey)
+    ->Arg(TTY_TRANSFER_PARSER_LAST_TOKEN)
+    ->Arg(TTY_TRANSFER_PARSER_ALL_TOKENS);
+
+static void BM_TokenForUuid(benchmark::State &state) {
+  const std::string seq = TOKEN_SEQ CPR;
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+  tty_transfer_parser_set_mode(p, (tty_transfer_parser_mode)state.range(0));
+  tty_transfer_parser_feed(p, seq.data(), seq.size());
+
+  tty_transfer_uuid key;
+  tty_transfer_uuid_parse(UUID_KEY, &key);
+
+  for (auto _ : state) {
+    const tty_transfer_uuid *tok = tty_transfer_parser_token_for_uuid(p, &key);
+    benchmark::DoNotOptimize(tok);
+  }
+
+  tty_transfer_parser_free(p);
+}
+BENCHMARK(BM_TokenForUuid)
+    ->Arg(TTY_TRANSFER_PARSER_LAST_TOKEN)
+    ->Arg(TTY_TRANSFER_PARSER_ALL_TOKENS);
+
+static void BM_UuidGenerate(benchmark::State &state) {
+  char buf[TTY_TRANSFER_UUID_SIZE];
+  for (auto _ : state) {
+    tty_transfer_uuid_generate(buf, sizeof(buf));
+    benchmark::DoNotOptimize(buf);
+  }
+}
+BENCHMARK(BM_UuidGenerate);
+
+static void BM_UuidGenerateBatch(benchmark::State &state) {
+  std::vector<char> bufs(state.range(0) * TTY_TRANSFER_UUID_SIZE);
+  for (auto _ : state) {
+    tty_transfer_uuid_generate_batch(bufs.data(), state.range(0));
+    benchmark::DoNotOptimize(bufs.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_UuidGenerateBatch)->Arg(16)->Arg(256);
+
+// Shared by every thread of a registry benchmark
+static tty_transfer_registry *registry;
+static std::vector<tty_transfer_uuid> registry_tokens;
+
+static void setup_registry(size_t ntokens) {
+  registry = tty_transfer_registry_alloc(2 * ntokens);
+  registry_tokens.resize(ntokens);
+  for (size_t i = 0; i < ntokens; ++i)
+    tty_transfer_registry_mint(registry, i, 600000, &registry_tokens[i]);
+}
+
+static void teardown_registry() {
+  tty_transfer_registry_free(registry);
+  registry = nullptr;
+}
+
+static void BM_RegistryLookup(benchmark::State &state) {
+  if (state.thread_index() == 0)
+    setup_registry(64 * 1024);
+
+  size_t i = state.thread_index() * 7919;
+  for (auto _ : state) {
+    uint64_t value;
+    const auto &token = registry_tokens[i++ % registry_tokens.size()];
+    benchmark::DoNotOptimize(
+        tty_transfer_registry_lookup(registry, &token, &value));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0)
+    teardown_registry();
+}
+BENCHMARK(BM_RegistryLookup)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_RegistryMintAndTake(benchmark::State &state) {
+  if (state.thread_index() == 0)
+    setup_registry(64 * 1024);
+
+  for (auto _ : state) {
+    tty_transfer_uuid token;
+    tty_transfer_registry_mint(registry, 1, 600000, &token);
+    benchmark::DoNotOptimize(
+        tty_transfer_registry_take(registry, &token, nullptr));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0)
+    teardown_registry();
+}
+BENCHMARK(BM_RegistryMintAndTake)->ThreadRange(1, 8)->UseRealTime();
+
+// Mostly lookups while other threads mint, like a busy host
+static void BM_RegistryMixed(benchmark::State &state) {
+  if (state.thread_index() == 0)
+    setup_registry(64 * 1024);
+
+  size_t i = state.thread_index() * 7919;
+  for (auto _ : state) {
+    if (++i % 16 == 0) {
+      tty_transfer_uuid token;
+      tty_transfer_registry_mint(registry, i, 600000, &token);
+      tty_transfer_registry_take(registry, &token, nullptr);
+    } else {
+      const auto &token = registry_tokens[i % registry_tokens.size()];
+      benchmark::DoNotOptimize(
+          tty_transfer_registry_lookup(registry, &token, nullptr));
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0)
+    teardown_registry();
+}
+BENCHMARK(BM_RegistryMixed)->ThreadRange(1, 8)->UseRealTime();
+
+// Answer every request on the pty master like a terminal would, until the
+// slave is closed
+static void respond_to_requests(int master) {
+  static const char prefix[] = "RequestTransferIOToken=";
+  std::string out;
+  char buf[256];
+
+  while (true) {
+    int nread = ::read(master, buf, sizeof(buf));
+    if (nread < 1)
+      return;
+
+    out.append(buf, nread);
+    if (out.find("\e[6n") == std::string::npos)
+      continue;
+
+    auto pos = out.find(prefix);
+    if (pos == std::string::npos)
+      return;
+
+    std::string key = out.substr(pos + sizeof(prefix) - 1, 36);
+    std::string reply = "\e]1337;IOToken=" + key + ";" UUID_VAL "\e\\" CPR;
+    ::write(master, reply.data(), reply.size());
+    out.clear();
+  }
+}
+
+static void BM_RequestIoTokenRoundTrip(benchmark::State &state) {
+  int master, slave;
+  if (openpty(&master, &slave, nullptr, nullptr, nullptr) != 0) {
+    state.SkipWithError("openpty failed");
+    return;
+  }
+
+  std::thread responder{respond_to_requests, master};
+
+  tty_transfer_request_stats stats;
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = opts.out_fd = slave;
+  opts.timeout_ms = 2000;
+  opts.stats = &stats;
+
+  size_t nsyscalls = 0;
+  char token[TTY_TRANSFER_UUID_SIZE];
+  for (auto _ : state) {
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+        TTY_TRANSFER_OK) {
+      state.SkipWithError("request failed");
+      break;
+    }
+
+    nsyscalls += stats.nsyscalls;
+  }
+
+  // Compare builds with and without TTY_TRANSFER_IO_URING
+  state.counters["syscalls"] =
+      benchmark::Counter(nsyscalls, benchmark::Counter::kAvgIterations);
+
+  ::close(slave);
+  responder.join();
+  ::close(master);
+}
+BENCHMARK(BM_RequestIoTokenRoundTrip)->UseRealTime();
+
+// Report JSON unless another format is requested, so results can be diffed
+// between revisions
+int main(int argc, char **argv) {
+  std::vector<char *> args{argv, argv + argc};
+
+  bool has_format = false;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--benchmark_format", 18) == 0)
+      has_format = true;
+  }
+
+  char json_format[] = "--benchmark_format=json";
+  if (!has_format)
+    args.push_back(json_format);
+
+  int nargs = args.size();
+  benchmark::Initialize(&nargs, args.data());
+  if (benchmark::ReportUnrecognizedArguments(nargs, args.data()))
+    return 1;
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
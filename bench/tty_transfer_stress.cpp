@@ -0,0 +1,412 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+// Load generator for the request path. Each child runs on its own pty and
+// makes requests back to back while this process plays a fake terminal for
+// all of them, replying with configurable delays, fragmentation, noise and
+// dropped replies. It reports throughput and latency percentiles.
+#include "tty_transfer/private/uuid.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <poll.h>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// for forkpty
+#if defined(__APPLE__)
+#include <util.h>
+#elif defined(__linux__)
+#include <pty.h>
+#endif
+
+#include "tty_transfer.h"
+
+#define UUID_VAL "f81d4fae-7dec-11d0-a765-00a0c91e6bf6"
+
+#define REQUEST_PREFIX "\e]1337;RequestTransferIOToken="
+#define CSI6N "\e[6n"
+#define CPR "\e[24;80R"
+
+// Reported by a child whose token did not match the reply
+#define WRONG_TOKEN -1
+
+struct stress_options {
+  int nchildren = 64;
+  int nrequests = 16;
+  int timeout_ms = 1000;
+  int max_delay_ms = 0;
+  size_t fragment_size = 0;
+  size_t noise_size = 0;
+  int drop_percent = 0;
+  unsigned seed = 1;
+};
+
+// Written by children to a shared pipe. It is smaller than PIPE_BUF, so
+// records from different children never interleave.
+struct result {
+  int32_t err;
+  int32_t reserved;
+  int64_t latency_ns;
+};
+
+struct fake_tty {
+  int master;
+  pid_t pid;
+  std::string in;      // bytes from the child since its last request
+  std::string out;     // reply bytes not yet written
+  int64_t write_at_ns; // when the next fragment of out is due
+};
+
+static int64_t monotonic_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void usage(FILE *f) {
+  fprintf(f, "usage: tty_transfer_stress [-n children] [-r requests] "
+             "[-t timeout_ms]\n"
+             "                           [-d max_delay_ms] "
+             "[-f fragment_size] [-x noise_size]\n"
+             "                           [-p drop_percent] [-s seed]\n");
+}
+
+// Traffic a terminal might send ahead of the reply. None of it is a cursor
+// position report, which would end the request early.
+static std::string make_noise(size_t size, std::mt19937 &rng) {
+  static const char *units[] = {
+      "plain text ",
+      "\e[?62;4;22c",                       // device attributes
+      "\e]11;rgb:0000/0000/0000\e\\",       // background color
+      "\e]1337;RemoteHost=user@host\a",     // unrelated OSC 1337
+      "\e]1337;IOToken=bad;" UUID_VAL "\e\\", // malformed token
+  };
+
+  size_t nunits = sizeof(units) / sizeof(*units);
+  std::uniform_int_distribution<size_t> pick(0, nunits - 1);
+
+  std::string noise;
+  while (noise.size() < size)
+    noise += units[pick(rng)];
+
+  return noise;
+}
+
+static void run_child(const stress_options &o, int go_fd, int results_fd) {
+  // Wait for every child to be spawned
+  char c;
+  while (::read(go_fd, &c, 1) == -1 && errno == EINTR)
+    ;
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.timeout_ms = o.timeout_ms;
+
+  for (int i = 0; i < o.nrequests; ++i) {
+    char token[TTY_TRANSFER_UUID_SIZE];
+    int64_t start = monotonic_ns();
+    tty_transfer_errno err =
+        tty_transfer_request_io_token_ex(&opts, token, sizeof(token));
+
+    result r;
+    r.err = err;
+    r.reserved = 0;
+    r.latency_ns = monotonic_ns() - start;
+    if (err == TTY_TRANSFER_OK && std::strcmp(token, UUID_VAL) != 0)
+      r.err = WRONG_TOKEN;
+
+    if (::write(results_fd, &r, sizeof(r)) != sizeof(r))
+      std::_Exit(1);
+  }
+
+  std::_Exit(0);
+}
+
+// Queue replies for every complete request the child has written
+static void respond(const stress_options &o, fake_tty &t,
+                    const std::string &noise, std::mt19937 &rng) {
+  std::uniform_int_distribution<int> delay(0, o.max_delay_ms);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  size_t end;
+  while ((end = t.in.find(CSI6N)) != std::string::npos) {
+    size_t prefix = t.in.rfind(REQUEST_PREFIX, end);
+    size_t key_start = prefix + sizeof(REQUEST_PREFIX) - 1;
+    bool has_key = prefix != std::string::npos && key_start + 36 <= end;
+
+    if (has_key && percent(rng) >= o.drop_percent) {
+      std::string key = t.in.substr(key_start, 36);
+      if (t.out.empty())
+        t.write_at_ns = monotonic_ns() + (int64_t)delay(rng) * 1000000;
+
+      // The token must be the last OSC sequence before the CPR
+      t.out += noise;
+      t.out += "\e]1337;IOToken=" + key + ";" UUID_VAL "\e\\" CPR;
+    }
+
+    t.in.erase(0, end + sizeof(CSI6N) - 1);
+  }
+
+  // Echoed input can pile up between requests
+  if (t.in.size() > 64 * 1024)
+    t.in.erase(0, t.in.size() - 1024);
+}
+
+static double percentile(const std::vector<int64_t> &sorted, double p) {
+  if (sorted.empty())
+    return 0.0;
+
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i] / 1e6;
+}
+
+static void raise_fd_limit() {
+  struct rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+  }
+}
+
+int main(int argc, char **argv) {
+  stress_options o;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hn:r:t:d:f:x:p:s:")) != -1) {
+    switch (opt) {
+    case 'h':
+      usage(stdout);
+      return 0;
+    case 'n':
+      o.nchildren = atoi(optarg);
+      break;
+    case 'r':
+      o.nrequests = atoi(optarg);
+      break;
+    case 't':
+      o.timeout_ms = atoi(optarg);
+      break;
+    case 'd':
+      o.max_delay_ms = atoi(optarg);
+      break;
+    case 'f':
+      o.fragment_size = strtoul(optarg, nullptr, 10);
+      break;
+    case 'x':
+      o.noise_size = strtoul(optarg, nullptr, 10);
+      break;
+    case 'p':
+      o.drop_percent = atoi(optarg);
+      break;
+    case 's':
+      o.seed = strtoul(optarg, nullptr, 10);
+      break;
+    default:
+      usage(stderr);
+      return 2;
+    }
+  }
+
+  if (optind != argc || o.nchildren < 1 || o.nrequests < 1 ||
+      o.max_delay_ms < 0 || o.drop_percent < 0 || o.drop_percent > 100) {
+    usage(stderr);
+    return 2;
+  }
+
+  raise_fd_limit();
+  signal(SIGPIPE, SIG_IGN);
+
+  std::mt19937 rng(o.seed);
+  std::string noise = make_noise(o.noise_size, rng);
+
+  int go[2], results[2];
+  if (::pipe(go) == -1 || ::pipe(results) == -1) {
+    perror("tty_transfer_stress: pipe");
+    return 1;
+  }
+
+  std::vector<fake_tty> ttys;
+  ttys.reserve(o.nchildren);
+
+  for (int i = 0; i < o.nchildren; ++i) {
+    fake_tty t;
+    t.pid = forkpty(&t.master, nullptr, nullptr, nullptr);
+    if (t.pid == -1) {
+      fprintf(stderr, "tty_transfer_stress: forkpty failed after %d children"
+                      ": %s\n",
+              i, strerror(errno));
+      break;
+    }
+
+    if (t.pid == 0) {
+      // Don't hold every earlier child's tty open for the whole run
+      for (const fake_tty &other : ttys)
+        ::close(other.master);
+
+      ::close(go[1]);
+      ::close(results[0]);
+      run_child(o, go[0], results[1]);
+    }
+
+    ::fcntl(t.master, F_SETFL, ::fcntl(t.master, F_GETFL) | O_NONBLOCK);
+    t.write_at_ns = 0;
+    ttys.push_back(std::move(t));
+  }
+
+  ::close(go[0]);
+  ::close(results[1]);
+
+  std::vector<result> records;
+  records.reserve((size_t)ttys.size() * o.nrequests);
+
+  // Release the children
+  int64_t start = monotonic_ns();
+  ::close(go[1]);
+
+  std::vector<pollfd> pfds;
+  std::vector<size_t> pfd_tty;
+  size_t nopen = ttys.size();
+  bool results_open = true;
+  char buf[4096];
+
+  while (nopen || results_open) {
+    int64_t now = monotonic_ns();
+    int timeout = 100;
+
+    pfds.clear();
+    pfd_tty.clear();
+    for (size_t i = 0; i < ttys.size(); ++i) {
+      fake_tty &t = ttys[i];
+      if (t.master == -1)
+        continue;
+
+      short events = POLLIN;
+      if (!t.out.empty()) {
+        if (t.write_at_ns <= now) {
+          events |= POLLOUT;
+        } else {
+          int until = (int)((t.write_at_ns - now + 999999) / 1000000);
+          timeout = std::min(timeout, until);
+        }
+      }
+
+      pfds.push_back({t.master, events, 0});
+      pfd_tty.push_back(i);
+    }
+
+    if (results_open)
+      pfds.push_back({results[0], POLLIN, 0});
+
+    if (::poll(pfds.data(), pfds.size(), timeout) == -1) {
+      if (errno == EINTR)
+        continue;
+
+      perror("tty_transfer_stress: poll");
+      return 1;
+    }
+
+    for (size_t k = 0; k < pfd_tty.size(); ++k) {
+      fake_tty &t = ttys[pfd_tty[k]];
+      short revents = pfds[k].revents;
+
+      if (revents & POLLOUT) {
+        size_t n = t.out.size();
+        if (o.fragment_size && o.fragment_size < n)
+          n = o.fragment_size;
+
+        ssize_t nwritten = ::write(t.master, t.out.data(), n);
+        if (nwritten > 0)
+          t.out.erase(0, nwritten);
+      }
+
+      if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        ssize_t nread = ::read(t.master, buf, sizeof(buf));
+        if (nread > 0) {
+          t.in.append(buf, nread);
+          respond(o, t, noise, rng);
+        } else if (nread == 0 || (errno != EAGAIN && errno != EINTR)) {
+          // The child exited and closed its end of the pty
+          ::close(t.master);
+          t.master = -1;
+          --nopen;
+        }
+      }
+    }
+
+    if (results_open && pfds.back().revents) {
+      result r[256];
+      ssize_t nread;
+      while ((nread = ::read(results[0], r, sizeof(r))) == -1 &&
+             errno == EINTR)
+        ;
+
+      if (nread > 0)
+        records.insert(records.end(), r, r + nread / sizeof(result));
+      else
+        results_open = false;
+    }
+  }
+
+  double elapsed_s = (monotonic_ns() - start) / 1e9;
+
+  int nabnormal = 0;
+  for (const fake_tty &t : ttys) {
+    int status;
+    if (::waitpid(t.pid, &status, 0) != t.pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      ++nabnormal;
+  }
+
+  std::vector<int64_t> latencies;
+  size_t nok = 0, ntimeout = 0, nwrong = 0, nother = 0;
+  for (const result &r : records) {
+    switch (r.err) {
+    case TTY_TRANSFER_OK:
+      ++nok;
+      latencies.push_back(r.latency_ns);
+      break;
+    case TTY_TRANSFER_TIMEOUT:
+      ++ntimeout;
+      break;
+    case WRONG_TOKEN:
+      ++nwrong;
+      break;
+    default:
+      ++nother;
+      break;
+    }
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  printf("children %zu, requests %zu in %.3f s\n", ttys.size(),
+         records.size(), elapsed_s);
+  printf("ok %zu, timeout %zu, wrong token %zu, other errors %zu\n", nok,
+         ntimeout, nwrong, nother);
+  printf("throughput %.1f req/s\n", elapsed_s > 0 ? nok / elapsed_s : 0.0);
+  printf("ok latency ms p50 %.3f, p99 %.3f, p999 %.3f, max %.3f\n",
+         percentile(latencies, 0.5), percentile(latencies, 0.99),
+         percentile(latencies, 0.999), percentile(latencies, 1.0));
+
+  if (nabnormal)
+    printf("%d children exited abnormally\n", nabnormal);
+
+  return nabnormal || nwrong ? 1 : 0;
+}
@@ -9,6 +9,8 @@
 #define TTY_TRANSFER_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <time.h>
 
 #ifndef TTY_TRANSFER_API
 #define TTY_TRANSFER_API
@@ -18,6 +20,27 @@
 extern "C" {
 #endif
 
+/**
+ * Hooks for the heap memory the library allocates
+ */
+typedef struct tty_transfer_allocator {
+  /** Allocate size bytes aligned for any type, or return NULL */
+  void *(*alloc)(void *ctx, size_t size);
+  /** Free memory returned by alloc */
+  void (*free)(void *ctx, void *ptr);
+  /** Passed to alloc and free */
+  void *ctx;
+} tty_transfer_allocator;
+
+/**
+ * Replace the allocator the library uses for heap memory
+ * @param[in] a The allocator to copy, or NULL to restore malloc and free
+ * @remarks This is not thread safe and must be called before any library
+ * object is allocated, since objects are freed with the current allocator
+ */
+TTY_TRANSFER_API void
+tty_transfer_set_allocator(const tty_transfer_allocator *a);
+
 /**
  * Type that encapsulates parsing tty I/O transfer tokens
  */
@@ -33,12 +56,38 @@ TTY_TRANSFER_API tty_transfer_parser *tty_transfer_parser_alloc();
 
 /**
  * Free a tty_transfer_parser
+ * @remarks Only pass parsers from tty_transfer_parser_alloc
  */
 TTY_TRANSFER_API void tty_transfer_parser_free(tty_transfer_parser *p);
 
+/**
+ * Size of a tty_transfer_parser
+ * @returns The number of bytes of storage tty_transfer_parser_init needs
+ */
+TTY_TRANSFER_API size_t tty_transfer_parser_sizeof();
+
+/**
+ * Alignment of a tty_transfer_parser
+ * @returns The alignment of storage tty_transfer_parser_init needs
+ */
+TTY_TRANSFER_API size_t tty_transfer_parser_alignof();
+
+/**
+ * Initialize a tty_transfer_parser in caller provided storage
+ * @param[in] storage The storage for the parser
+ * @param[in] storage_size The size of storage in bytes
+ * @returns The initialized parser, or NULL if storage is too small or not
+ * aligned to tty_transfer_parser_alignof
+ * @remarks The parser owns no other resources, so the storage may be reused
+ * or released without calling tty_transfer_parser_free
+ */
+TTY_TRANSFER_API tty_transfer_parser *
+tty_transfer_parser_init(void *storage, size_t storage_size);
+
 /**
  * Reset a tty_transfer_parser state as if newly initialized
  * @param[in] p The parser
+ * @remarks The mode set by tty_transfer_parser_set_mode is preserved
  */
 TTY_TRANSFER_API void tty_transfer_parser_reset(tty_transfer_parser *p);
 
@@ -66,6 +115,125 @@ TTY_TRANSFER_API const char *
 tty_transfer_parser_token_for_key(const tty_transfer_parser *p,
                                   const char *key);
 
+/** Maximum number of distinct I/O tokens recorded in
+ * TTY_TRANSFER_PARSER_ALL_TOKENS mode */
+#define TTY_TRANSFER_PARSER_MAX_TOKENS 16
+
+/**
+ * Constants selecting which I/O tokens a parser keeps
+ */
+typedef enum tty_transfer_parser_mode {
+  /** Only a token in the last OSC sequence is kept (default) */
+  TTY_TRANSFER_PARSER_LAST_TOKEN = 0,
+  /** Every token since the last reset is kept, up to
+   * TTY_TRANSFER_PARSER_MAX_TOKENS distinct keys */
+  TTY_TRANSFER_PARSER_ALL_TOKENS = 1,
+} tty_transfer_parser_mode;
+
+/**
+ * Select which I/O tokens a parser keeps
+ * @param[in] p The parser
+ * @param[in] mode The mode
+ * @remarks This implicitly resets the parser with tty_transfer_parser_reset.
+ * In TTY_TRANSFER_PARSER_ALL_TOKENS mode, a later token for the same key
+ * replaces the earlier one, and tokens for new keys are dropped once
+ * TTY_TRANSFER_PARSER_MAX_TOKENS keys are recorded.
+ */
+TTY_TRANSFER_API void
+tty_transfer_parser_set_mode(tty_transfer_parser *p,
+                             tty_transfer_parser_mode mode);
+
+/**
+ * Count the parsed I/O tokens
+ * @param[in] p The parser
+ * @returns The number of tokens that can be accessed with
+ * tty_transfer_parser_token_at
+ */
+TTY_TRANSFER_API size_t
+tty_transfer_parser_token_count(const tty_transfer_parser *p);
+
+/**
+ * Access a parsed I/O token by index
+ * @param[in] p The parser
+ * @param[in] i The index of the token, less than
+ * tty_transfer_parser_token_count
+ * @param[out] key Set to the UUID key of the token (may be NULL)
+ * @returns A pointer to the parsed token, or NULL if i is out of range
+ * @remarks The returned pointers are invalidated by calling
+ * tty_transfer_parser_feed, tty_transfer_parser_reset or
+ * tty_transfer_parser_free
+ */
+TTY_TRANSFER_API const char *
+tty_transfer_parser_token_at(const tty_transfer_parser *p, size_t i,
+                             const char **key);
+
+/**
+ * Access parsed I/O tokens for many keys at once
+ * @param[in] p The parser
+ * @param[in] keys The UUID keys to look up
+ * @param[out] tokens Set to the parsed token for each key, or NULL
+ * @param[in] nkeys The number of elements in keys and tokens
+ * @returns The number of keys that have a parsed token
+ * @remarks Each lookup is equivalent to tty_transfer_parser_token_for_key
+ */
+TTY_TRANSFER_API size_t
+tty_transfer_parser_tokens_for_keys(const tty_transfer_parser *p,
+                                    const char *const *keys,
+                                    const char **tokens, size_t nkeys);
+
+/**
+ * Binary form of a UUID, as used for I/O token keys and values
+ */
+typedef struct tty_transfer_uuid {
+  unsigned char bytes[16];
+} tty_transfer_uuid;
+
+/**
+ * Parse a formatted UUID
+ * @param[in] str The null terminated UUID (like
+ * 68338148-030e-436c-89eb-9f905860f83b). Hex digits may be either case.
+ * @param[out] uuid The parsed UUID
+ * @returns 1 if str is a formatted UUID, 0 otherwise
+ */
+TTY_TRANSFER_API int tty_transfer_uuid_parse(const char *str,
+                                             tty_transfer_uuid *uuid);
+
+/**
+ * Format a UUID with lowercase hex digits
+ * @param[in] uuid The UUID
+ * @param[out] buf The buffer to hold the null terminated formatted UUID. This
+ * must be at least 37 chars.
+ */
+TTY_TRANSFER_API void tty_transfer_uuid_format(const tty_transfer_uuid *uuid,
+                                               char *buf);
+
+/**
+ * Access a parsed I/O token by binary key
+ * @param[in] p The parser
+ * @param[in] key The UUID key associated with the IO token request
+ * @returns A pointer to the parsed token, or NULL
+ * @remarks This avoids formatting and parsing keys as strings. The returned
+ * pointer is invalidated like with tty_transfer_parser_token_at.
+ */
+TTY_TRANSFER_API const tty_transfer_uuid *
+tty_transfer_parser_token_for_uuid(const tty_transfer_parser *p,
+                                   const tty_transfer_uuid *key);
+
+/**
+ * Access parsed I/O tokens for many binary keys at once
+ * @param[in] p The parser
+ * @param[in] keys The UUID keys to look up
+ * @param[out] tokens Set to the parsed token for each key, or NULL
+ * @param[in] nkeys The number of elements in keys and tokens
+ * @returns The number of keys that have a parsed token
+ * @remarks Each lookup is equivalent to tty_transfer_parser_token_for_uuid
+ */
+TTY_TRANSFER_API size_t
+tty_transfer_parser_tokens_for_uuids(const tty_transfer_parser *p,
+                                     const tty_transfer_uuid *keys,
+                                     const tty_transfer_uuid **tokens,
+                                     size_t nkeys);
+
 /**
  * Constants representing error conditions
  */
@@ -90,6 +258,20 @@ typedef enum tty_transfer_errno {
   TTY_TRANSFER_TOKEN_TRUNCATED = 7,
   /** timed out */
   TTY_TRANSFER_TIMEOUT = 8,
+  /** request has not completed yet */
+  TTY_TRANSFER_IN_PROGRESS = 9,
+  /** request was canceled */
+  TTY_TRANSFER_CANCELED = 10,
+  /** tty could not be opened */
+  TTY_TRANSFER_BAD_OPEN = 11,
+  /** no room for another token */
+  TTY_TRANSFER_FULL = 12,
+  /** token was not accepted */
+  TTY_TRANSFER_REJECTED = 13,
+  /** terminal is cached as not supporting I/O tokens */
+  TTY_TRANSFER_UNSUPPORTED = 14,
+  /** random keys could not be generated */
+  TTY_TRANSFER_NO_ENTROPY = 15,
 } tty_transfer_errno;
 
 /**
@@ -102,6 +284,276 @@ typedef enum tty_transfer_errno {
 TTY_TRANSFER_API tty_transfer_errno
 tty_transfer_request_io_token(char *token_buf, size_t token_buf_size);
 
+/**
+ * Timing and traffic of a single I/O token request
+ * @remarks Times are nanoseconds since the request started, or 0 if the
+ * event did not happen
+ */
+typedef struct tty_transfer_request_stats {
+  /** The request was completely written */
+  int64_t written_ns;
+  /** The first byte of the reply was read */
+  int64_t first_read_ns;
+  /** The OSC sequence with the I/O token was parsed */
+  int64_t token_ns;
+  /** The cursor position report ending the reply was received */
+  int64_t cpr_ns;
+  /** The request ended and the tty was restored */
+  int64_t total_ns;
+  /** Time spent changing and restoring the termios attributes */
+  int64_t termios_ns;
+  /** Number of reads from the tty */
+  size_t nreads;
+  /** Number of bytes given to the parser */
+  size_t nbytes;
+  /** Number of OSC sequences seen */
+  size_t nosc;
+  /** Number of CSI sequences seen */
+  size_t ncsi;
+  /** Number of system calls made to wait for, write and read the tty */
+  size_t nsyscalls;
+} tty_transfer_request_stats;
+
+/**
+ * Constants selecting how a request uses the terminal capability cache
+ * described in tty_transfer/caps.h
+ */
+typedef enum tty_transfer_caps_mode {
+  /** Neither read nor update the cache (default) */
+  TTY_TRANSFER_CAPS_IGNORE = 0,
+  /** Fail with TTY_TRANSFER_UNSUPPORTED without writing to a terminal cached
+   * as not supporting I/O tokens, and cache the result */
+  TTY_TRANSFER_CAPS_CACHE = 1,
+  /** Probe the terminal whatever is cached and cache the result */
+  TTY_TRANSFER_CAPS_REFRESH = 2,
+} tty_transfer_caps_mode;
+
+/**
+ * Options for requesting an IO token
+ */
+typedef struct tty_transfer_request_options {
+  /** The tty to read the reply from. Defaults to STDIN_FILENO */
+  int in_fd;
+  /** The tty to write the request to. Defaults to STDOUT_FILENO */
+  int out_fd;
+  /** Path of a tty to open and use instead of in_fd and out_fd, or NULL */
+  const char *tty_path;
+  /** How long to wait for the reply in milliseconds. Defaults to 500 */
+  int timeout_ms;
+  /** Absolute CLOCK_MONOTONIC time to stop waiting for the reply. Overrides
+   * timeout_ms unless zero, which is the default */
+  struct timespec deadline;
+  /** File descriptor (like an eventfd or pipe) that aborts the wait as soon
+   * as it is readable, or -1. It is never read. Defaults to -1 */
+  int cancel_fd;
+  /** Filled in when the request ends, or NULL. Requests that fail to start
+   * leave it untouched. Defaults to NULL */
+  tty_transfer_request_stats *stats;
+  /** How the terminal capability cache is used. Defaults to
+   * TTY_TRANSFER_CAPS_IGNORE */
+  tty_transfer_caps_mode caps_mode;
+  /** Milliseconds to share a token with later requests from any process on
+   * the same terminal, or 0 to not share. Only
+   * tty_transfer_request_io_token_ex shares tokens. This must not exceed how
+   * long the host honors its tokens. Defaults to 0 */
+  int token_cache_ms;
+} tty_transfer_request_options;
+
+/**
+ * Initialize request options with defaults
+ * @param[out] opts The options to initialize
+ */
+TTY_TRANSFER_API void
+tty_transfer_request_options_init(tty_transfer_request_options *opts);
+
+/**
+ * Synchronously request an IO token to transfer a TTY
+ * @param[in] opts The options for the request, or NULL for defaults
+ * @param[out] token_buf The buffer to hold the null terminated output token
+ * @param[in] token_buf_size The size of token_buf in chars. This must be at
+ * least 37 to hold a null terminated formatted UUID
+ * @returns An error code constant
+ * @remarks tty_transfer_request_io_token is equivalent to calling this with
+ * default options. With a positive token_cache_ms, a token another process
+ * obtained on the same terminal is reused without a round trip, and
+ * processes requesting at the same time wait for a single round trip. The
+ * stats option is left untouched when a shared token is reused.
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_request_io_token_ex(const tty_transfer_request_options *opts,
+                                 char *token_buf, size_t token_buf_size);
+
+/**
+ * Synchronously request many IO tokens in as few round trips as possible
+ * @param[in] opts The options for the requests, or NULL for defaults
+ * @param[out] token_bufs The buffer to hold ntokens consecutive null
+ * terminated output tokens, each occupying token_buf_size chars
+ * @param[in] token_buf_size The size of each token in token_bufs in chars.
+ * This must be at least 37 to hold a null terminated formatted UUID
+ * @param[out] results The result for each token (may be NULL)
+ * @param[in] ntokens The number of tokens to request
+ * @returns TTY_TRANSFER_OK if every token was received, otherwise the first
+ * result that is not TTY_TRANSFER_OK
+ * @remarks Up to TTY_TRANSFER_PARSER_MAX_TOKENS requests are written
+ * together, followed by a single cursor position query, so each group of
+ * tokens costs one terminal round trip. If a round trip fails, every token
+ * it and later groups would have received reports the same error. The
+ * timeout, deadline and stats options apply to each round trip.
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_request_io_tokens_ex(const tty_transfer_request_options *opts,
+                                  char *token_bufs, size_t token_buf_size,
+                                  tty_transfer_errno *results, size_t ntokens);
+
+/**
+ * Type that encapsulates an I/O token request driven by an event loop
+ */
+typedef struct tty_transfer_request_ tty_transfer_request;
+
+/** The request is waiting for its tty to become readable */
+#define TTY_TRANSFER_EVENT_READ 0x1
+/** The request is waiting for its tty to become writable */
+#define TTY_TRANSFER_EVENT_WRITE 0x2
+
+/**
+ * Begin requesting an IO token without blocking
+ * @param[in] in_fd The tty to read the reply from
+ * @param[in] out_fd The tty to write the request to
+ * @param[in] timeout_ms How long to wait for the reply in milliseconds
+ * @param[out] req Set to the new request, or NULL if an error is returned
+ * @returns TTY_TRANSFER_IN_PROGRESS on success, or an error code
+ * @remarks The tty is put in raw mode until tty_transfer_request_finish is
+ * called. The request sequence is written when tty_transfer_request_step is
+ * called with TTY_TRANSFER_EVENT_WRITE. The tty modes are changed with
+ * TCSANOW, so neither this nor tty_transfer_request_finish waits for pending
+ * output to drain.
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_request_begin(int in_fd, int out_fd, int timeout_ms,
+                           tty_transfer_request **req);
+
+/**
+ * Begin requesting an IO token without blocking
+ * @param[in] opts The options for the request, or NULL for defaults. The
+ * cancel_fd option is ignored since the caller's event loop does the waiting.
+ * @param[out] req Set to the new request, or NULL if an error is returned
+ * @returns TTY_TRANSFER_IN_PROGRESS on success, or an error code
+ * @remarks A tty opened from tty_path is closed by
+ * tty_transfer_request_finish. Like tty_transfer_request_begin, this never
+ * waits for pending output to drain.
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_request_begin_ex(const tty_transfer_request_options *opts,
+                              tty_transfer_request **req);
+
+/**
+ * Access the file descriptor a request is waiting on
+ * @param[in] req The request
+ * @returns The file descriptor to wait on for tty_transfer_request_events
+ */
+TTY_TRANSFER_API int tty_transfer_request_fd(const tty_transfer_request *req);
+
+/**
+ * Access the events a request is waiting for
+ * @param[in] req The request
+ * @returns A combination of TTY_TRANSFER_EVENT_READ and
+ * TTY_TRANSFER_EVENT_WRITE, or 0 if the request is complete
+ */
+TTY_TRANSFER_API int
+tty_transfer_request_events(const tty_transfer_request *req);
+
+/**
+ * Time remaining before a request times out
+ * @param[in] req The request
+ * @returns Milliseconds until the request times out, rounded up, or 0 if the
+ * deadline has passed
+ */
+TTY_TRANSFER_API int
+tty_transfer_request_timeout_ms(const tty_transfer_request *req);
+
+/**
+ * Advance a request after its file descriptor is ready or a timeout passes
+ * @param[in] req The request
+ * @param[in] revents The ready events. Report error or hangup conditions as
+ * TTY_TRANSFER_EVENT_READ. Pass 0 to only check the deadline.
+ * @returns TTY_TRANSFER_IN_PROGRESS if the request should keep waiting,
+ * otherwise the result of the request
+ * @remarks This reads from the tty at most once and does not block when
+ * revents reports it as readable
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_request_step(tty_transfer_request *req, int revents);
+
+/**
+ * Advance a request with bytes the caller already read from its tty
+ * @param[in] req The request
+ * @param[in] bytes The bytes read from the tty
+ * @param[in] nbytes The number of bytes
+ * @returns TTY_TRANSFER_IN_PROGRESS if the request should keep waiting,
+ * otherwise the result of the request
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_request_feed(tty_transfer_request *req, const void *bytes,
+                          size_t nbytes);
+
+/**
+ * Restore the tty, retrieve the token and free a request
+ * @param[in] req The request
+ * @param[out] token_buf The buffer to hold the null terminated output token,
+ * or NULL to discard it
+ * @param[in] token_buf_size The size of token_buf in chars. This must be at
+ * least 37 to hold a null terminated formatted UUID
+ * @returns The result of the request, which is TTY_TRANSFER_IN_PROGRESS if it
+ * was abandoned before completing
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_request_finish(tty_transfer_request *req, char *token_buf,
+                            size_t token_buf_size);
+
+/** Number of buckets in each tty_transfer_stats latency histogram */
+#define TTY_TRANSFER_STATS_BUCKETS 32
+
+/**
+ * Counters aggregated over every request that ended in this process
+ * @remarks Histogram bucket i counts requests whose latency in microseconds
+ * was in [2^i, 2^(i+1)). The first bucket also counts faster requests and
+ * the last bucket also counts slower ones. Requests that fail to start are
+ * not counted.
+ */
+typedef struct tty_transfer_stats {
+  /** Number of requests that ended */
+  uint64_t nrequests;
+  /** Number of requests that ended with TTY_TRANSFER_OK */
+  uint64_t nok;
+  /** Number of requests that ended with TTY_TRANSFER_TIMEOUT */
+  uint64_t ntimeouts;
+  /** Total of tty_transfer_request_stats nreads */
+  uint64_t nreads;
+  /** Total of tty_transfer_request_stats nbytes */
+  uint64_t nbytes;
+  /** Total of tty_transfer_request_stats nosc */
+  uint64_t nosc;
+  /** Total of tty_transfer_request_stats ncsi */
+  uint64_t ncsi;
+  /** Total of tty_transfer_request_stats nsyscalls */
+  uint64_t nsyscalls;
+  /** Total of tty_transfer_request_stats termios_ns */
+  uint64_t termios_ns;
+  /** Histogram of tty_transfer_request_stats total_ns */
+  uint64_t total_us_log2[TTY_TRANSFER_STATS_BUCKETS];
+  /** Histogram of tty_transfer_request_stats first_read_ns for requests that
+   * read a reply */
+  uint64_t first_read_us_log2[TTY_TRANSFER_STATS_BUCKETS];
+} tty_transfer_stats;
+
+/**
+ * Read the process-wide request counters
+ * @param[out] stats The current counters
+ * @remarks Counters are updated without locks, so a snapshot taken while
+ * requests end may include only part of a request
+ */
+TTY_TRANSFER_API void tty_transfer_stats_snapshot(tty_transfer_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
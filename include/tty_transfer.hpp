@@ -0,0 +1,747 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_HPP
+#define TTY_TRANSFER_HPP
+
+#include "tty_transfer.h"
+#include "tty_transfer/session.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string_view>
+#include <utility>
+
+namespace tty_transfer {
+
+/**
+ * Buffer for a null terminated formatted UUID
+ */
+using token = std::array<char, 37>;
+
+/**
+ * Policy giving basic_parser the behavior of tty_transfer_parser in
+ * TTY_TRANSFER_PARSER_LAST_TOKEN mode
+ */
+struct default_parser_policy {
+  /** Capacity of the OSC string buffer in chars, including a terminator.
+   * Longer OSC strings are truncated and will not parse as a token. */
+  static constexpr std::size_t osc_capacity = 128;
+
+  /** Number of tokens to track. With 1, only the last parsed token is kept
+   * and any other OSC string invalidates it. */
+  static constexpr std::size_t max_keys = 1;
+
+  /** Whether whitespace may surround the fields of the OSC string */
+  static constexpr bool tolerate_whitespace = true;
+};
+
+/**
+ * Policy giving basic_parser the behavior of tty_transfer_parser in
+ * TTY_TRANSFER_PARSER_ALL_TOKENS mode
+ */
+struct all_tokens_parser_policy : default_parser_policy {
+  static constexpr std::size_t max_keys = TTY_TRANSFER_PARSER_MAX_TOKENS;
+};
+
+namespace detail {
+
+// Same states, actions and byte classes as the VT500 style recognizer
+// behind tty_transfer_parser_feed, evaluated at compile time
+enum vt_state : std::uint8_t {
+  vt_ground,
+  vt_escape,
+  vt_escape_intermediate,
+  vt_csi_entry,
+  vt_csi_param,
+  vt_csi_intermediate,
+  vt_csi_ignore,
+  vt_dcs_entry,
+  vt_dcs_param,
+  vt_dcs_intermediate,
+  vt_dcs_passthrough,
+  vt_dcs_ignore,
+  vt_osc_string,
+  vt_osc_esc,
+  vt_sos_pm_apc_string,
+  vt_nstates
+};
+
+enum vt_action : std::uint8_t {
+  vt_none,
+  vt_osc_start,
+  vt_osc_put,
+  vt_osc_end,
+  vt_csi_start,
+  vt_cpr
+};
+
+enum vt_class : std::uint8_t {
+  vt_class_c0,
+  vt_class_bel,
+  vt_class_can,
+  vt_class_esc,
+  vt_class_inter,
+  vt_class_param,
+  vt_class_colon,
+  vt_class_priv,
+  vt_class_csi,
+  vt_class_osc,
+  vt_class_dcs,
+  vt_class_sos,
+  vt_class_st,
+  vt_class_cpr,
+  vt_class_final,
+  vt_class_del,
+  vt_class_high,
+  vt_nclasses
+};
+
+constexpr vt_class vt_classify(unsigned b) {
+  if (b == 0x07)
+    return vt_class_bel;
+  if (b == 0x18 || b == 0x1a)
+    return vt_class_can;
+  if (b == 0x1b)
+    return vt_class_esc;
+  if (b < 0x20)
+    return vt_class_c0;
+  if (b < 0x30)
+    return vt_class_inter;
+  if (b == ':')
+    return vt_class_colon;
+  if (b < 0x3c)
+    return vt_class_param;
+  if (b < 0x40)
+    return vt_class_priv;
+
+  switch (b) {
+  case '[':
+    return vt_class_csi;
+  case ']':
+    return vt_class_osc;
+  case 'P':
+    return vt_class_dcs;
+  case 'X':
+  case '^':
+  case '_':
+    return vt_class_sos;
+  case '\\':
+    return vt_class_st;
+  case 'R':
+    return vt_class_cpr;
+  default:
+    break;
+  }
+
+  if (b < 0x7f)
+    return vt_class_final;
+  if (b == 0x7f)
+    return vt_class_del;
+  return vt_class_high;
+}
+
+constexpr std::uint8_t vt_pack(vt_action a, vt_state s) {
+  return static_cast<std::uint8_t>((a << 4) | s);
+}
+
+constexpr bool vt_is_execute(vt_class c) {
+  return c == vt_class_c0 || c == vt_class_bel || c == vt_class_del;
+}
+
+// Bytes from 0x40 to 0x7e
+constexpr bool vt_is_final(vt_class c) {
+  return c >= vt_class_csi && c <= vt_class_final;
+}
+
+constexpr std::uint8_t vt_csi_transition(vt_state s, vt_class c) {
+  if (vt_is_execute(c))
+    return vt_pack(vt_none, s);
+  if (c == vt_class_high)
+    return vt_pack(vt_none, vt_csi_ignore);
+  if (c == vt_class_cpr)
+    return vt_pack(s == vt_csi_ignore ? vt_none : vt_cpr, vt_ground);
+  if (vt_is_final(c))
+    return vt_pack(vt_none, vt_ground);
+  if (s == vt_csi_ignore)
+    return vt_pack(vt_none, s);
+  if (c == vt_class_inter)
+    return vt_pack(vt_none, vt_csi_intermediate);
+  if (s == vt_csi_intermediate)
+    return vt_pack(vt_none, vt_csi_ignore);
+  if (c == vt_class_priv && s != vt_csi_entry)
+    return vt_pack(vt_none, vt_csi_ignore);
+  return vt_pack(vt_none, vt_csi_param);
+}
+
+constexpr std::uint8_t vt_dcs_transition(vt_state s, vt_class c) {
+  if (vt_is_execute(c))
+    return vt_pack(vt_none, s);
+  if (c == vt_class_high)
+    return vt_pack(vt_none, vt_dcs_ignore);
+  if (vt_is_final(c))
+    return vt_pack(vt_none, vt_dcs_passthrough);
+  if (c == vt_class_inter)
+    return vt_pack(vt_none, vt_dcs_intermediate);
+  if (s == vt_dcs_intermediate)
+    return vt_pack(vt_none, vt_dcs_ignore);
+  if (c == vt_class_priv && s != vt_dcs_entry)
+    return vt_pack(vt_none, vt_dcs_ignore);
+  return vt_pack(vt_none, vt_dcs_param);
+}
+
+constexpr std::uint8_t vt_escape_transition(vt_state s, vt_class c) {
+  switch (c) {
+  case vt_class_c0:
+  case vt_class_bel:
+  case vt_class_del:
+    return vt_pack(vt_none, vt_escape);
+  case vt_class_inter:
+    return vt_pack(vt_none, vt_escape_intermediate);
+  case vt_class_csi:
+    return vt_pack(vt_csi_start, vt_csi_entry);
+  case vt_class_osc:
+    return vt_pack(vt_osc_start, vt_osc_string);
+  case vt_class_dcs:
+    return vt_pack(vt_none, vt_dcs_entry);
+  case vt_class_sos:
+    return vt_pack(vt_none, vt_sos_pm_apc_string);
+  case vt_class_st:
+    // ST ends an OSC string that was interrupted by ESC
+    return vt_pack(s == vt_osc_esc ? vt_osc_end : vt_none, vt_ground);
+  default:
+    return vt_pack(vt_none, vt_ground);
+  }
+}
+
+constexpr std::uint8_t vt_transition(vt_state s, vt_class c) {
+  if (c == vt_class_can)
+    return vt_pack(vt_none, vt_ground);
+  if (c == vt_class_esc)
+    return vt_pack(vt_none, s == vt_osc_string ? vt_osc_esc : vt_escape);
+
+  switch (s) {
+  case vt_escape:
+  case vt_osc_esc:
+    return vt_escape_transition(s, c);
+  case vt_escape_intermediate:
+    if (vt_is_execute(c) || c == vt_class_inter)
+      return vt_pack(vt_none, s);
+    return vt_pack(vt_none, vt_ground);
+  case vt_csi_entry:
+  case vt_csi_param:
+  case vt_csi_intermediate:
+  case vt_csi_ignore:
+    return vt_csi_transition(s, c);
+  case vt_dcs_entry:
+  case vt_dcs_param:
+  case vt_dcs_intermediate:
+    return vt_dcs_transition(s, c);
+  case vt_osc_string:
+    if (c == vt_class_bel)
+      return vt_pack(vt_osc_end, vt_ground);
+    if (c == vt_class_c0)
+      return vt_pack(vt_none, s);
+    return vt_pack(vt_osc_put, s);
+  default:
+    // ground and strings that are skipped until ESC
+    return vt_pack(vt_none, s);
+  }
+}
+
+inline constexpr auto vt_classes = [] {
+  std::array<std::uint8_t, 256> t{};
+  for (unsigned b = 0; b < t.size(); ++b)
+    t[b] = vt_classify(b);
+  return t;
+}();
+
+inline constexpr auto vt_transitions = [] {
+  std::array<std::array<std::uint8_t, vt_nclasses>, vt_nstates> t{};
+  for (unsigned s = 0; s < vt_nstates; ++s) {
+    for (unsigned c = 0; c < vt_nclasses; ++c)
+      t[s][c] = vt_transition(vt_state(s), vt_class(c));
+  }
+  return t;
+}();
+
+// Hex digit value + 1, or 0 for bytes that are not hex digits
+inline constexpr auto hex_values = [] {
+  std::array<std::uint8_t, 256> t{};
+  for (unsigned i = 0; i < 10; ++i)
+    t['0' + i] = i + 1;
+  for (unsigned i = 0; i < 6; ++i) {
+    t['a' + i] = i + 11;
+    t['A' + i] = i + 11;
+  }
+  return t;
+}();
+
+constexpr bool is_space(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+constexpr char ascii_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Decode the 36 chars of a formatted UUID at it, which has at least 36 chars
+constexpr bool decode_uuid(const char *it, tty_transfer_uuid &uuid) {
+  constexpr int group_bytes[] = {4, 2, 2, 2, 6};
+
+  unsigned char *bin = uuid.bytes;
+  for (int g = 0; g < 5; ++g) {
+    if (g && *it++ != '-')
+      return false;
+
+    for (int i = 0; i < group_bytes[g]; ++i) {
+      unsigned hi = hex_values[static_cast<unsigned char>(it[0])];
+      unsigned lo = hex_values[static_cast<unsigned char>(it[1])];
+      if (!(hi && lo))
+        return false;
+
+      *bin++ = static_cast<unsigned char>(((hi - 1) << 4) | (lo - 1));
+      it += 2;
+    }
+  }
+
+  return true;
+}
+
+inline bool uuid_eq(const tty_transfer_uuid &a, const tty_transfer_uuid &b) {
+  return std::memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+} // namespace detail
+
+/**
+ * Parser for I/O tokens that is specialized at compile time by a policy
+ * @remarks Parses the same replies as tty_transfer_parser, but the buffer
+ * sizes are set by Policy and the whole parser is inline, so it can live in
+ * the embedder's own objects without an allocation.
+ */
+template <typename Policy = default_parser_policy> class basic_parser {
+public:
+  static constexpr std::size_t osc_capacity = Policy::osc_capacity;
+  static constexpr std::size_t max_keys = Policy::max_keys;
+  static constexpr bool tolerate_whitespace = Policy::tolerate_whitespace;
+
+  // 1337;IOToken=<uuid-key>;<uuid-val>
+  static_assert(osc_capacity > 13 + 36 + 1 + 36,
+                "osc_capacity must hold an I/O token OSC string");
+  static_assert(max_keys >= 1, "max_keys must be at least 1");
+
+  basic_parser() noexcept { reset(); }
+
+  /**
+   * Discard all parsed tokens and any partial sequence
+   */
+  void reset() noexcept {
+    state_ = detail::vt_ground;
+    osc_len_ = 0;
+    nosc_ = 0;
+    ncsi_ = 0;
+    ntokens_ = 0;
+  }
+
+  /**
+   * Feed bytes read from the tty
+   * @param[in] bytes The bytes to parse
+   * @returns The number of bytes consumed through the cursor position report
+   * that ends the reply, or 0 if the reply has not ended
+   */
+  std::size_t feed(std::span<const char> bytes) noexcept {
+    const char *buf = bytes.data();
+    std::size_t n = bytes.size();
+    std::size_t i = 0;
+
+    while (i < n) {
+      switch (state_) {
+      case detail::vt_ground: {
+        const void *esc = std::memchr(&buf[i], '\e', n - i);
+        i = esc ? static_cast<const char *>(esc) - buf : n;
+        break;
+      }
+      case detail::vt_osc_string: {
+        std::size_t start = i;
+        while (i < n && static_cast<unsigned char>(buf[i]) > 0x1f)
+          ++i;
+        push(&buf[start], i - start);
+        break;
+      }
+      case detail::vt_dcs_passthrough:
+      case detail::vt_dcs_ignore:
+      case detail::vt_sos_pm_apc_string:
+        // Only CAN, SUB and ESC end these strings
+        while (i < n && (buf[i] < 0x18 || buf[i] > 0x1b))
+          ++i;
+        break;
+      default:
+        break;
+      }
+
+      if (i == n)
+        break;
+
+      if (step(static_cast<unsigned char>(buf[i++])))
+        return i;
+    }
+
+    return 0;
+  }
+
+  /**
+   * Feed bytes read from the tty
+   * @param[in] bytes The bytes to parse
+   * @returns The number of bytes consumed through the cursor position report
+   * that ends the reply, or 0 if the reply has not ended
+   */
+  std::size_t feed(std::span<const std::byte> bytes) noexcept {
+    return feed(std::span<const char>{
+        reinterpret_cast<const char *>(bytes.data()), bytes.size()});
+  }
+
+  /**
+   * Look up the token parsed for a key
+   * @param[in] key The key sent in the request
+   * @returns The token, or nullptr if none was parsed for the key
+   */
+  const tty_transfer_uuid *
+  token_for(const tty_transfer_uuid &key) const noexcept {
+    // Linear search is faster than hashing for the few keys of a request
+    for (std::size_t i = 0; i < ntokens_; ++i) {
+      if (detail::uuid_eq(keys_[i], key))
+        return &vals_[i];
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * Look up the token parsed for a formatted key
+   * @param[in] key The formatted UUID key sent in the request
+   * @param[out] out Set to the formatted token if one was parsed
+   * @returns Whether a token was parsed for the key
+   */
+  bool token_for(std::string_view key, token &out) const noexcept {
+    tty_transfer_uuid bin;
+    if (key.size() != 36 || !detail::decode_uuid(key.data(), bin))
+      return false;
+
+    const tty_transfer_uuid *val = token_for(bin);
+    if (!val)
+      return false;
+
+    tty_transfer_uuid_format(val, out.data());
+    return true;
+  }
+
+  /** Number of tokens currently held */
+  std::size_t token_count() const noexcept { return ntokens_; }
+
+  /** Number of OSC sequences started since the last reset */
+  std::size_t osc_count() const noexcept { return nosc_; }
+
+  /** Number of CSI sequences started since the last reset */
+  std::size_t csi_count() const noexcept { return ncsi_; }
+
+private:
+  std::uint8_t state_;
+  std::size_t osc_len_;
+  std::size_t nosc_;
+  std::size_t ncsi_;
+  std::size_t ntokens_;
+  char osc_[osc_capacity];
+  tty_transfer_uuid keys_[max_keys];
+  tty_transfer_uuid vals_[max_keys];
+
+  bool step(unsigned char c) noexcept {
+    std::uint8_t t = detail::vt_transitions[state_][detail::vt_classes[c]];
+    state_ = t & 0xf;
+
+    switch (t >> 4) {
+    case detail::vt_osc_start:
+      ++nosc_;
+      osc_len_ = 0;
+      break;
+    case detail::vt_osc_put:
+      push(reinterpret_cast<const char *>(&c), 1);
+      break;
+    case detail::vt_osc_end:
+      parse_io_token();
+      break;
+    case detail::vt_csi_start:
+      ++ncsi_;
+      break;
+    case detail::vt_cpr:
+      return true; // end of cursor position report
+    default:
+      break;
+    }
+
+    return false;
+  }
+
+  void push(const char *s, std::size_t n) noexcept {
+    std::size_t room = osc_capacity - 1 - osc_len_;
+    if (n > room)
+      n = room;
+
+    std::memcpy(&osc_[osc_len_], s, n);
+    osc_len_ += n;
+  }
+
+  static const char *skip_ws(const char *it, const char *end) noexcept {
+    if constexpr (tolerate_whitespace) {
+      while (it < end && detail::is_space(*it))
+        ++it;
+    }
+
+    return it;
+  }
+
+  static const char *parse_literal(const char *it, const char *end,
+                                   std::string_view lower_literal) noexcept {
+    it = skip_ws(it, end);
+    if (static_cast<std::size_t>(end - it) < lower_literal.size())
+      return nullptr;
+
+    for (char c : lower_literal) {
+      if (detail::ascii_lower(*it++) != c)
+        return nullptr;
+    }
+
+    return it;
+  }
+
+  static const char *parse_uuid(const char *it, const char *end,
+                                tty_transfer_uuid &uuid) noexcept {
+    it = skip_ws(it, end);
+    if (end - it < 36 || !detail::decode_uuid(it, uuid))
+      return nullptr;
+
+    return it + 36;
+  }
+
+  void parse_io_token() noexcept {
+    // Any other OSC string invalidates the last token
+    if constexpr (max_keys == 1)
+      ntokens_ = 0;
+
+    tty_transfer_uuid key, val;
+
+    const char *it = osc_;
+    const char *end = osc_ + osc_len_;
+    if (!(it = parse_literal(it, end, "1337")))
+      return;
+
+    if (!(it = parse_literal(it, end, ";")))
+      return;
+
+    if (!(it = parse_literal(it, end, "iotoken")))
+      return;
+
+    if (!(it = parse_literal(it, end, "=")))
+      return;
+
+    if (!(it = parse_uuid(it, end, key)))
+      return;
+
+    if (!(it = parse_literal(it, end, ";")))
+      return;
+
+    if (!(it = parse_uuid(it, end, val)))
+      return;
+
+    if (skip_ws(it, end) != end)
+      return;
+
+    record(key, val);
+  }
+
+  void record(const tty_transfer_uuid &key,
+              const tty_transfer_uuid &val) noexcept {
+    std::size_t i = 0;
+    if constexpr (max_keys > 1) {
+      while (i < ntokens_ && !detail::uuid_eq(keys_[i], key))
+        ++i;
+    }
+
+    if (i == ntokens_) {
+      if (ntokens_ >= max_keys)
+        return;
+
+      keys_[ntokens_++] = key;
+    }
+
+    vals_[i] = val;
+  }
+};
+
+/**
+ * Parser with the behavior of tty_transfer_parser
+ */
+using parser = basic_parser<>;
+
+/**
+ * Owner of a tty_transfer_session
+ */
+class session {
+public:
+  session() noexcept = default;
+  session(const session &) = delete;
+  session &operator=(const session &) = delete;
+
+  session(session &&other) noexcept
+      : session_{std::exchange(other.session_, nullptr)} {}
+
+  session &operator=(session &&other) noexcept {
+    if (this != &other) {
+      close();
+      session_ = std::exchange(other.session_, nullptr);
+    }
+
+    return *this;
+  }
+
+  ~session() { close(); }
+
+  /**
+   * Open the session, closing any session already held
+   * @param[in] opts The options for the session's requests, or nullptr for
+   * defaults
+   * @param[in] drain How to handle pending tty input and output
+   * @returns An error code constant
+   */
+  tty_transfer_errno
+  open(const tty_transfer_request_options *opts = nullptr,
+       tty_transfer_drain_policy drain = TTY_TRANSFER_DRAIN_OUTPUT) noexcept {
+    close();
+    return tty_transfer_session_open(opts, drain, &session_);
+  }
+
+  /**
+   * Request an I/O token on the session's tty
+   * @param[out] out The null terminated token
+   * @returns An error code constant
+   */
+  tty_transfer_errno request_io_token(token &out) noexcept {
+    return tty_transfer_session_request_io_token(session_, out.data(),
+                                                 out.size());
+  }
+
+  /**
+   * Restore the tty and close the session if one is open
+   */
+  void close() noexcept {
+    if (session_)
+      tty_transfer_session_close(std::exchange(session_, nullptr));
+  }
+
+  explicit operator bool() const noexcept { return session_; }
+
+  tty_transfer_session *get() const noexcept { return session_; }
+
+private:
+  tty_transfer_session *session_ = nullptr;
+};
+
+/**
+ * Owner of a tty_transfer_request driven by the caller's event loop
+ * @remarks A request that is destroyed before it is finished is abandoned
+ * and its tty is restored
+ */
+class request {
+public:
+  request() noexcept = default;
+  request(const request &) = delete;
+  request &operator=(const request &) = delete;
+
+  request(request &&other) noexcept
+      : request_{std::exchange(other.request_, nullptr)} {}
+
+  request &operator=(request &&other) noexcept {
+    if (this != &other) {
+      abandon();
+      request_ = std::exchange(other.request_, nullptr);
+    }
+
+    return *this;
+  }
+
+  ~request() { abandon(); }
+
+  /**
+   * Begin the request, abandoning any request already held
+   * @param[in] opts The options for the request, or nullptr for defaults
+   * @returns TTY_TRANSFER_IN_PROGRESS on success, or an error code
+   */
+  tty_transfer_errno
+  begin(const tty_transfer_request_options *opts = nullptr) noexcept {
+    abandon();
+    return tty_transfer_request_begin_ex(opts, &request_);
+  }
+
+  /** The file descriptor to wait on */
+  int fd() const noexcept { return tty_transfer_request_fd(request_); }
+
+  /** The TTY_TRANSFER_EVENT_* events to wait for */
+  int events() const noexcept { return tty_transfer_request_events(request_); }
+
+  /** Milliseconds until the request times out */
+  int timeout_ms() const noexcept {
+    return tty_transfer_request_timeout_ms(request_);
+  }
+
+  /**
+   * Advance the request after its file descriptor is ready
+   * @param[in] revents The ready TTY_TRANSFER_EVENT_* events
+   * @returns TTY_TRANSFER_IN_PROGRESS or the result of the request
+   */
+  tty_transfer_errno step(int revents) noexcept {
+    return tty_transfer_request_step(request_, revents);
+  }
+
+  /**
+   * Advance the request with bytes the caller read from its tty
+   * @param[in] bytes The bytes read from the tty
+   * @returns TTY_TRANSFER_IN_PROGRESS or the result of the request
+   */
+  tty_transfer_errno feed(std::span<const char> bytes) noexcept {
+    return tty_transfer_request_feed(request_, bytes.data(), bytes.size());
+  }
+
+  /**
+   * Restore the tty and retrieve the token
+   * @param[out] out The null terminated token
+   * @returns The result of the request
+   */
+  tty_transfer_errno finish(token &out) noexcept {
+    return tty_transfer_request_finish(std::exchange(request_, nullptr),
+                                       out.data(), out.size());
+  }
+
+  explicit operator bool() const noexcept { return request_; }
+
+  tty_transfer_request *get() const noexcept { return request_; }
+
+private:
+  tty_transfer_request *request_ = nullptr;
+
+  void abandon() noexcept {
+    if (request_)
+      tty_transfer_request_finish(std::exchange(request_, nullptr), nullptr,
+                                  0);
+  }
+};
+
+} // namespace tty_transfer
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_BROKER_H
+#define TTY_TRANSFER_BROKER_H
+
+#include "tty_transfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Type that requests I/O tokens on many ttys concurrently from one thread
+ */
+typedef struct tty_transfer_broker_ tty_transfer_broker;
+
+/**
+ * Allocate a tty_transfer_broker
+ * @param[in] capacity The maximum number of ttys that can be added
+ * @returns The newly allocated broker or NULL
+ */
+TTY_TRANSFER_API tty_transfer_broker *
+tty_transfer_broker_alloc(size_t capacity);
+
+/**
+ * Free a tty_transfer_broker
+ * @remarks Any requests that did not complete are abandoned and their ttys
+ * are restored
+ */
+TTY_TRANSFER_API void tty_transfer_broker_free(tty_transfer_broker *b);
+
+/**
+ * Add a tty to request an I/O token on
+ * @param[in] b The broker
+ * @param[in] in_fd The tty to read the reply from
+ * @param[in] out_fd The tty to write the request to
+ * @param[in] timeout_ms How long to wait for the reply in milliseconds
+ * @returns The index of the tty for tty_transfer_broker_result, or -1 if the
+ * broker is full
+ * @remarks Nothing is written until tty_transfer_broker_run is called. Each
+ * tty may only be added once per run.
+ */
+TTY_TRANSFER_API int tty_transfer_broker_add(tty_transfer_broker *b,
+                                             int in_fd, int out_fd,
+                                             int timeout_ms);
+
+/**
+ * Request I/O tokens on every added tty and wait for all of them to complete
+ * @param[in] b The broker
+ * @returns TTY_TRANSFER_OK if every request completed, or an error code if
+ * the broker itself failed to wait on the ttys
+ * @remarks All requests are written before any reply is awaited, so the run
+ * takes about one terminal round trip regardless of the number of ttys.
+ * Each tty's own result is available from tty_transfer_broker_result.
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_broker_run(tty_transfer_broker *b);
+
+/**
+ * Retrieve the result of a tty's request
+ * @param[in] b The broker
+ * @param[in] index The index returned by tty_transfer_broker_add
+ * @param[out] token_buf The buffer to hold the null terminated output token
+ * @param[in] token_buf_size The size of token_buf in chars. This must be at
+ * least 37 to hold a null terminated formatted UUID
+ * @returns The result of the request, which is TTY_TRANSFER_IN_PROGRESS
+ * before tty_transfer_broker_run completes it
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_broker_result(const tty_transfer_broker *b, int index,
+                           char *token_buf, size_t token_buf_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
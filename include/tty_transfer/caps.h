@@ -0,0 +1,61 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_CAPS_H
+#define TTY_TRANSFER_CAPS_H
+
+#include "tty_transfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Seconds a cached capability is trusted before the terminal is probed
+ * again */
+#define TTY_TRANSFER_CAPS_MAX_AGE_S 3600
+
+/**
+ * Constants describing whether a terminal answers I/O token requests
+ */
+typedef enum tty_transfer_caps {
+  /** Nothing is cached for the terminal */
+  TTY_TRANSFER_CAPS_UNKNOWN = 0,
+  /** The terminal replied with an I/O token */
+  TTY_TRANSFER_CAPS_SUPPORTED = 1,
+  /** The terminal timed out without ever replying with a token */
+  TTY_TRANSFER_CAPS_UNSUPPORTED = 2,
+} tty_transfer_caps;
+
+/**
+ * Look up the cached capability of a tty
+ * @param[in] fd The tty
+ * @returns The cached capability, or TTY_TRANSFER_CAPS_UNKNOWN if nothing
+ * younger than TTY_TRANSFER_CAPS_MAX_AGE_S is cached. Older entries are
+ * removed.
+ * @remarks The cache lives in $XDG_RUNTIME_DIR/tty_transfer and is keyed by
+ * the tty device, its session and $TERM. Nothing is cached if
+ * XDG_RUNTIME_DIR is not set or the tty is not the controlling terminal of a
+ * session.
+ */
+TTY_TRANSFER_API tty_transfer_caps tty_transfer_caps_lookup(int fd);
+
+/**
+ * Cache the capability of a tty
+ * @param[in] fd The tty
+ * @param[in] caps The capability, or TTY_TRANSFER_CAPS_UNKNOWN to remove the
+ * cached one
+ * @returns 1 if the cache was updated, otherwise 0
+ * @remarks The cache entry is replaced atomically, so concurrent processes
+ * never read a partial entry
+ */
+TTY_TRANSFER_API int tty_transfer_caps_store(int fd, tty_transfer_caps caps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
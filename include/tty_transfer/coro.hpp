@@ -0,0 +1,160 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_CORO_HPP
+#define TTY_TRANSFER_CORO_HPP
+
+#include "tty_transfer.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <ctime>
+
+namespace tty_transfer {
+
+/**
+ * Event loop that coroutines awaiting I/O tokens suspend on
+ */
+class reactor {
+public:
+  /**
+   * Function called when a watched file descriptor is ready
+   * @param[in] ctx The context given to watch
+   * @param[in] revents The TTY_TRANSFER_EVENT_* events that are ready. Error
+   * and hangup conditions are reported as TTY_TRANSFER_EVENT_READ. This is 0
+   * if the timeout passed first.
+   */
+  using callback = void (*)(void *ctx, int revents);
+
+  virtual ~reactor() = default;
+
+  /**
+   * Call fn once when fd is ready or the timeout passes
+   * @param[in] fd The file descriptor to wait on
+   * @param[in] events The TTY_TRANSFER_EVENT_* events to wait for
+   * @param[in] timeout_ms Milliseconds to wait before calling fn with no
+   * events
+   * @param[in] fn The function to call
+   * @param[in] ctx The context to pass to fn
+   * @remarks A file descriptor has at most one watch at a time. fn may call
+   * watch again for the same file descriptor.
+   */
+  virtual void watch(int fd, int events, int timeout_ms, callback fn,
+                     void *ctx) = 0;
+};
+
+/**
+ * Outcome of an I/O token request
+ */
+struct token_result {
+  /** The result of the request */
+  tty_transfer_errno error = TTY_TRANSFER_IN_PROGRESS;
+  /** The null terminated token if error is TTY_TRANSFER_OK */
+  token value{};
+
+  explicit operator bool() const noexcept { return error == TTY_TRANSFER_OK; }
+};
+
+/**
+ * Awaitable that requests an I/O token without blocking the coroutine's
+ * thread
+ * @remarks The coroutine is resumed from the reactor's callback once the
+ * request completes, and the tty is restored before it resumes. Replies to
+ * concurrent requests on one tty cannot be told apart, so await at most one
+ * token per tty at a time.
+ */
+class token_awaitable {
+public:
+  token_awaitable(reactor &r, const tty_transfer_request_options &opts)
+      : reactor_{r}, opts_{opts} {}
+
+  token_awaitable(const token_awaitable &) = delete;
+  token_awaitable &operator=(const token_awaitable &) = delete;
+
+  bool await_ready() noexcept {
+    result_.error = request_.begin(&opts_);
+    return result_.error != TTY_TRANSFER_IN_PROGRESS;
+  }
+
+  void await_suspend(std::coroutine_handle<> h) noexcept {
+    handle_ = h;
+    wait();
+  }
+
+  token_result await_resume() noexcept { return result_; }
+
+private:
+  reactor &reactor_;
+  tty_transfer_request_options opts_;
+  request request_;
+  token_result result_;
+  std::coroutine_handle<> handle_;
+
+  void wait() noexcept {
+    reactor_.watch(request_.fd(), request_.events(), request_.timeout_ms(),
+                   &token_awaitable::on_ready, this);
+  }
+
+  static void on_ready(void *ctx, int revents) noexcept {
+    auto *self = static_cast<token_awaitable *>(ctx);
+
+    // The step reads the reply into the request's parser
+    if (self->request_.step(revents) == TTY_TRANSFER_IN_PROGRESS) {
+      self->wait();
+      return;
+    }
+
+    self->result_.error = self->request_.finish(self->result_.value);
+    self->handle_.resume();
+  }
+};
+
+/**
+ * Request an I/O token on a tty from a coroutine
+ * @param[in] r The reactor to suspend on
+ * @param[in] fd The tty to write the request to and read the reply from
+ * @param[in] deadline When to stop waiting for the reply
+ * @returns An awaitable producing a token_result
+ */
+inline token_awaitable request_token(reactor &r, int fd,
+                                     std::chrono::steady_clock::time_point
+                                         deadline) {
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = fd;
+  opts.out_fd = fd;
+
+  // steady_clock is not CLOCK_MONOTONIC everywhere, so carry over the
+  // remaining time instead of the time point
+  auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      deadline - std::chrono::steady_clock::now());
+  if (remaining.count() < 0)
+    remaining = remaining.zero();
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long ns = now.tv_nsec + remaining.count();
+  opts.deadline.tv_sec = now.tv_sec + ns / 1000000000;
+  opts.deadline.tv_nsec = ns % 1000000000;
+
+  return token_awaitable{r, opts};
+}
+
+/**
+ * Request an I/O token on a tty from a coroutine
+ * @param[in] r The reactor to suspend on
+ * @param[in] opts The options for the request. cancel_fd is ignored.
+ * @returns An awaitable producing a token_result
+ */
+inline token_awaitable request_token(reactor &r,
+                                     const tty_transfer_request_options &opts) {
+  return token_awaitable{r, opts};
+}
+
+} // namespace tty_transfer
+
+#endif
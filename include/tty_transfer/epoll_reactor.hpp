@@ -0,0 +1,164 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_EPOLL_REACTOR_HPP
+#define TTY_TRANSFER_EPOLL_REACTOR_HPP
+
+#include "tty_transfer/coro.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace tty_transfer {
+
+/**
+ * Reference single threaded reactor built on epoll
+ */
+class epoll_reactor : public reactor {
+public:
+  epoll_reactor() : epfd_{::epoll_create1(EPOLL_CLOEXEC)} {}
+
+  epoll_reactor(const epoll_reactor &) = delete;
+  epoll_reactor &operator=(const epoll_reactor &) = delete;
+
+  ~epoll_reactor() override {
+    if (epfd_ != -1)
+      ::close(epfd_);
+  }
+
+  /** Whether the epoll instance was created */
+  explicit operator bool() const noexcept { return epfd_ != -1; }
+
+  void watch(int fd, int events, int timeout_ms, callback fn,
+             void *ctx) override {
+    auto [it, inserted] = waiters_.try_emplace(fd);
+    assert(inserted && "fd already has a watch");
+    (void)inserted;
+
+    waiter &w = it->second;
+    w.events = events;
+    w.deadline = clock::now() + std::chrono::milliseconds{timeout_ms};
+    w.fn = fn;
+    w.ctx = ctx;
+
+    epoll_event ev{};
+    ev.events = EPOLLONESHOT;
+    if (events & TTY_TRANSFER_EVENT_READ)
+      ev.events |= EPOLLIN;
+    if (events & TTY_TRANSFER_EVENT_WRITE)
+      ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+
+    // A one shot registration stays in the set after it fires
+    if (::epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) == -1 && errno == ENOENT)
+      ::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  /** Number of callbacks waiting to be called */
+  std::size_t pending() const noexcept { return waiters_.size(); }
+
+  /**
+   * Wait for ready file descriptors or timeouts and call their callbacks
+   * @returns The number of callbacks called, or -1 if epoll_wait failed
+   */
+  int run_once() {
+    if (waiters_.empty())
+      return 0;
+
+    auto now = clock::now();
+    auto next = waiters_.begin()->second.deadline;
+    for (const auto &[fd, w] : waiters_) {
+      if (w.deadline < next)
+        next = w.deadline;
+    }
+
+    int timeout_ms = 0;
+    if (next > now) {
+      // Round up so the deadline has passed when epoll_wait returns
+      auto ms = std::chrono::ceil<std::chrono::milliseconds>(next - now);
+      timeout_ms = static_cast<int>(ms.count());
+    }
+
+    epoll_event events[16];
+    int n = ::epoll_wait(epfd_, events, 16, timeout_ms);
+    if (n == -1)
+      return errno == EINTR ? 0 : -1;
+
+    int ncalled = 0;
+    for (int i = 0; i < n; ++i) {
+      auto it = waiters_.find(events[i].data.fd);
+      if (it == waiters_.end())
+        continue;
+
+      int revents = 0;
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        revents |= TTY_TRANSFER_EVENT_READ;
+      if (events[i].events & EPOLLOUT)
+        revents |= TTY_TRANSFER_EVENT_WRITE;
+
+      ncalled += fire(it, revents);
+    }
+
+    // Expire the rest. Callbacks may add waiters, so search again each time.
+    now = clock::now();
+    for (;;) {
+      auto it = std::find_if(waiters_.begin(), waiters_.end(),
+                             [now](const auto &e) {
+                               return e.second.deadline <= now;
+                             });
+      if (it == waiters_.end())
+        break;
+
+      ::epoll_ctl(epfd_, EPOLL_CTL_DEL, it->first, nullptr);
+      ncalled += fire(it, 0);
+    }
+
+    return ncalled;
+  }
+
+  /**
+   * Call run_once until no callbacks are pending
+   * @returns false if epoll_wait failed
+   */
+  bool run() {
+    while (!waiters_.empty()) {
+      if (run_once() == -1)
+        return false;
+    }
+
+    return true;
+  }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct waiter {
+    int events;
+    clock::time_point deadline;
+    callback fn;
+    void *ctx;
+  };
+
+  int epfd_;
+  std::unordered_map<int, waiter> waiters_;
+
+  int fire(std::unordered_map<int, waiter>::iterator it, int revents) {
+    waiter w = it->second;
+    waiters_.erase(it);
+    w.fn(w.ctx, revents);
+    return 1;
+  }
+};
+
+} // namespace tty_transfer
+
+#endif
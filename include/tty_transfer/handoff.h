@@ -0,0 +1,95 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_HANDOFF_H
+#define TTY_TRANSFER_HANDOFF_H
+
+#include "tty_transfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Maximum number of file descriptors passed for one token */
+#define TTY_TRANSFER_HANDOFF_MAX_FDS 8
+
+/**
+ * Function that resolves a redeemed token to the file descriptors it grants
+ * @param[in] ctx The context given to tty_transfer_handoff_serve
+ * @param[in] token The token presented by the client
+ * @param[out] fds The file descriptors to pass. They stay open in the host.
+ * @param[in] max_fds The number of elements in fds
+ * @param[out] nfds Set to the number of file descriptors in fds
+ * @returns 1 if the token is valid, otherwise 0
+ */
+typedef int (*tty_transfer_handoff_resolve_fn)(void *ctx,
+                                               const tty_transfer_uuid *token,
+                                               int *fds, size_t max_fds,
+                                               size_t *nfds);
+
+/**
+ * Listen for token redemptions on a Unix domain socket
+ * @param[in] path The socket path. On Linux, a leading '@' names an abstract
+ * socket instead of a file.
+ * @param[out] listen_fd Set to the listening socket
+ * @returns An error code constant
+ * @remarks Accept connections with accept(2) and pass them to
+ * tty_transfer_handoff_serve
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_handoff_listen(const char *path, int *listen_fd);
+
+/**
+ * Answer one redemption on a connected socket
+ * @param[in] conn_fd The connection from the client
+ * @param[in] resolve The function that validates the token
+ * @param[in] ctx The context to pass to resolve
+ * @returns TTY_TRANSFER_OK if file descriptors were passed,
+ * TTY_TRANSFER_REJECTED if resolve refused the token, or another error code
+ * @remarks This blocks until the client sends its token, so set
+ * SO_RCVTIMEO on conn_fd to bound how long a client can stall. The caller
+ * still owns and closes conn_fd.
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_handoff_serve(int conn_fd, tty_transfer_handoff_resolve_fn resolve,
+                           void *ctx);
+
+/**
+ * Redeem a token for the host's file descriptors over a connected socket
+ * @param[in] sock_fd The socket connected to the host
+ * @param[in] token The null terminated token from
+ * tty_transfer_request_io_token
+ * @param[out] fds The received file descriptors, owned by the caller
+ * @param[in] max_fds The number of elements in fds. Any extra descriptors
+ * the host passes are closed.
+ * @param[out] nfds Set to the number of file descriptors in fds
+ * @returns An error code constant
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_handoff_redeem_fd(int sock_fd, const char *token, int *fds,
+                               size_t max_fds, size_t *nfds);
+
+/**
+ * Redeem a token for the host's file descriptors
+ * @param[in] path The host's socket path, as given to
+ * tty_transfer_handoff_listen
+ * @param[in] token The null terminated token from
+ * tty_transfer_request_io_token
+ * @param[out] fds The received file descriptors, owned by the caller
+ * @param[in] max_fds The number of elements in fds
+ * @param[out] nfds Set to the number of file descriptors in fds
+ * @returns An error code constant
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_handoff_redeem(const char *path, const char *token, int *fds,
+                            size_t max_fds, size_t *nfds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
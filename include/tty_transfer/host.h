@@ -0,0 +1,102 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_HOST_H
+#define TTY_TRANSFER_HOST_H
+
+#include "tty_transfer.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Type that finds I/O token requests in the output of a pty's child for the
+ * host terminal to answer
+ */
+typedef struct tty_transfer_host_scanner_ tty_transfer_host_scanner;
+
+/**
+ * An I/O token request found in the child's output
+ */
+typedef struct tty_transfer_host_request {
+  /** Stream offset of the ESC beginning the request sequence */
+  uint64_t start;
+  /** Stream offset one past the end of the request sequence */
+  uint64_t end;
+  /** The null terminated key to reply with */
+  char key[37];
+} tty_transfer_host_request;
+
+/**
+ * Allocate a tty_transfer_host_scanner
+ * @returns The newly allocated scanner or NULL
+ */
+TTY_TRANSFER_API tty_transfer_host_scanner *tty_transfer_host_scanner_alloc();
+
+/**
+ * Free a tty_transfer_host_scanner
+ */
+TTY_TRANSFER_API void
+tty_transfer_host_scanner_free(tty_transfer_host_scanner *s);
+
+/**
+ * Forget any partial request and restart stream offsets at 0
+ * @param[in] s The scanner
+ */
+TTY_TRANSFER_API void
+tty_transfer_host_scanner_reset(tty_transfer_host_scanner *s);
+
+/**
+ * Scan the next chunk of the child's output for I/O token requests
+ * @param[in] s The scanner
+ * @param[in] bytes The chunk read from the pty
+ * @param[in] nbytes The number of bytes in the chunk
+ * @param[out] reqs The requests that end in the chunk
+ * @param[in] max_reqs The number of elements in reqs
+ * @param[out] nreqs Set to the number of requests stored in reqs
+ * @returns The number of bytes scanned, which is less than nbytes only if
+ * reqs filled up. Scan the rest of the chunk with another call.
+ * @remarks Nothing is copied. Offsets count every byte scanned since the
+ * scanner was allocated or reset, so a request may start in an earlier
+ * chunk. Escape sequences are located with vectorized scans, so text
+ * without ESC bytes is skipped at memory bandwidth.
+ */
+TTY_TRANSFER_API size_t tty_transfer_host_scanner_feed(
+    tty_transfer_host_scanner *s, const void *bytes, size_t nbytes,
+    tty_transfer_host_request *reqs, size_t max_reqs, size_t *nreqs);
+
+/**
+ * Stream offset of the first byte that may belong to an unfinished request
+ * @param[in] s The scanner
+ * @returns An offset such that every earlier byte not in a reported request
+ * can be forwarded. Bytes from here to the end of the scanned stream should
+ * be held back until more output is scanned.
+ */
+TTY_TRANSFER_API uint64_t
+tty_transfer_host_scanner_safe_offset(const tty_transfer_host_scanner *s);
+
+/**
+ * Format the reply to an I/O token request
+ * @param[in] key The null terminated key from a tty_transfer_host_request
+ * @param[in] token The null terminated I/O token to transfer
+ * @param[out] buf The buffer to hold the null terminated reply
+ * @param[in] buf_size The size of buf in chars
+ * @returns The length of the reply, or 0 if buf is too small
+ */
+TTY_TRANSFER_API size_t tty_transfer_host_format_reply(const char *key,
+                                                       const char *token,
+                                                       char *buf,
+                                                       size_t buf_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
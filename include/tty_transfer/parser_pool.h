@@ -0,0 +1,116 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_PARSER_POOL_H
+#define TTY_TRANSFER_PARSER_POOL_H
+
+#include "tty_transfer.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Type that parses many tty streams with compact per-stream state
+ */
+typedef struct tty_transfer_parser_pool_ tty_transfer_parser_pool;
+
+/**
+ * Kinds of sequences reported by a parser pool
+ */
+typedef enum tty_transfer_parser_pool_event_type {
+  /** An I/O token reply, 1337;IOToken=<key>;<val> */
+  TTY_TRANSFER_PARSER_POOL_TOKEN = 0,
+  /** An I/O token request, 1337;RequestTransferIOToken=<key> */
+  TTY_TRANSFER_PARSER_POOL_REQUEST = 1,
+  /** A CSI sequence ending with 'R', like a cursor position report */
+  TTY_TRANSFER_PARSER_POOL_CPR = 2,
+} tty_transfer_parser_pool_event_type;
+
+/**
+ * Bytes read from one stream
+ */
+typedef struct tty_transfer_parser_pool_input {
+  /** The stream the bytes continue */
+  uint32_t stream;
+  /** The bytes */
+  const void *bytes;
+  /** The number of bytes */
+  size_t nbytes;
+} tty_transfer_parser_pool_input;
+
+/**
+ * A sequence that ended in a batch of inputs
+ */
+typedef struct tty_transfer_parser_pool_event {
+  /** The kind of sequence */
+  tty_transfer_parser_pool_event_type type;
+  /** The stream of the sequence */
+  uint32_t stream;
+  /** Index of the input in the batch that the sequence ended in */
+  size_t input;
+  /** Offset in that input one past the end of the sequence */
+  size_t end;
+  /** The key of a token or request */
+  tty_transfer_uuid key;
+  /** The token of a token reply */
+  tty_transfer_uuid val;
+} tty_transfer_parser_pool_event;
+
+/**
+ * Allocate a tty_transfer_parser_pool
+ * @param[in] nstreams The number of streams, identified from 0 to nstreams-1
+ * @returns The newly allocated pool or NULL
+ * @remarks Every stream starts outside any sequence. A stream takes 5 bytes
+ * unless it is in an OSC string that may still be a token or request, which
+ * borrows a shared matcher until the string ends.
+ */
+TTY_TRANSFER_API tty_transfer_parser_pool *
+tty_transfer_parser_pool_alloc(size_t nstreams);
+
+/**
+ * Free a tty_transfer_parser_pool
+ */
+TTY_TRANSFER_API void
+tty_transfer_parser_pool_free(tty_transfer_parser_pool *p);
+
+/**
+ * Return a stream to the state it was allocated with
+ * @param[in] p The pool
+ * @param[in] stream The stream to reset
+ */
+TTY_TRANSFER_API void
+tty_transfer_parser_pool_reset(tty_transfer_parser_pool *p, uint32_t stream);
+
+/**
+ * Parse a batch of inputs from any streams
+ * @param[in] p The pool
+ * @param[in] inputs The inputs, which are parsed in order
+ * @param[in] ninputs The number of inputs
+ * @param[out] events The sequences that end in the inputs, in order
+ * @param[in] max_events The number of elements in events, which must be
+ * positive
+ * @param[out] nevents Set to the number of events stored in events
+ * @returns TTY_TRANSFER_FULL if events filled up, in which case parsing
+ * stopped right after the last event. Resume from its end in its input.
+ * Otherwise TTY_TRANSFER_BAD_ALLOC if an OSC string could not be matched for
+ * lack of memory, or TTY_TRANSFER_OK.
+ * @remarks Nothing is copied. Inputs for streams out of range are ignored.
+ * A stream may appear in several inputs of a batch.
+ */
+TTY_TRANSFER_API tty_transfer_errno tty_transfer_parser_pool_feed(
+    tty_transfer_parser_pool *p, const tty_transfer_parser_pool_input *inputs,
+    size_t ninputs, tty_transfer_parser_pool_event *events, size_t max_events,
+    size_t *nevents);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_ALLOC_H
+#define TTY_TRANSFER_PRIVATE_ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * Allocate memory with the allocator set by tty_transfer_set_allocator
+ * @param[in] size The number of bytes to allocate
+ * @returns The allocated memory or NULL
+ */
+void *tty_transfer_malloc(size_t size);
+
+/**
+ * Allocate zeroed memory with the allocator set by tty_transfer_set_allocator
+ * @param[in] n The number of elements to allocate
+ * @param[in] size The size of each element
+ * @returns The allocated memory or NULL
+ */
+void *tty_transfer_calloc(size_t n, size_t size);
+
+/**
+ * Free memory from tty_transfer_malloc or tty_transfer_calloc
+ * @param[in] ptr The memory to free, or NULL
+ */
+void tty_transfer_free(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
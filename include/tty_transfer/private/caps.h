@@ -0,0 +1,70 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_CAPS_H
+#define TTY_TRANSFER_PRIVATE_CAPS_H
+
+#include "tty_transfer/caps.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Identity of a terminal in the capability cache
+ */
+typedef struct tty_transfer_caps_key {
+  uint64_t rdev;
+  int64_t sid;
+  uint64_t term_hash;
+} tty_transfer_caps_key;
+
+/** Size of a buffer that holds any path from tty_transfer_caps_path */
+#define TTY_TRANSFER_CAPS_PATH_SIZE 512
+
+/**
+ * Compute the cache key of a tty
+ * @param[in] fd The tty
+ * @param[out] key The key
+ * @returns 1 if the tty can be cached, otherwise 0
+ */
+int tty_transfer_caps_key_init(tty_transfer_caps_key *key, int fd);
+
+/**
+ * Format the path of a per-terminal file in the runtime directory
+ * @param[in] key The terminal
+ * @param[in] kind The kind of file, like "caps"
+ * @param[out] buf The buffer to hold the null terminated path
+ * @param[in] bufsz The size of buf
+ * @param[in] create Whether to create the directory holding the file
+ * @returns 1 if the path was formatted, or 0 if XDG_RUNTIME_DIR is not set
+ * or the directory could not be created
+ */
+int tty_transfer_caps_path(const tty_transfer_caps_key *key,
+                           const char *kind, char *buf, size_t bufsz,
+                           int create);
+
+/**
+ * Like tty_transfer_caps_lookup with a computed key
+ */
+tty_transfer_caps
+tty_transfer_caps_lookup_key(const tty_transfer_caps_key *key);
+
+/**
+ * Like tty_transfer_caps_store with a computed key
+ */
+int tty_transfer_caps_store_key(const tty_transfer_caps_key *key,
+                                tty_transfer_caps caps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
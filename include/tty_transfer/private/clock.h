@@ -0,0 +1,39 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_CLOCK_H
+#define TTY_TRANSFER_PRIVATE_CLOCK_H
+
+#include "tty_transfer.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Read CLOCK_MONOTONIC, which every process on the host shares
+ * @returns The current time in nanoseconds
+ */
+int64_t tty_transfer_monotonic_ns(void);
+
+/**
+ * Compute when a request with the given options stops waiting
+ * @param[in] opts The request options
+ * @returns The deadline option, or timeout_ms from now if it is zero, in
+ * CLOCK_MONOTONIC nanoseconds
+ */
+int64_t
+tty_transfer_options_deadline_ns(const tty_transfer_request_options *opts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,112 +8,671 @@
 
 // Assume posix!!!
 #include "tty_transfer.h"
+#include "tty_transfer/private/caps.h"
+#include "tty_transfer/private/clock.h"
+#include "tty_transfer/private/restore.h"
+#include "tty_transfer/private/stats.h"
+#include "tty_transfer/private/token_cache.h"
 #include "tty_transfer/private/uuid.h"
+#include "tty_transfer/private/wait.h"
+#include "tty_transfer/session.h"
 
-#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
-tty_transfer_errno tty_transfer_request_io_token(char *token_buf,
-                                                 size_t token_buf_size) {
-  if (!isatty(STDIN_FILENO)) {
+#if defined(TTY_TRANSFER_IO_URING) && defined(__linux__)
+#include <linux/io_uring.h>
+#endif
+
+// \e]1337;RequestTransferIOToken=<uuid>\e\\ for each key
+#define REQUEST_OSC_PREFIX "\e]1337;RequestTransferIOToken="
+#define REQUEST_OSC_PREFIX_SIZE (sizeof(REQUEST_OSC_PREFIX) - 1)
+#define REQUEST_OSC_SIZE (REQUEST_OSC_PREFIX_SIZE + 36 + 2)
+
+struct tty_transfer_request_ {
+  int in_fd;
+  int out_fd;
+  int owned_fd; // opened from tty_path, or -1
+  int caps_cached; // results are cached under caps_key
+  tty_transfer_caps_key caps_key;
+  tty_transfer_caps caps; // what the cache holds for caps_key
+  struct termios tattr_orig;
+  int restore_action; // how tattr_orig is restored
+  int events;
+  tty_transfer_errno result;
+  int64_t start_ns;
+  int64_t deadline_ns;
+  tty_transfer_request_stats stats;
+  tty_transfer_request_stats *stats_out;
+  size_t nkeys;
+  size_t nfound; // keys with a parsed token
+  tty_transfer_uuid token_keys[TTY_TRANSFER_PARSER_MAX_TOKENS];
+  char buf[TTY_TRANSFER_PARSER_MAX_TOKENS * REQUEST_OSC_SIZE + 4];
+  char read_buf[256];
+  size_t nreq;
+  size_t nwritten;
+#if defined(TTY_TRANSFER_IO_URING) && defined(__linux__)
+  unsigned uring_inflight; // ops submitted but not yet completed
+  struct __kernel_timespec uring_deadline;
+#endif
+  tty_transfer_parser parser;
+};
+
+static tty_transfer_errno check_ttys(int in_fd, int out_fd) {
+  if (!isatty(in_fd)) {
     return TTY_TRANSFER_STDIN_NOT_TTY;
   }
 
+  if (!isatty(out_fd)) {
+    return TTY_TRANSFER_STDOUT_NOT_TTY;
+  }
+
+  struct stat in_stat, out_stat;
+  if (fstat(in_fd, &in_stat) == -1 || fstat(out_fd, &out_stat) == -1)
+    return TTY_TRANSFER_STDIO_MISMATCH;
+
+  if (in_stat.st_rdev != out_stat.st_rdev)
+    return TTY_TRANSFER_STDIO_MISMATCH;
+
+  return TTY_TRANSFER_OK;
+}
+
+void tty_transfer_request_options_init(tty_transfer_request_options *opts) {
+  opts->in_fd = STDIN_FILENO;
+  opts->out_fd = STDOUT_FILENO;
+  opts->tty_path = NULL;
+  opts->timeout_ms = 500;
+  opts->deadline.tv_sec = 0;
+  opts->deadline.tv_nsec = 0;
+  opts->cancel_fd = -1;
+  opts->stats = NULL;
+  opts->caps_mode = TTY_TRANSFER_CAPS_IGNORE;
+  opts->token_cache_ms = 0;
+}
+
+// Format the request for nkeys tokens, at most
+// TTY_TRANSFER_PARSER_MAX_TOKENS, with a placeholder for each key. Every
+// request OSC is followed by a single CPR query so that all the replies
+// arrive before the CPR: <osc>...<osc>\e[6n
+static void tty_transfer_request_format(tty_transfer_request *r,
+                                        size_t nkeys) {
+  static const char prefix[] = REQUEST_OSC_PREFIX;
+  static const char suffix[] = "\e[6n";
+
+  char *it = r->buf;
+  for (size_t i = 0; i < nkeys; ++i) {
+    memcpy(it, prefix, REQUEST_OSC_PREFIX_SIZE);
+    it += REQUEST_OSC_PREFIX_SIZE;
+    memset(it, '0', 36);
+    it += 36;
+    memcpy(it, "\e\\", 2);
+    it += 2;
+  }
+
+  memcpy(it, suffix, sizeof(suffix) - 1);
+  it += sizeof(suffix) - 1;
+
+  r->nkeys = nkeys;
+  r->nreq = it - r->buf;
+
+  tty_transfer_parser_construct(&r->parser);
+  if (nkeys > 1)
+    tty_transfer_parser_set_mode(&r->parser, TTY_TRANSFER_PARSER_ALL_TOKENS);
+}
+
+// Reset a formatted request to be written again with new keys. Fails
+// rather than reuse the previous keys if no random keys can be generated.
+static tty_transfer_errno tty_transfer_request_prepare(tty_transfer_request *r,
+                                                       int64_t start_ns,
+                                                       int64_t deadline_ns) {
+  r->events = TTY_TRANSFER_EVENT_WRITE;
+  r->result = TTY_TRANSFER_IN_PROGRESS;
+  r->start_ns = start_ns;
+  r->deadline_ns = deadline_ns;
+  memset(&r->stats, 0, sizeof(r->stats));
+  r->nwritten = 0;
+  r->nfound = 0;
+  tty_transfer_parser_reset(&r->parser);
+
+  if (!tty_transfer_uuid_random(r->token_keys, r->nkeys))
+    return TTY_TRANSFER_NO_ENTROPY;
+
+  for (size_t i = 0; i < r->nkeys; ++i) {
+    char key[TTY_TRANSFER_UUID_SIZE];
+    tty_transfer_uuid_format(&r->token_keys[i], key);
+    memcpy(&r->buf[i * REQUEST_OSC_SIZE + REQUEST_OSC_PREFIX_SIZE], key, 36);
+  }
+
+  return TTY_TRANSFER_OK;
+}
+
+// Open and check the ttys and put them in raw mode. Nothing needs to be
+// released unless TTY_TRANSFER_OK is returned.
+static tty_transfer_errno
+tty_transfer_request_open_tty(tty_transfer_request *r,
+                              const tty_transfer_request_options *opts,
+                              int raw_action, int restore_action) {
+  int in_fd = opts->in_fd;
+  int out_fd = opts->out_fd;
+  int owned_fd = -1;
+  if (opts->tty_path) {
+    owned_fd = open(opts->tty_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (owned_fd == -1)
+      return TTY_TRANSFER_BAD_OPEN;
+
+    in_fd = out_fd = owned_fd;
+  }
+
+  tty_transfer_errno err = check_ttys(in_fd, out_fd);
+
+  // Fail fast on a terminal known not to reply before touching it
+  r->caps = TTY_TRANSFER_CAPS_UNKNOWN;
+  r->caps_cached = err == TTY_TRANSFER_OK &&
+                   opts->caps_mode != TTY_TRANSFER_CAPS_IGNORE &&
+                   tty_transfer_caps_key_init(&r->caps_key, in_fd);
+  if (r->caps_cached && opts->caps_mode == TTY_TRANSFER_CAPS_CACHE) {
+    r->caps = tty_transfer_caps_lookup_key(&r->caps_key);
+    if (r->caps == TTY_TRANSFER_CAPS_UNSUPPORTED)
+      err = TTY_TRANSFER_UNSUPPORTED;
+  }
+
+  if (err != TTY_TRANSFER_OK) {
+    if (owned_fd != -1)
+      close(owned_fd);
+    return err;
+  }
+
+  r->in_fd = in_fd;
+  r->out_fd = out_fd;
+  r->owned_fd = owned_fd;
+  r->restore_action = restore_action;
+
   // Make raw terminal
-  // TODO - reset this
-  struct termios tattr_orig, tattr;
-  tcgetattr(STDIN_FILENO, &tattr_orig);
-  tattr = tattr_orig;
+  int64_t termios_start_ns = tty_transfer_monotonic_ns();
+  struct termios tattr;
+  if (tcgetattr(in_fd, &r->tattr_orig) == -1) {
+    if (owned_fd != -1)
+      close(owned_fd);
+    return TTY_TRANSFER_BAD_READ;
+  }
+
+  tattr = r->tattr_orig;
   cfmakeraw(&tattr);
-  tcsetattr(STDIN_FILENO, TCSADRAIN, &tattr);
+  tcsetattr(in_fd, raw_action, &tattr);
+  r->stats.termios_ns += tty_transfer_monotonic_ns() - termios_start_ns;
 
-  char token_key_buf[TTY_TRANSFER_UUID_SIZE];
-  tty_transfer_uuid_generate(token_key_buf, TTY_TRANSFER_UUID_SIZE);
+  return TTY_TRANSFER_OK;
+}
+
+// Restore the tty and close it if it was opened
+static void tty_transfer_request_close_tty(tty_transfer_request *r) {
+  int64_t termios_start_ns = tty_transfer_monotonic_ns();
+  tcsetattr(r->in_fd, r->restore_action, &r->tattr_orig);
+
+  if (r->owned_fd != -1)
+    close(r->owned_fd);
+
+  r->stats.termios_ns += tty_transfer_monotonic_ns() - termios_start_ns;
+}
 
-  char buf[256];
-  size_t bufsz = sizeof(buf) / sizeof(char);
-  buf[0] = '\0';
+// Start a request for nkeys tokens, at most TTY_TRANSFER_PARSER_MAX_TOKENS, in
+// caller provided storage. The tty modes are changed with termios_action.
+// Nothing needs to be released unless TTY_TRANSFER_IN_PROGRESS is returned.
+static tty_transfer_errno
+tty_transfer_request_start(tty_transfer_request *r,
+                           const tty_transfer_request_options *opts,
+                           size_t nkeys, int termios_action) {
+  tty_transfer_request_options defaults;
+  if (!opts) {
+    tty_transfer_request_options_init(&defaults);
+    opts = &defaults;
+  }
+
+  tty_transfer_request_format(r, nkeys);
+  int64_t start_ns = tty_transfer_monotonic_ns();
+  int64_t deadline_ns = tty_transfer_options_deadline_ns(opts);
+  tty_transfer_errno err =
+      tty_transfer_request_prepare(r, start_ns, deadline_ns);
+  if (err != TTY_TRANSFER_OK)
+    return err;
+
+  r->stats_out = opts->stats;
 
-  snprintf(buf, bufsz, "\e]1337;RequestTransferIOToken=%s\e\\\e[6n",
-           token_key_buf);
+  err = tty_transfer_request_open_tty(r, opts, termios_action,
+                                      termios_action);
+  if (err != TTY_TRANSFER_OK)
+    return err;
+
+  return TTY_TRANSFER_IN_PROGRESS;
+}
 
-  if (write(STDOUT_FILENO, buf, strlen(buf)) == -1)
-    return TTY_TRANSFER_BAD_WRITE;
+tty_transfer_errno
+tty_transfer_request_begin_ex(const tty_transfer_request_options *opts,
+                              tty_transfer_request **req) {
+  *req = NULL;
 
-  tty_transfer_parser *p = tty_transfer_parser_alloc();
-  if (!p)
+  tty_transfer_request *r = tty_transfer_malloc(sizeof(tty_transfer_request));
+  if (!r)
     return TTY_TRANSFER_BAD_ALLOC;
 
-  tty_transfer_errno out = TTY_TRANSFER_OK;
+  // Waiting for output to drain would block the caller's event loop
+  tty_transfer_errno err = tty_transfer_request_start(r, opts, 1, TCSANOW);
+  if (err != TTY_TRANSFER_IN_PROGRESS) {
+    tty_transfer_free(r);
+    return err;
+  }
 
-  struct timespec start;
+  *req = r;
+  return err;
+}
+
+tty_transfer_errno tty_transfer_request_begin(int in_fd, int out_fd,
+                                              int timeout_ms,
+                                              tty_transfer_request **req) {
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = in_fd;
+  opts.out_fd = out_fd;
+  opts.timeout_ms = timeout_ms;
+  return tty_transfer_request_begin_ex(&opts, req);
+}
+
+int tty_transfer_request_fd(const tty_transfer_request *req) {
+  return (req->events & TTY_TRANSFER_EVENT_WRITE) ? req->out_fd : req->in_fd;
+}
+
+int tty_transfer_request_events(const tty_transfer_request *req) {
+  return req->events;
+}
 
-  // TODO check retval
-  clock_gettime(CLOCK_MONOTONIC, &start);
+int tty_transfer_request_timeout_ms(const tty_transfer_request *req) {
+  int64_t remaining = req->deadline_ns - tty_transfer_monotonic_ns();
+  if (remaining <= 0)
+    return 0;
+
+  return (int)((remaining + 999999) / 1000000);
+}
+
+static tty_transfer_errno tty_transfer_request_complete(tty_transfer_request *r,
+                                                        tty_transfer_errno e) {
+  r->result = e;
+  r->events = 0;
+  return e;
+}
+
+static tty_transfer_errno tty_transfer_request_write(tty_transfer_request *r) {
+  ++r->stats.nsyscalls;
+  ssize_t nwrite =
+      write(r->out_fd, &r->buf[r->nwritten], r->nreq - r->nwritten);
+  if (nwrite == -1) {
+    if (errno == EAGAIN || errno == EINTR)
+      return TTY_TRANSFER_IN_PROGRESS;
+
+    return tty_transfer_request_complete(r, TTY_TRANSFER_BAD_WRITE);
+  }
+
+  r->nwritten += nwrite;
+  if (r->nwritten == r->nreq) {
+    r->events = TTY_TRANSFER_EVENT_READ;
+    r->stats.written_ns = tty_transfer_monotonic_ns() - r->start_ns;
+  }
+
+  return TTY_TRANSFER_IN_PROGRESS;
+}
+
+tty_transfer_errno tty_transfer_request_feed(tty_transfer_request *req,
+                                             const void *bytes,
+                                             size_t nbytes) {
+  if (req->result != TTY_TRANSFER_IN_PROGRESS)
+    return req->result;
+
+  int nused = tty_transfer_parser_feed(&req->parser, bytes, nbytes);
+  req->stats.nbytes += nused ? (size_t)nused : nbytes;
+
+  req->nfound = 0;
+  for (size_t i = 0; i < req->nkeys; ++i) {
+    req->nfound += tty_transfer_parser_token_for_uuid(
+                       &req->parser, &req->token_keys[i]) != NULL;
+  }
+
+  if (req->nfound == req->nkeys && !req->stats.token_ns)
+    req->stats.token_ns = tty_transfer_monotonic_ns() - req->start_ns;
+
+  // done parsing
+  if (nused) {
+    req->stats.cpr_ns = tty_transfer_monotonic_ns() - req->start_ns;
+    return tty_transfer_request_complete(
+        req,
+        req->nfound == req->nkeys ? TTY_TRANSFER_OK : TTY_TRANSFER_NO_TOKEN);
+  }
 
-  while (1) {
-    struct timespec now;
+  return TTY_TRANSFER_IN_PROGRESS;
+}
 
-    // TODO check retval
-    clock_gettime(CLOCK_MONOTONIC, &now);
+tty_transfer_errno tty_transfer_request_step(tty_transfer_request *req,
+                                             int revents) {
+  if (req->result != TTY_TRANSFER_IN_PROGRESS)
+    return req->result;
 
-    size_t ms_diff = 1000 * (now.tv_sec - start.tv_sec) +
-                     (now.tv_nsec - start.tv_nsec) / 1000000;
+  if ((revents & TTY_TRANSFER_EVENT_WRITE) &&
+      (req->events & TTY_TRANSFER_EVENT_WRITE)) {
+    tty_transfer_errno err = tty_transfer_request_write(req);
+    if (err != TTY_TRANSFER_IN_PROGRESS)
+      return err;
+  } else if ((revents & TTY_TRANSFER_EVENT_READ) &&
+             (req->events & TTY_TRANSFER_EVENT_READ)) {
+    ++req->stats.nsyscalls;
+    ssize_t nread = read(req->in_fd, req->read_buf, sizeof(req->read_buf));
+    if (nread == -1 && (errno == EAGAIN || errno == EINTR)) {
+      // spurious wakeup
+    } else if (nread < 1) {
+      return tty_transfer_request_complete(req, TTY_TRANSFER_BAD_READ);
+    } else {
+      if (!req->stats.nreads++)
+        req->stats.first_read_ns = tty_transfer_monotonic_ns() - req->start_ns;
 
-    if (ms_diff >= 500) {
-      out = TTY_TRANSFER_TIMEOUT;
-      break;
+      tty_transfer_errno err =
+          tty_transfer_request_feed(req, req->read_buf, nread);
+      if (err != TTY_TRANSFER_IN_PROGRESS)
+        return err;
     }
+  }
+
+  if (tty_transfer_monotonic_ns() >= req->deadline_ns)
+    return tty_transfer_request_complete(req, TTY_TRANSFER_TIMEOUT);
+
+  return TTY_TRANSFER_IN_PROGRESS;
+}
 
-    fd_set readfds;
-    FD_ZERO(&readfds);
-    FD_SET(STDIN_FILENO, &readfds);
+// Copy the token for the i-th key of a request
+static tty_transfer_errno
+tty_transfer_request_copy_token(const tty_transfer_request *req, size_t i,
+                                char *token_buf, size_t token_buf_size) {
+  const char *token = tty_transfer_parser_token_str_for_uuid(
+      &req->parser, &req->token_keys[i]);
+  if (!token)
+    return TTY_TRANSFER_NO_TOKEN;
+
+  strncpy(token_buf, token, token_buf_size);
+
+  if (strlen(token) >= token_buf_size) {
+    token_buf[token_buf_size - 1] = '\0';
+    return TTY_TRANSFER_TOKEN_TRUNCATED;
+  }
+
+  return TTY_TRANSFER_OK;
+}
 
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = (500 - ms_diff) * 1000;
+// Remember whether the terminal replied so later requests can fail fast.
+// Only a timeout without a single IOToken reply counts against it, since a
+// token may have been found for some keys or overridden by a later OSC.
+static void tty_transfer_request_cache_caps(tty_transfer_request *req) {
+  tty_transfer_caps caps;
+  if (req->result == TTY_TRANSFER_OK)
+    caps = TTY_TRANSFER_CAPS_SUPPORTED;
+  else if (req->result == TTY_TRANSFER_TIMEOUT && !req->nfound &&
+           !req->parser.nreplies)
+    caps = TTY_TRANSFER_CAPS_UNSUPPORTED;
+  else
+    return;
 
-    int ret = select(STDIN_FILENO + 1, &readfds, NULL, NULL, &timeout);
+  // Only write the cache when it changes
+  if (caps != req->caps && tty_transfer_caps_store_key(&req->caps_key, caps))
+    req->caps = caps;
+}
+
+// Copy the token and report the request's stats
+static tty_transfer_errno
+tty_transfer_request_conclude(tty_transfer_request *req, char *token_buf,
+                              size_t token_buf_size) {
+  tty_transfer_errno out = req->result;
+
+  if (out == TTY_TRANSFER_OK && token_buf)
+    out = tty_transfer_request_copy_token(req, 0, token_buf, token_buf_size);
+
+  req->stats.total_ns = tty_transfer_monotonic_ns() - req->start_ns;
+  req->stats.nosc = req->parser.nosc;
+  req->stats.ncsi = req->parser.ncsi;
+
+  tty_transfer_stats_record(&req->stats, req->result);
+  if (req->caps_cached)
+    tty_transfer_request_cache_caps(req);
+
+  if (req->stats_out)
+    *req->stats_out = req->stats;
+
+  return out;
+}
+
+// Restore the tty and release everything but the request's storage
+static tty_transfer_errno tty_transfer_request_end(tty_transfer_request *req,
+                                                   char *token_buf,
+                                                   size_t token_buf_size) {
+  tty_transfer_request_close_tty(req);
+  return tty_transfer_request_conclude(req, token_buf, token_buf_size);
+}
+
+tty_transfer_errno tty_transfer_request_finish(tty_transfer_request *req,
+                                               char *token_buf,
+                                               size_t token_buf_size) {
+  tty_transfer_errno out =
+      tty_transfer_request_end(req, token_buf, token_buf_size);
+  tty_transfer_free(req);
+  return out;
+}
+
+#if defined(TTY_TRANSFER_IO_URING) && defined(__linux__)
+#include "tty_transfer/private/impl/tty_transfer_uring.c"
+#else
+// Returning 0 makes the broker fall back to poll
+int tty_transfer_request_wait_all(tty_transfer_request **reqs, size_t n) {
+  (void)reqs;
+  (void)n;
+  return 0;
+}
+#endif
+
+// Block until a started request completes or is canceled
+static tty_transfer_errno tty_transfer_request_wait(tty_transfer_request *req,
+                                                    int cancel_fd) {
+  tty_transfer_errno out = TTY_TRANSFER_IN_PROGRESS;
+
+#if defined(TTY_TRANSFER_IO_URING) && defined(__linux__)
+  // A cancel_fd needs poll to be watched
+  if (cancel_fd == -1 && tty_transfer_uring_wait(req))
+    return req->result;
+#endif
+
+  while (out == TTY_TRANSFER_IN_PROGRESS) {
+    int events = tty_transfer_request_events(req);
+
+    struct pollfd pfds[2];
+    pfds[0].fd = tty_transfer_request_fd(req);
+    pfds[0].events = (events & TTY_TRANSFER_EVENT_READ) ? POLLIN : POLLOUT;
+    pfds[0].revents = 0;
+    pfds[1].fd = cancel_fd;
+    pfds[1].events = POLLIN;
+    pfds[1].revents = 0;
+
+    nfds_t nfds = cancel_fd == -1 ? 1 : 2;
+    ++req->stats.nsyscalls;
+    int ret = poll(pfds, nfds, tty_transfer_request_timeout_ms(req));
     if (ret == -1) {
+      if (errno == EINTR)
+        continue;
+
       // TODO log this
-      out = TTY_TRANSFER_BAD_READ;
-      break;
+      return tty_transfer_request_complete(req, TTY_TRANSFER_BAD_READ);
     }
 
-    if (!FD_ISSET(STDIN_FILENO, &readfds)) {
-      continue;
-    }
+    if (pfds[1].revents)
+      return tty_transfer_request_complete(req, TTY_TRANSFER_CANCELED);
+
+    // Any readiness, error or hangup is reported by the next read or write
+    int revents = pfds[0].revents ? events : 0;
+    out = tty_transfer_request_step(req, revents);
+  }
+
+  return out;
+}
+
+tty_transfer_errno
+tty_transfer_request_io_token_ex(const tty_transfer_request_options *opts,
+                                 char *token_buf, size_t token_buf_size) {
+  if (opts && opts->token_cache_ms > 0)
+    return tty_transfer_token_cache_request(opts, token_buf, token_buf_size);
+
+  // The request lives on the stack so the blocking path never allocates
+  tty_transfer_request storage;
+  tty_transfer_request *req = &storage;
+  tty_transfer_errno out = tty_transfer_request_start(req, opts, 1, TCSADRAIN);
+  if (out != TTY_TRANSFER_IN_PROGRESS)
+    return out;
+
+  tty_transfer_request_wait(req, opts ? opts->cancel_fd : -1);
+  return tty_transfer_request_end(req, token_buf, token_buf_size);
+}
 
-    ssize_t nread = read(STDIN_FILENO, buf, bufsz);
-    if (nread < 1) {
-      out = TTY_TRANSFER_BAD_READ;
-      break;
+tty_transfer_errno tty_transfer_request_io_token(char *token_buf,
+                                                 size_t token_buf_size) {
+  return tty_transfer_request_io_token_ex(NULL, token_buf, token_buf_size);
+}
+
+tty_transfer_errno
+tty_transfer_request_io_tokens_ex(const tty_transfer_request_options *opts,
+                                  char *token_bufs, size_t token_buf_size,
+                                  tty_transfer_errno *results,
+                                  size_t ntokens) {
+  tty_transfer_errno out = TTY_TRANSFER_OK;
+  tty_transfer_errno failed = TTY_TRANSFER_OK;
+  tty_transfer_request storage;
+  tty_transfer_request *req = &storage;
+
+  for (size_t first = 0; first < ntokens;) {
+    size_t n = ntokens - first;
+    if (n > TTY_TRANSFER_PARSER_MAX_TOKENS)
+      n = TTY_TRANSFER_PARSER_MAX_TOKENS;
+
+    // Once a round trip fails, the remaining keys are not requested
+    tty_transfer_errno err = failed;
+    if (err == TTY_TRANSFER_OK)
+      err = tty_transfer_request_start(req, opts, n, TCSADRAIN);
+
+    if (err == TTY_TRANSFER_IN_PROGRESS) {
+      err = tty_transfer_request_wait(req, opts ? opts->cancel_fd : -1);
+      tty_transfer_request_end(req, NULL, 0);
     }
 
-    // done parsing
-    if (tty_transfer_parser_feed(p, buf, nread)) {
-      const char *token = tty_transfer_parser_token_for_key(p, token_key_buf);
+    if (err != TTY_TRANSFER_OK && err != TTY_TRANSFER_NO_TOKEN)
+      failed = err;
 
-      if (token) {
-        strncpy(token_buf, token, token_buf_size);
+    for (size_t i = 0; i < n; ++i) {
+      tty_transfer_errno result = err;
 
-        if (strlen(token) >= token_buf_size) {
-          out = TTY_TRANSFER_TOKEN_TRUNCATED;
-          token_buf[token_buf_size - 1] = '\0';
-        }
-      } else {
-        out = TTY_TRANSFER_NO_TOKEN;
+      // Keys without a token are reported individually
+      if (err == TTY_TRANSFER_OK || err == TTY_TRANSFER_NO_TOKEN) {
+        result = tty_transfer_request_copy_token(
+            req, i, &token_bufs[(first + i) * token_buf_size], token_buf_size);
       }
 
-      break;
+      if (results)
+        results[first + i] = result;
+
+      if (out == TTY_TRANSFER_OK)
+        out = result;
     }
+
+    first += n;
   }
 
-  tcsetattr(STDIN_FILENO, TCSADRAIN, &tattr_orig);
-  tty_transfer_parser_free(p);
   return out;
 }
+
+struct tty_transfer_session_ {
+  tty_transfer_request req;
+  tty_transfer_drain_policy drain;
+  int timeout_ms;
+  int cancel_fd;
+  int restore_reg;
+};
+
+tty_transfer_errno
+tty_transfer_session_open(const tty_transfer_request_options *opts,
+                          tty_transfer_drain_policy drain,
+                          tty_transfer_session **session) {
+  *session = NULL;
+
+  tty_transfer_request_options defaults;
+  if (!opts) {
+    tty_transfer_request_options_init(&defaults);
+    opts = &defaults;
+  }
+
+  int raw_action = TCSADRAIN;
+  int restore_action = TCSADRAIN;
+  if (drain == TTY_TRANSFER_DRAIN_NONE) {
+    raw_action = restore_action = TCSANOW;
+  } else if (drain == TTY_TRANSFER_DRAIN_FLUSH_INPUT) {
+    raw_action = TCSAFLUSH;
+  }
+
+  tty_transfer_session *s = tty_transfer_malloc(sizeof(tty_transfer_session));
+  if (!s)
+    return TTY_TRANSFER_BAD_ALLOC;
+
+  tty_transfer_request *req = &s->req;
+  tty_transfer_request_format(req, 1);
+  memset(&req->stats, 0, sizeof(req->stats));
+  req->stats_out = opts->stats;
+
+  tty_transfer_errno err =
+      tty_transfer_request_open_tty(req, opts, raw_action, restore_action);
+  if (err != TTY_TRANSFER_OK) {
+    tty_transfer_free(s);
+    return err;
+  }
+
+  s->drain = drain;
+  s->timeout_ms = opts->timeout_ms;
+  s->cancel_fd = opts->cancel_fd;
+  s->restore_reg = tty_transfer_restore_register(req->in_fd, &req->tattr_orig);
+
+  *session = s;
+  return TTY_TRANSFER_OK;
+}
+
+tty_transfer_errno
+tty_transfer_session_request_io_token(tty_transfer_session *session,
+                                      char *token_buf, size_t token_buf_size) {
+  tty_transfer_request *req = &session->req;
+
+  if (session->drain == TTY_TRANSFER_DRAIN_FLUSH_INPUT)
+    tcflush(req->in_fd, TCIFLUSH);
+
+  int64_t start_ns = tty_transfer_monotonic_ns();
+  tty_transfer_errno err = tty_transfer_request_prepare(
+      req, start_ns, start_ns + (int64_t)session->timeout_ms * 1000000);
+  if (err != TTY_TRANSFER_OK)
+    return err;
+
+  tty_transfer_request_wait(req, session->cancel_fd);
+  return tty_transfer_request_conclude(req, token_buf, token_buf_size);
+}
+
+void tty_transfer_session_close(tty_transfer_session *session) {
+  if (!session)
+    return;
+
+  // A signal after the fd is closed must not restore it, or whatever reused
+  // its number
+  tty_transfer_restore_unregister(session->restore_reg);
+  tty_transfer_request_close_tty(&session->req);
+  tty_transfer_free(session);
+}
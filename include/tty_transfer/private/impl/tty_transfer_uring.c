@@ -0,0 +1,350 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+// Drives requests with io_uring instead of poll. Each round submits the
+// request write, a linked read and a linked timeout, and waits for their
+// completions, all in a single io_uring_enter. This is included by
+// tty_transfer_posix.c when built with TTY_TRANSFER_IO_URING.
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Submission queue entries needed per request per round
+#define URING_SQES_PER_REQUEST 3
+
+// Largest ring used to drive many requests at once
+#define URING_MAX_ENTRIES 4096
+
+enum uring_op { uring_write, uring_read, uring_timeout };
+
+struct tty_transfer_uring_ {
+  int fd;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned sq_entries;
+  unsigned sq_local_tail; // entries queued but not yet published
+  unsigned to_submit;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ptr;
+  size_t sq_size;
+  void *cq_ptr; // same as sq_ptr with IORING_FEAT_SINGLE_MMAP
+  size_t cq_size;
+  size_t sqes_size;
+};
+
+static void tty_transfer_uring_free(struct tty_transfer_uring_ *r) {
+  munmap(r->sqes, r->sqes_size);
+  if (r->cq_ptr != r->sq_ptr)
+    munmap(r->cq_ptr, r->cq_size);
+  munmap(r->sq_ptr, r->sq_size);
+  close(r->fd);
+}
+
+static int tty_transfer_uring_init(struct tty_transfer_uring_ *r,
+                                   unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (r->fd < 0)
+    return 0;
+
+  // Fast poll (5.7) implies every opcode used here is supported
+  if (!(p.features & IORING_FEAT_FAST_POLL)) {
+    close(r->fd);
+    return 0;
+  }
+
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  int single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap && r->cq_size > r->sq_size)
+    r->sq_size = r->cq_size;
+
+  r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+  if (r->sq_ptr == MAP_FAILED) {
+    close(r->fd);
+    return 0;
+  }
+
+  r->cq_ptr = r->sq_ptr;
+  if (!single_mmap) {
+    r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_ptr == MAP_FAILED) {
+      munmap(r->sq_ptr, r->sq_size);
+      close(r->fd);
+      return 0;
+    }
+  }
+
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+  if (r->sqes == MAP_FAILED) {
+    if (r->cq_ptr != r->sq_ptr)
+      munmap(r->cq_ptr, r->cq_size);
+    munmap(r->sq_ptr, r->sq_size);
+    close(r->fd);
+    return 0;
+  }
+
+  char *sq = r->sq_ptr;
+  r->sq_head = (unsigned *)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned *)(sq + p.sq_off.array);
+  r->sq_entries = p.sq_entries;
+  r->sq_local_tail = *r->sq_tail;
+  r->to_submit = 0;
+
+  char *cq = r->cq_ptr;
+  r->cq_head = (unsigned *)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  return 1;
+}
+
+static struct io_uring_sqe *
+tty_transfer_uring_get_sqe(struct tty_transfer_uring_ *r) {
+  unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+  if (r->sq_local_tail - head >= r->sq_entries)
+    return NULL;
+
+  unsigned index = r->sq_local_tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  r->sq_array[index] = index;
+  ++r->sq_local_tail;
+  ++r->to_submit;
+  return sqe;
+}
+
+// Submit queued entries and wait for at least one completion
+static int tty_transfer_uring_submit_and_wait(struct tty_transfer_uring_ *r) {
+  __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+
+  while (1) {
+    int ret = (int)syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1,
+                           IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret >= 0) {
+      r->to_submit -= ret;
+      return 1;
+    }
+
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      return 0;
+  }
+}
+
+static uint64_t uring_tag(size_t i, enum uring_op op) {
+  return ((uint64_t)i << 2) | op;
+}
+
+// Queue the next round of I/O for a request
+static void tty_transfer_uring_queue(struct tty_transfer_uring_ *r,
+                                     tty_transfer_request *req, size_t i) {
+  struct io_uring_sqe *sqe;
+
+  if (req->events & TTY_TRANSFER_EVENT_WRITE) {
+    sqe = tty_transfer_uring_get_sqe(r);
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = req->out_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&req->buf[req->nwritten];
+    sqe->len = req->nreq - req->nwritten;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = uring_tag(i, uring_write);
+    ++req->uring_inflight;
+  }
+
+  sqe = tty_transfer_uring_get_sqe(r);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = req->in_fd;
+  sqe->addr = (uint64_t)(uintptr_t)req->read_buf;
+  sqe->len = sizeof(req->read_buf);
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = uring_tag(i, uring_read);
+
+  // Cancels the read at the request's deadline
+  req->uring_deadline.tv_sec = req->deadline_ns / 1000000000;
+  req->uring_deadline.tv_nsec = req->deadline_ns % 1000000000;
+  sqe = tty_transfer_uring_get_sqe(r);
+  sqe->opcode = IORING_OP_LINK_TIMEOUT;
+  sqe->addr = (uint64_t)(uintptr_t)&req->uring_deadline;
+  sqe->len = 1;
+  sqe->timeout_flags = IORING_TIMEOUT_ABS;
+  sqe->user_data = uring_tag(i, uring_timeout);
+
+  req->uring_inflight += 2;
+}
+
+static void tty_transfer_uring_complete(tty_transfer_request *req,
+                                        enum uring_op op, int res) {
+  --req->uring_inflight;
+  if (req->result != TTY_TRANSFER_IN_PROGRESS)
+    return;
+
+  // Ops canceled by a short write or by the deadline are simply retried
+  int retry = res == -ECANCELED || res == -EAGAIN || res == -EINTR;
+
+  if (op == uring_write) {
+    if (res >= 0) {
+      req->nwritten += res;
+      if (req->nwritten == req->nreq) {
+        req->events = TTY_TRANSFER_EVENT_READ;
+        req->stats.written_ns = tty_transfer_monotonic_ns() - req->start_ns;
+      }
+    } else if (!retry) {
+      tty_transfer_request_complete(req, TTY_TRANSFER_BAD_WRITE);
+    }
+  } else if (op == uring_read) {
+    if (res > 0) {
+      if (!req->stats.nreads++)
+        req->stats.first_read_ns = tty_transfer_monotonic_ns() - req->start_ns;
+
+      tty_transfer_request_feed(req, req->read_buf, res);
+    } else if (!retry) {
+      tty_transfer_request_complete(req, TTY_TRANSFER_BAD_READ);
+    }
+  } else if (res == -ETIME) {
+    tty_transfer_request_complete(req, TTY_TRANSFER_TIMEOUT);
+  }
+}
+
+// Drive requests to completion. Returns 0 if the ring failed, in which case
+// the requests are completed with TTY_TRANSFER_BAD_READ.
+static int tty_transfer_uring_run(struct tty_transfer_uring_ *r,
+                                  tty_transfer_request **reqs, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    reqs[i]->uring_inflight = 0;
+
+  // Buffers must outlive every op that references them, so keep reaping
+  // until completed requests have no ops left in flight
+  while (1) {
+    int inflight = 0;
+    for (size_t i = 0; i < n; ++i) {
+      tty_transfer_request *req = reqs[i];
+      if (req->result == TTY_TRANSFER_IN_PROGRESS) {
+        if (!req->uring_inflight)
+          tty_transfer_uring_queue(r, req, i);
+
+        ++req->stats.nsyscalls;
+      }
+
+      inflight |= req->uring_inflight != 0;
+    }
+
+    if (!inflight)
+      return 1;
+
+    if (!tty_transfer_uring_submit_and_wait(r)) {
+      for (size_t i = 0; i < n; ++i) {
+        if (reqs[i]->result == TTY_TRANSFER_IN_PROGRESS)
+          tty_transfer_request_complete(reqs[i], TTY_TRANSFER_BAD_READ);
+      }
+
+      return 0;
+    }
+
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+      tty_transfer_uring_complete(reqs[cqe->user_data >> 2],
+                                  cqe->user_data & 3, cqe->res);
+    }
+
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+  }
+}
+
+// Each thread keeps a small ring for single requests
+static _Thread_local struct tty_transfer_uring_ thread_ring;
+static _Thread_local int thread_ring_state; // 0 untried, 1 ready, -1 failed
+static _Thread_local unsigned thread_ring_fork_gen;
+static pthread_key_t thread_ring_key;
+static pthread_once_t thread_ring_once = PTHREAD_ONCE_INIT;
+
+// A forked child inherits the ring's fd and its shared mappings, so it would
+// submit to the parent's ring. Forking bumps the generation to make the child
+// release them and set up its own ring.
+static atomic_uint ring_fork_gen = 1;
+
+static void thread_ring_destroy(void *ring) { tty_transfer_uring_free(ring); }
+
+static void on_fork_child(void) {
+  atomic_fetch_add_explicit(&ring_fork_gen, 1, memory_order_relaxed);
+}
+
+static void thread_ring_create_key(void) {
+  pthread_key_create(&thread_ring_key, thread_ring_destroy);
+  pthread_atfork(NULL, NULL, on_fork_child);
+}
+
+static struct tty_transfer_uring_ *tty_transfer_uring_for_thread(void) {
+  unsigned gen = atomic_load_explicit(&ring_fork_gen, memory_order_relaxed);
+  if (thread_ring_state && thread_ring_fork_gen != gen) {
+    if (thread_ring_state == 1) {
+      pthread_setspecific(thread_ring_key, NULL);
+      tty_transfer_uring_free(&thread_ring);
+    }
+
+    thread_ring_state = 0;
+  }
+
+  if (!thread_ring_state) {
+    thread_ring_fork_gen = gen;
+    pthread_once(&thread_ring_once, thread_ring_create_key);
+
+    thread_ring_state = -1;
+    if (tty_transfer_uring_init(&thread_ring, 8)) {
+      thread_ring_state = 1;
+      pthread_setspecific(thread_ring_key, &thread_ring);
+    }
+  }
+
+  return thread_ring_state == 1 ? &thread_ring : NULL;
+}
+
+// Drive a single request with the thread's ring. Returns 0 if io_uring is
+// unavailable and the request was not touched.
+static int tty_transfer_uring_wait(tty_transfer_request *req) {
+  struct tty_transfer_uring_ *r = tty_transfer_uring_for_thread();
+  if (!r)
+    return 0;
+
+  tty_transfer_uring_run(r, &req, 1);
+  return 1;
+}
+
+int tty_transfer_request_wait_all(tty_transfer_request **reqs, size_t n) {
+  unsigned entries = 8;
+  while (entries < n * URING_SQES_PER_REQUEST) {
+    entries *= 2;
+    if (entries > URING_MAX_ENTRIES)
+      return 0;
+  }
+
+  struct tty_transfer_uring_ r;
+  if (!tty_transfer_uring_init(&r, entries))
+    return 0;
+
+  tty_transfer_uring_run(&r, reqs, n);
+  tty_transfer_uring_free(&r);
+  return 1;
+}
@@ -0,0 +1,90 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_OSC_H
+#define TTY_TRANSFER_PRIVATE_OSC_H
+
+#include "tty_transfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * OSC strings recognized by tty_transfer_osc_matcher
+ */
+typedef enum tty_transfer_osc_kind {
+  TTY_TRANSFER_OSC_NONE = 0,
+  /** 1337;IOToken=<key>;<val> */
+  TTY_TRANSFER_OSC_IO_TOKEN = 1,
+  /** 1337;RequestTransferIOToken=<key> */
+  TTY_TRANSFER_OSC_REQUEST = 2,
+} tty_transfer_osc_kind;
+
+/**
+ * Fields of the recognized OSC strings. Whitespace may precede each one.
+ */
+typedef enum tty_transfer_osc_field {
+  tty_transfer_osc_1337,
+  tty_transfer_osc_semi,
+  tty_transfer_osc_name,
+  tty_transfer_osc_eq,
+  tty_transfer_osc_key,
+  tty_transfer_osc_key_semi,
+  tty_transfer_osc_val,
+  tty_transfer_osc_end,
+  tty_transfer_osc_reject,
+} tty_transfer_osc_field;
+
+/**
+ * Incremental matcher for the string of an OSC sequence
+ * @remarks Only the UUIDs are stored, so memory and work per byte are
+ * bounded however long the string is. Once the string can no longer match,
+ * field is tty_transfer_osc_reject and the rest can be skipped. UUIDs are
+ * only checked once all 36 chars arrive.
+ */
+typedef struct tty_transfer_osc_matcher {
+  unsigned char field; // enum tty_transfer_osc_field
+  unsigned char pos;   // chars matched in the field
+  unsigned char kind;  // enum tty_transfer_osc_kind, once the name starts
+  char key[37];
+  char val[37];
+  tty_transfer_uuid key_bin;
+  tty_transfer_uuid val_bin;
+} tty_transfer_osc_matcher;
+
+/**
+ * Prepare a matcher for a new OSC string
+ * @param[in] m The matcher
+ */
+void tty_transfer_osc_matcher_reset(tty_transfer_osc_matcher *m);
+
+/**
+ * Match more chars of an OSC string
+ * @param[in] m The matcher
+ * @param[in] s The chars of the string
+ * @param[in] n The number of chars in s
+ * @returns 0 if the string can no longer match, otherwise 1
+ */
+int tty_transfer_osc_matcher_put(tty_transfer_osc_matcher *m, const char *s,
+                                 size_t n);
+
+/**
+ * Classify the string once the OSC sequence is terminated
+ * @param[in] m The matcher
+ * @returns The kind of string matched. The key, and the val for
+ * TTY_TRANSFER_OSC_IO_TOKEN, are set in m.
+ */
+tty_transfer_osc_kind
+tty_transfer_osc_matcher_finish(const tty_transfer_osc_matcher *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_RESTORE_H
+#define TTY_TRANSFER_PRIVATE_RESTORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <termios.h>
+
+/** Maximum number of ttys that can be registered at once */
+#define TTY_TRANSFER_RESTORE_MAX 64
+
+/**
+ * Register terminal attributes to restore if the process exits or is killed
+ * by a signal before tty_transfer_restore_unregister is called
+ * @param[in] fd The tty
+ * @param[in] tattr The attributes to restore
+ * @returns A registration for tty_transfer_restore_unregister, or -1 if too
+ * many ttys are registered
+ * @remarks The first registration installs an atexit handler and handlers
+ * for terminating signals whose disposition is the default. Those handlers
+ * restore every registered tty and then perform the default action.
+ */
+int tty_transfer_restore_register(int fd, const struct termios *tattr);
+
+/**
+ * Stop restoring a registered tty
+ * @param[in] reg The registration, or -1 to do nothing
+ */
+void tty_transfer_restore_unregister(int reg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
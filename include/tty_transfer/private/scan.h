@@ -0,0 +1,52 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_SCAN_H
+#define TTY_TRANSFER_PRIVATE_SCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * Find the first occurrence of a byte in a buffer
+ * @param[in] buf The buffer to scan
+ * @param[in] n The number of bytes in buf
+ * @param[in] c The byte to search for
+ * @returns The offset of the first matching byte, or n if none match
+ */
+size_t tty_transfer_scan_byte(const char *buf, size_t n, unsigned char c);
+
+/**
+ * Find the first byte within an inclusive range of values
+ * @param[in] buf The buffer to scan
+ * @param[in] n The number of bytes in buf
+ * @param[in] lo The smallest matching byte value
+ * @param[in] hi The largest matching byte value
+ * @returns The offset of the first matching byte, or n if none match
+ */
+size_t tty_transfer_scan_range(const char *buf, size_t n, unsigned char lo,
+                               unsigned char hi);
+
+/**
+ * Find the first byte that is not a CSI parameter: a digit, ':' or ';'
+ * @param[in] buf The buffer to scan
+ * @param[in] n The number of bytes in buf
+ * @returns The offset of the first other byte, or n if there is none
+ * @remarks Parameters are usually a few bytes long, so this is not
+ * vectorized
+ */
+size_t tty_transfer_scan_csi_params(const char *buf, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_STATS_H
+#define TTY_TRANSFER_PRIVATE_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tty_transfer.h"
+
+/**
+ * Add an ended request to the process-wide counters
+ * @param[in] stats The request's stats
+ * @param[in] result The request's result
+ */
+void tty_transfer_stats_record(const tty_transfer_request_stats *stats,
+                               tty_transfer_errno result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_TIMER_WHEEL_H
+#define TTY_TRANSFER_PRIVATE_TIMER_WHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Hashed timer wheel over a fixed range of integer timer ids
+ */
+typedef struct tty_transfer_timer_wheel_ tty_transfer_timer_wheel;
+
+/**
+ * Callback invoked for each expired timer
+ * @param[in] ctx The context given to tty_transfer_timer_wheel_advance
+ * @param[in] id The id of the expired timer
+ */
+typedef void (*tty_transfer_timer_fn)(void *ctx, uint32_t id);
+
+/**
+ * Allocate a timer wheel
+ * @param[in] capacity Timer ids must be less than this value
+ * @param[in] nslots The number of slots. Must be a power of two
+ * @param[in] tick_ns The time spanned by each slot in nanoseconds
+ * @param[in] now_ns The current time in nanoseconds
+ * @returns The newly allocated wheel or NULL
+ */
+tty_transfer_timer_wheel *tty_transfer_timer_wheel_alloc(size_t capacity,
+                                                         size_t nslots,
+                                                         int64_t tick_ns,
+                                                         int64_t now_ns);
+
+/**
+ * Free a timer wheel
+ */
+void tty_transfer_timer_wheel_free(tty_transfer_timer_wheel *w);
+
+/**
+ * Schedule a timer, replacing any pending deadline for the same id
+ * @param[in] w The wheel
+ * @param[in] id The timer id
+ * @param[in] deadline_ns When the timer expires in nanoseconds
+ */
+void tty_transfer_timer_wheel_schedule(tty_transfer_timer_wheel *w,
+                                       uint32_t id, int64_t deadline_ns);
+
+/**
+ * Cancel a timer. Does nothing if the timer is not pending.
+ * @param[in] w The wheel
+ * @param[in] id The timer id
+ */
+void tty_transfer_timer_wheel_cancel(tty_transfer_timer_wheel *w, uint32_t id);
+
+/**
+ * Expire every timer whose deadline is at or before now_ns
+ * @param[in] w The wheel
+ * @param[in] now_ns The current time in nanoseconds
+ * @param[in] fn Called for each expired timer after it is removed. It must
+ * not schedule or cancel timers.
+ * @param[in] ctx Passed to fn
+ * @returns The number of expired timers
+ */
+size_t tty_transfer_timer_wheel_advance(tty_transfer_timer_wheel *w,
+                                        int64_t now_ns,
+                                        tty_transfer_timer_fn fn, void *ctx);
+
+/**
+ * Find when the next timer might expire
+ * @param[in] w The wheel
+ * @param[out] deadline_ns Set to a time no later than the earliest pending
+ * deadline
+ * @returns 1 if any timer is pending, 0 otherwise
+ */
+int tty_transfer_timer_wheel_next(const tty_transfer_timer_wheel *w,
+                                  int64_t *deadline_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_TOKEN_CACHE_H
+#define TTY_TRANSFER_PRIVATE_TOKEN_CACHE_H
+
+#include "tty_transfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Request an I/O token, reusing one that another process on the same
+ * terminal obtained within opts->token_cache_ms
+ * @param[in] opts The options for the request. token_cache_ms is positive.
+ * @param[out] token_buf The buffer to hold the null terminated output token
+ * @param[in] token_buf_size The size of token_buf in chars
+ * @returns An error code constant
+ * @remarks The token is shared through a memory mapped file in the runtime
+ * directory guarded by a seqlock. Writers hold an flock on the file while
+ * they request a token, so processes starting together make one request.
+ * The others poll for the token and the flock until their own deadline or
+ * cancel_fd, since the writer may take longer or be stopped.
+ * Terminals that cannot be cached are requested from directly.
+ */
+tty_transfer_errno
+tty_transfer_token_cache_request(const tty_transfer_request_options *opts,
+                                 char *token_buf, size_t token_buf_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
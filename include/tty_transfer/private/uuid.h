@@ -13,6 +13,8 @@
 extern "C" {
 #endif
 
+#include "tty_transfer.h"
+
 #include <stddef.h>
 
 /** Size for allocating memory for a formatted UUID string */
@@ -27,6 +29,25 @@ extern "C" {
  */
 int tty_transfer_uuid_generate(char *buf, size_t bufsz);
 
+/**
+ * Generate many random UUIDs and format them
+ * @param[out] bufs The buffer to store n consecutive formatted UUIDs, each
+ * occupying TTY_TRANSFER_UUID_SIZE chars
+ * @param[in] n The number of UUIDs to generate
+ * @returns 1 on success, 0 on failure
+ */
+int tty_transfer_uuid_generate_batch(char *bufs, size_t n);
+
+/**
+ * Generate random RFC 9562 version 4 UUIDs
+ * @param[out] uuids The generated UUIDs
+ * @param[in] n The number of UUIDs to generate
+ * @returns 1 on success, 0 on failure
+ * @remarks Random bytes are drawn from a per-thread pool that is refilled in
+ * batches, so most calls make no system call
+ */
+int tty_transfer_uuid_random(tty_transfer_uuid *uuids, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,95 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_VTPARSE_H
+#define TTY_TRANSFER_PRIVATE_VTPARSE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Escape sequence recognizer modeled on the VT500 series parser described at
+// https://vt100.net/emu/dec_ansi_parser. Only 7-bit controls are recognized,
+// so UTF-8 continuation bytes are never mistaken for 8-bit C1 controls.
+
+/**
+ * Parser states
+ */
+enum tty_transfer_vt_state {
+  vt_ground,
+  vt_escape,
+  vt_escape_intermediate,
+  vt_csi_entry,
+  vt_csi_param,
+  vt_csi_intermediate,
+  vt_csi_ignore,
+  vt_dcs_entry,
+  vt_dcs_param,
+  vt_dcs_intermediate,
+  vt_dcs_passthrough,
+  vt_dcs_ignore,
+  vt_osc_string,
+  vt_osc_esc, // ESC seen in an OSC string, which ends it if followed by '\'
+  vt_sos_pm_apc_string,
+  vt_nstates
+};
+
+/**
+ * Actions taken on a transition
+ */
+enum tty_transfer_vt_action {
+  vt_none,
+  vt_osc_start, // begin collecting an OSC string
+  vt_osc_put,   // collect a byte of an OSC string
+  vt_osc_end,   // the OSC string was terminated by ST or BEL
+  vt_csi_start, // a CSI sequence began
+  vt_cpr        // a CSI sequence ended with 'R', like a cursor position report
+};
+
+/**
+ * Classes of bytes that the transitions distinguish
+ */
+enum tty_transfer_vt_class {
+  vt_class_c0,        // C0 controls without a class of their own
+  vt_class_bel,       // 0x07
+  vt_class_can,       // CAN and SUB abort any sequence
+  vt_class_esc,       // 0x1b
+  vt_class_inter,     // 0x20 to 0x2f
+  vt_class_param,     // digits and ';'
+  vt_class_colon,     // ':' for sub-parameters
+  vt_class_priv,      // '<', '=', '>' and '?'
+  vt_class_csi,       // '['
+  vt_class_osc,       // ']'
+  vt_class_dcs,       // 'P'
+  vt_class_sos,       // 'X', '^' and '_' for SOS, PM and APC
+  vt_class_st,        // '\'
+  vt_class_cpr,       // 'R'
+  vt_class_final,     // every other byte from 0x40 to 0x7e
+  vt_class_del,       // 0x7f
+  vt_class_high,      // 0x80 to 0xff
+  vt_nclasses
+};
+
+/** Class of each byte value */
+extern const unsigned char tty_transfer_vt_classes[256];
+
+/**
+ * Transition for each state and byte class. The low nibble is the next
+ * state and the high nibble is the action.
+ */
+extern const unsigned char tty_transfer_vt_transitions[vt_nstates]
+                                                      [vt_nclasses];
+
+#define TTY_TRANSFER_VT_STATE(t) ((t) & 0xf)
+#define TTY_TRANSFER_VT_ACTION(t) ((t) >> 4)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef TTY_TRANSFER_PRIVATE_WAIT_H
+#define TTY_TRANSFER_PRIVATE_WAIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "tty_transfer.h"
+
+/**
+ * Drive many requests to completion at once with io_uring
+ * @param[in] reqs Requests from tty_transfer_request_begin
+ * @param[in] n The number of requests
+ * @returns 1 if every request completed, or 0 if io_uring is unavailable, in
+ * which case no request was touched
+ * @remarks This is only available when built with TTY_TRANSFER_IO_URING on
+ * Linux. Each request is still released with tty_transfer_request_finish.
+ */
+int tty_transfer_request_wait_all(tty_transfer_request **reqs, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_REGISTRY_H
+#define TTY_TRANSFER_REGISTRY_H
+
+#include "tty_transfer.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Type that maps I/O tokens minted by a host to caller defined values, like
+ * the pty each token transfers
+ * @remarks Every function is safe to call from any number of threads. The
+ * map is split into shards with their own reader-writer locks, so lookups
+ * of different tokens rarely contend.
+ */
+typedef struct tty_transfer_registry_ tty_transfer_registry;
+
+/**
+ * Allocate a tty_transfer_registry
+ * @param[in] capacity The maximum number of tokens held at once. All memory
+ * for them is allocated up front.
+ * @returns The newly allocated registry or NULL
+ */
+TTY_TRANSFER_API tty_transfer_registry *
+tty_transfer_registry_alloc(size_t capacity);
+
+/**
+ * Free a tty_transfer_registry
+ */
+TTY_TRANSFER_API void tty_transfer_registry_free(tty_transfer_registry *r);
+
+/**
+ * Mint a random token
+ * @param[in] r The registry
+ * @param[in] value The value to resolve the token to
+ * @param[in] ttl_ms Milliseconds until the token expires
+ * @param[out] token The new token
+ * @returns TTY_TRANSFER_OK, TTY_TRANSFER_FULL if capacity tokens are held,
+ * or TTY_TRANSFER_NO_ENTROPY if no random token could be generated
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_registry_mint(tty_transfer_registry *r, uint64_t value,
+                           int ttl_ms, tty_transfer_uuid *token);
+
+/**
+ * Add or replace a token that was minted elsewhere
+ * @param[in] r The registry
+ * @param[in] token The token
+ * @param[in] value The value to resolve the token to
+ * @param[in] ttl_ms Milliseconds until the token expires
+ * @returns TTY_TRANSFER_OK, or TTY_TRANSFER_FULL if capacity tokens are held
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_registry_insert(tty_transfer_registry *r,
+                             const tty_transfer_uuid *token, uint64_t value,
+                             int ttl_ms);
+
+/**
+ * Resolve a token
+ * @param[in] r The registry
+ * @param[in] token The token
+ * @param[out] value Set to the token's value if it is found, or NULL
+ * @returns 1 if the token is held and has not expired, otherwise 0
+ */
+TTY_TRANSFER_API int
+tty_transfer_registry_lookup(tty_transfer_registry *r,
+                             const tty_transfer_uuid *token, uint64_t *value);
+
+/**
+ * Resolve a token and remove it so it cannot be presented again
+ * @param[in] r The registry
+ * @param[in] token The token
+ * @param[out] value Set to the token's value if it is found, or NULL
+ * @returns 1 if the token was held and had not expired, otherwise 0
+ */
+TTY_TRANSFER_API int
+tty_transfer_registry_take(tty_transfer_registry *r,
+                           const tty_transfer_uuid *token, uint64_t *value);
+
+/**
+ * Reclaim the memory of expired tokens
+ * @param[in] r The registry
+ * @returns The number of tokens reclaimed
+ * @remarks Expired tokens never resolve, and minting reclaims them from the
+ * shard it inserts into, so calling this is only needed to bound how long
+ * expired tokens hold memory in idle shards
+ */
+TTY_TRANSFER_API size_t tty_transfer_registry_expire(tty_transfer_registry *r);
+
+/**
+ * Number of tokens held, including expired tokens not yet reclaimed
+ * @param[in] r The registry
+ * @returns The number of tokens
+ */
+TTY_TRANSFER_API size_t tty_transfer_registry_size(tty_transfer_registry *r);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_SESSION_H
+#define TTY_TRANSFER_SESSION_H
+
+#include "tty_transfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Type that keeps a tty in raw mode across many I/O token requests
+ */
+typedef struct tty_transfer_session_ tty_transfer_session;
+
+/**
+ * Constants selecting how a session treats pending tty I/O
+ */
+typedef enum tty_transfer_drain_policy {
+  /** Wait for pending output to be written before entering raw mode and
+   * before restoring the tty (default) */
+  TTY_TRANSFER_DRAIN_OUTPUT = 0,
+  /** Change modes immediately without waiting for pending output */
+  TTY_TRANSFER_DRAIN_NONE = 1,
+  /** Like TTY_TRANSFER_DRAIN_OUTPUT, and also discard unread input when
+   * entering raw mode and before each request, so late replies to an
+   * earlier request cannot be mistaken for the current one */
+  TTY_TRANSFER_DRAIN_FLUSH_INPUT = 2,
+} tty_transfer_drain_policy;
+
+/**
+ * Open a session, putting the tty in raw mode until it is closed
+ * @param[in] opts The options for every request, or NULL for defaults. The
+ * deadline option is ignored, and stats describe the most recent request.
+ * @param[in] drain How pending tty I/O is treated
+ * @param[out] session The newly opened session, or NULL on failure
+ * @returns TTY_TRANSFER_OK on success, or an error code constant
+ * @remarks The original terminal attributes are also restored if the process
+ * exits or is killed by a terminating signal whose disposition was the
+ * default before the session was opened.
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_session_open(const tty_transfer_request_options *opts,
+                          tty_transfer_drain_policy drain,
+                          tty_transfer_session **session);
+
+/**
+ * Synchronously request an IO token on a session's tty
+ * @param[in] session The session
+ * @param[out] token_buf The buffer to hold the null terminated output token
+ * @param[in] token_buf_size The size of token_buf in chars. This must be at
+ * least 37 to hold a null terminated formatted UUID
+ * @returns An error code constant
+ * @remarks This reuses the session's parser and request buffers, so it makes
+ * no termios changes and no allocations
+ */
+TTY_TRANSFER_API tty_transfer_errno
+tty_transfer_session_request_io_token(tty_transfer_session *session,
+                                      char *token_buf, size_t token_buf_size);
+
+/**
+ * Restore the session's tty and free the session
+ * @param[in] session The session, or NULL to do nothing
+ */
+TTY_TRANSFER_API void tty_transfer_session_close(tty_transfer_session *session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
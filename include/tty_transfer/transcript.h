@@ -0,0 +1,91 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#ifndef TTY_TRANSFER_TRANSCRIPT_H
+#define TTY_TRANSFER_TRANSCRIPT_H
+
+#include "tty_transfer.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Kinds of sequences found in a transcript
+ */
+typedef enum tty_transfer_transcript_event_type {
+  /** An I/O token reply, 1337;IOToken=<key>;<val> */
+  TTY_TRANSFER_TRANSCRIPT_TOKEN = 0,
+  /** An I/O token request, 1337;RequestTransferIOToken=<key> */
+  TTY_TRANSFER_TRANSCRIPT_REQUEST = 1,
+  /** A CSI sequence ending with 'R', like a cursor position report */
+  TTY_TRANSFER_TRANSCRIPT_CPR = 2,
+} tty_transfer_transcript_event_type;
+
+/**
+ * A sequence found in a transcript
+ */
+typedef struct tty_transfer_transcript_event {
+  /** The kind of sequence */
+  tty_transfer_transcript_event_type type;
+  /** Offset of the ESC beginning the sequence */
+  uint64_t start;
+  /** Offset one past the end of the sequence */
+  uint64_t end;
+  /** The key of a token or request */
+  tty_transfer_uuid key;
+  /** The token of a token reply */
+  tty_transfer_uuid val;
+} tty_transfer_transcript_event;
+
+/**
+ * Find every I/O token, request and CPR in a transcript
+ * @param[in] bytes The recorded tty traffic
+ * @param[in] nbytes The number of bytes
+ * @param[in] nthreads The number of threads to scan with, or 0 for one per
+ * online CPU. Fewer are used if chunks would be under 256 KiB.
+ * @param[out] events Set to the events in order of their end offsets. Free
+ * with tty_transfer_transcript_events_free.
+ * @param[out] nevents Set to the number of events
+ * @returns An error code constant
+ * @remarks The transcript is split into chunks at ESC bytes and each chunk
+ * is scanned as if it began outside any sequence. Chunks are then merged in
+ * order, rescanning the start of a chunk from the true state of the previous
+ * chunk until the two agree, so the result is exactly what one sequential
+ * pass with the tty_transfer_parser state machine finds.
+ */
+TTY_TRANSFER_API tty_transfer_errno tty_transfer_transcript_scan(
+    const void *bytes, size_t nbytes, size_t nthreads,
+    tty_transfer_transcript_event **events, size_t *nevents);
+
+/**
+ * Find every I/O token, request and CPR in a transcript file
+ * @param[in] path The path of the transcript, which is memory mapped
+ * @param[in] nthreads The number of threads to scan with, or 0 for one per
+ * online CPU
+ * @param[out] events Set to the events. Free with
+ * tty_transfer_transcript_events_free.
+ * @param[out] nevents Set to the number of events
+ * @returns An error code constant
+ */
+TTY_TRANSFER_API tty_transfer_errno tty_transfer_transcript_scan_file(
+    const char *path, size_t nthreads, tty_transfer_transcript_event **events,
+    size_t *nevents);
+
+/**
+ * Free events from tty_transfer_transcript_scan
+ */
+TTY_TRANSFER_API void
+tty_transfer_transcript_events_free(tty_transfer_transcript_event *events);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,7 +18,25 @@ cli((make) => {
 
   const lib = d.addLibrary({
     name: "tty_transfer",
-    src: ["src/tty_transfer.c", "src/uuid.c"],
+    src: [
+      "src/tty_transfer.c",
+      "src/uuid.c",
+      "src/scan.c",
+      "src/vtparse.c",
+      "src/timer_wheel.c",
+      "src/broker.c",
+      "src/host.c",
+      "src/handoff.c",
+      "src/registry.c",
+      "src/alloc.c",
+      "src/clock.c",
+      "src/stats.c",
+      "src/restore.c",
+      "src/transcript.c",
+      "src/caps.c",
+      "src/token_cache.c",
+      "src/parser_pool.c",
+    ],
   });
 
   const gtest = d.findPackage("gtest_main");
@@ -29,8 +47,46 @@ cli((make) => {
     linkTo: [lib, gtest],
   });
 
+  d.addTest({
+    name: "tty_transfer_alloc_test",
+    src: ["test/tty_transfer_alloc_test.cpp"],
+    linkTo: [lib, gtest],
+  });
+
   make.add("test", [d.test], () => {});
 
+  const stress = d.addExecutable({
+    name: "tty_transfer_stress",
+    src: ["bench/tty_transfer_stress.cpp"],
+    linkTo: [lib],
+  });
+
+  const benchBinaries = [stress.binary];
+
+  // Google Benchmark is only installed where benchmarks are run, like not in
+  // CI, so the microbenchmark is opt in with TTY_TRANSFER_BENCH=1
+  if (process.env.TTY_TRANSFER_BENCH === "1") {
+    const benchmark = d.findPackage("benchmark");
+
+    const bench = d.addExecutable({
+      name: "tty_transfer_bench",
+      src: ["bench/tty_transfer_bench.cpp"],
+      linkTo: [lib, benchmark],
+    });
+
+    benchBinaries.push(bench.binary);
+  }
+
+  make.add("bench", benchBinaries, () => {});
+
+  const transcript = d.addExecutable({
+    name: "tty_transfer_transcript",
+    src: ["tools/tty_transfer_transcript.c"],
+    linkTo: [lib],
+  });
+
+  make.add("tools", [transcript.binary], () => {});
+
   const compileCommands = addCompileCommands(make, d);
 
   make.add("all", [d.test, compileCommands]);
@@ -0,0 +1,56 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/private/alloc.h"
+#include "tty_transfer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *default_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  return malloc(size);
+}
+
+static void default_free(void *ctx, void *ptr) {
+  (void)ctx;
+  free(ptr);
+}
+
+static tty_transfer_allocator allocator = {default_alloc, default_free, NULL};
+
+void tty_transfer_set_allocator(const tty_transfer_allocator *a) {
+  if (a) {
+    allocator = *a;
+  } else {
+    allocator.alloc = default_alloc;
+    allocator.free = default_free;
+    allocator.ctx = NULL;
+  }
+}
+
+void *tty_transfer_malloc(size_t size) {
+  return allocator.alloc(allocator.ctx, size);
+}
+
+void *tty_transfer_calloc(size_t n, size_t size) {
+  if (size && n > SIZE_MAX / size)
+    return NULL;
+
+  void *ptr = tty_transfer_malloc(n * size);
+  if (ptr)
+    memset(ptr, 0, n * size);
+
+  return ptr;
+}
+
+void tty_transfer_free(void *ptr) {
+  if (ptr)
+    allocator.free(allocator.ctx, ptr);
+}
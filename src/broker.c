@@ -0,0 +1,348 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/broker.h"
+#include "tty_transfer/private/alloc.h"
+#include "tty_transfer/private/clock.h"
+#include "tty_transfer/private/timer_wheel.h"
+#include "tty_transfer/private/uuid.h"
+#include "tty_transfer/private/wait.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#define TTY_TRANSFER_BROKER_EPOLL 1
+#include <sys/epoll.h>
+#elif defined(__APPLE__)
+#include <poll.h>
+#else
+#error "Platform not supported!"
+#endif
+
+// Deadlines are tracked with 1ms resolution over a ~1s wheel
+#define WHEEL_SLOTS 1024
+#define WHEEL_TICK_NS 1000000
+
+// Maximum number of readiness events handled per wait
+#define MAX_EVENTS 256
+
+struct tty_transfer_broker_entry_ {
+  int in_fd;
+  int out_fd;
+  int timeout_ms;
+  tty_transfer_request *req;
+  int watch_fd; // -1 if not watched
+  int watch_events;
+  tty_transfer_errno result;
+  char token[TTY_TRANSFER_UUID_SIZE];
+};
+
+struct tty_transfer_broker_ {
+  size_t capacity;
+  size_t n;
+  size_t npending;
+  struct tty_transfer_broker_entry_ *entries;
+  tty_transfer_request **reqs; // scratch for tty_transfer_request_wait_all
+  tty_transfer_timer_wheel *wheel;
+#ifdef TTY_TRANSFER_BROKER_EPOLL
+  int epfd;
+#else
+  struct pollfd *pfds;
+  uint32_t *pfd_entries;
+#endif
+};
+
+tty_transfer_broker *tty_transfer_broker_alloc(size_t capacity) {
+  tty_transfer_broker *b = tty_transfer_calloc(1, sizeof(tty_transfer_broker));
+  if (!b)
+    return NULL;
+
+  b->capacity = capacity;
+  b->entries = tty_transfer_calloc(capacity ? capacity : 1,
+                                   sizeof(struct tty_transfer_broker_entry_));
+  b->reqs = tty_transfer_calloc(capacity ? capacity : 1,
+                                sizeof(tty_transfer_request *));
+  b->wheel = tty_transfer_timer_wheel_alloc(
+      capacity, WHEEL_SLOTS, WHEEL_TICK_NS, tty_transfer_monotonic_ns());
+
+#ifdef TTY_TRANSFER_BROKER_EPOLL
+  b->epfd = epoll_create1(EPOLL_CLOEXEC);
+  int ok = b->epfd != -1;
+#else
+  b->pfds =
+      tty_transfer_calloc(capacity ? capacity : 1, sizeof(struct pollfd));
+  b->pfd_entries =
+      tty_transfer_calloc(capacity ? capacity : 1, sizeof(uint32_t));
+  int ok = b->pfds && b->pfd_entries;
+#endif
+
+  if (!(ok && b->entries && b->reqs && b->wheel)) {
+    tty_transfer_broker_free(b);
+    return NULL;
+  }
+
+  return b;
+}
+
+void tty_transfer_broker_free(tty_transfer_broker *b) {
+  if (!b)
+    return;
+
+  for (size_t i = 0; i < b->n; ++i) {
+    if (b->entries[i].req)
+      tty_transfer_request_finish(b->entries[i].req, NULL, 0);
+  }
+
+#ifdef TTY_TRANSFER_BROKER_EPOLL
+  if (b->epfd != -1)
+    close(b->epfd);
+#else
+  tty_transfer_free(b->pfds);
+  tty_transfer_free(b->pfd_entries);
+#endif
+
+  tty_transfer_timer_wheel_free(b->wheel);
+  tty_transfer_free(b->reqs);
+  tty_transfer_free(b->entries);
+  tty_transfer_free(b);
+}
+
+int tty_transfer_broker_add(tty_transfer_broker *b, int in_fd, int out_fd,
+                            int timeout_ms) {
+  if (b->n >= b->capacity)
+    return -1;
+
+  struct tty_transfer_broker_entry_ *e = &b->entries[b->n];
+  e->in_fd = in_fd;
+  e->out_fd = out_fd;
+  e->timeout_ms = timeout_ms;
+  e->req = NULL;
+  e->watch_fd = -1;
+  e->watch_events = 0;
+  e->result = TTY_TRANSFER_IN_PROGRESS;
+  e->token[0] = '\0';
+
+  return (int)b->n++;
+}
+
+tty_transfer_errno tty_transfer_broker_result(const tty_transfer_broker *b,
+                                              int index, char *token_buf,
+                                              size_t token_buf_size) {
+  if (index < 0 || (size_t)index >= b->n)
+    return TTY_TRANSFER_BAD_READ;
+
+  const struct tty_transfer_broker_entry_ *e = &b->entries[index];
+  tty_transfer_errno out = e->result;
+
+  if (out == TTY_TRANSFER_OK) {
+    strncpy(token_buf, e->token, token_buf_size);
+
+    if (strlen(e->token) >= token_buf_size) {
+      out = TTY_TRANSFER_TOKEN_TRUNCATED;
+      token_buf[token_buf_size - 1] = '\0';
+    }
+  }
+
+  return out;
+}
+
+static void tty_transfer_broker_unwatch(tty_transfer_broker *b, uint32_t i) {
+  struct tty_transfer_broker_entry_ *e = &b->entries[i];
+  if (e->watch_fd == -1)
+    return;
+
+#ifdef TTY_TRANSFER_BROKER_EPOLL
+  epoll_ctl(b->epfd, EPOLL_CTL_DEL, e->watch_fd, NULL);
+#endif
+
+  e->watch_fd = -1;
+  e->watch_events = 0;
+}
+
+static void tty_transfer_broker_complete(tty_transfer_broker *b, uint32_t i,
+                                         tty_transfer_errno result) {
+  struct tty_transfer_broker_entry_ *e = &b->entries[i];
+
+  tty_transfer_broker_unwatch(b, i);
+  tty_transfer_timer_wheel_cancel(b->wheel, i);
+
+  tty_transfer_errno finished =
+      tty_transfer_request_finish(e->req, e->token, sizeof(e->token));
+
+  // abandoned requests report TTY_TRANSFER_IN_PROGRESS
+  e->result = finished == TTY_TRANSFER_IN_PROGRESS ? result : finished;
+  e->req = NULL;
+  --b->npending;
+}
+
+// Make sure the entry is watched for what its request is waiting on
+static tty_transfer_errno tty_transfer_broker_watch(tty_transfer_broker *b,
+                                                    uint32_t i) {
+  struct tty_transfer_broker_entry_ *e = &b->entries[i];
+  int fd = tty_transfer_request_fd(e->req);
+  int events = tty_transfer_request_events(e->req);
+
+  if (fd == e->watch_fd && events == e->watch_events)
+    return TTY_TRANSFER_IN_PROGRESS;
+
+#ifdef TTY_TRANSFER_BROKER_EPOLL
+  struct epoll_event ev;
+  ev.events = (events & TTY_TRANSFER_EVENT_READ) ? EPOLLIN : EPOLLOUT;
+  ev.data.u32 = i;
+
+  int op = EPOLL_CTL_ADD;
+  if (fd == e->watch_fd) {
+    op = EPOLL_CTL_MOD;
+  } else {
+    tty_transfer_broker_unwatch(b, i);
+  }
+
+  if (epoll_ctl(b->epfd, op, fd, &ev) == -1)
+    return TTY_TRANSFER_BAD_READ;
+#endif
+
+  e->watch_fd = fd;
+  e->watch_events = events;
+  return TTY_TRANSFER_IN_PROGRESS;
+}
+
+static void tty_transfer_broker_ready(tty_transfer_broker *b, uint32_t i) {
+  struct tty_transfer_broker_entry_ *e = &b->entries[i];
+  if (!e->req)
+    return;
+
+  // Any readiness, error or hangup is reported by the next read or write
+  tty_transfer_errno err = tty_transfer_request_step(e->req, e->watch_events);
+  if (err == TTY_TRANSFER_IN_PROGRESS)
+    err = tty_transfer_broker_watch(b, i);
+
+  if (err != TTY_TRANSFER_IN_PROGRESS)
+    tty_transfer_broker_complete(b, i, err);
+}
+
+static void tty_transfer_broker_on_timeout(void *ctx, uint32_t i) {
+  tty_transfer_broker *b = ctx;
+  tty_transfer_broker_complete(b, i, TTY_TRANSFER_TIMEOUT);
+}
+
+static tty_transfer_errno tty_transfer_broker_wait(tty_transfer_broker *b,
+                                                   int timeout_ms) {
+#ifdef TTY_TRANSFER_BROKER_EPOLL
+  struct epoll_event events[MAX_EVENTS];
+  int n = epoll_wait(b->epfd, events, MAX_EVENTS, timeout_ms);
+  if (n == -1)
+    return errno == EINTR ? TTY_TRANSFER_OK : TTY_TRANSFER_BAD_READ;
+
+  for (int k = 0; k < n; ++k)
+    tty_transfer_broker_ready(b, events[k].data.u32);
+#else
+  nfds_t nfds = 0;
+  for (size_t i = 0; i < b->n; ++i) {
+    const struct tty_transfer_broker_entry_ *e = &b->entries[i];
+    if (!e->req)
+      continue;
+
+    b->pfds[nfds].fd = e->watch_fd;
+    b->pfds[nfds].events =
+        (e->watch_events & TTY_TRANSFER_EVENT_READ) ? POLLIN : POLLOUT;
+    b->pfds[nfds].revents = 0;
+    b->pfd_entries[nfds] = i;
+    ++nfds;
+  }
+
+  int n = poll(b->pfds, nfds, timeout_ms);
+  if (n == -1)
+    return errno == EINTR ? TTY_TRANSFER_OK : TTY_TRANSFER_BAD_READ;
+
+  for (nfds_t k = 0; k < nfds && n > 0; ++k) {
+    if (b->pfds[k].revents) {
+      tty_transfer_broker_ready(b, b->pfd_entries[k]);
+      --n;
+    }
+  }
+#endif
+
+  return TTY_TRANSFER_OK;
+}
+
+// Drive every pending request from a single io_uring if available
+static int tty_transfer_broker_run_all(tty_transfer_broker *b) {
+  size_t n = 0;
+  for (size_t i = 0; i < b->n; ++i) {
+    if (b->entries[i].req)
+      b->reqs[n++] = b->entries[i].req;
+  }
+
+  if (!tty_transfer_request_wait_all(b->reqs, n))
+    return 0;
+
+  for (size_t i = 0; i < b->n; ++i) {
+    if (b->entries[i].req)
+      tty_transfer_broker_complete(b, i, TTY_TRANSFER_BAD_READ);
+  }
+
+  return 1;
+}
+
+tty_transfer_errno tty_transfer_broker_run(tty_transfer_broker *b) {
+  for (size_t i = 0; i < b->n; ++i) {
+    struct tty_transfer_broker_entry_ *e = &b->entries[i];
+    if (e->req || e->result != TTY_TRANSFER_IN_PROGRESS)
+      continue;
+
+    e->result =
+        tty_transfer_request_begin(e->in_fd, e->out_fd, e->timeout_ms, &e->req);
+    if (e->result == TTY_TRANSFER_IN_PROGRESS)
+      ++b->npending;
+  }
+
+  if (tty_transfer_broker_run_all(b))
+    return TTY_TRANSFER_OK;
+
+  // Issue every request before waiting on any of them
+  for (size_t i = 0; i < b->n; ++i) {
+    struct tty_transfer_broker_entry_ *e = &b->entries[i];
+    if (!e->req)
+      continue;
+
+    int64_t deadline_ns =
+        tty_transfer_monotonic_ns() + (int64_t)e->timeout_ms * 1000000;
+    tty_transfer_timer_wheel_schedule(b->wheel, i, deadline_ns);
+
+    // ttys are writable nearly always, so skip waiting to find out
+    tty_transfer_errno err =
+        tty_transfer_request_step(e->req, TTY_TRANSFER_EVENT_WRITE);
+    if (err == TTY_TRANSFER_IN_PROGRESS)
+      err = tty_transfer_broker_watch(b, i);
+
+    if (err != TTY_TRANSFER_IN_PROGRESS)
+      tty_transfer_broker_complete(b, i, err);
+  }
+
+  while (b->npending) {
+    int timeout_ms = -1;
+    int64_t deadline_ns;
+    if (tty_transfer_timer_wheel_next(b->wheel, &deadline_ns)) {
+      int64_t remaining = deadline_ns - tty_transfer_monotonic_ns();
+      timeout_ms = remaining > 0 ? (int)((remaining + 999999) / 1000000) : 0;
+    }
+
+    tty_transfer_errno err = tty_transfer_broker_wait(b, timeout_ms);
+    if (err != TTY_TRANSFER_OK)
+      return err;
+
+    tty_transfer_timer_wheel_advance(b->wheel, tty_transfer_monotonic_ns(),
+                                     tty_transfer_broker_on_timeout, b);
+  }
+
+  return TTY_TRANSFER_OK;
+}
@@ -0,0 +1,165 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable mkstemp and tcgetsid
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tty_transfer/private/caps.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// FNV-1a, so the key has a fixed size however long TERM is
+static uint64_t hash_str(const char *s) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (; *s; ++s) {
+    h ^= (unsigned char)*s;
+    h *= 0x100000001b3ull;
+  }
+
+  return h;
+}
+
+int tty_transfer_caps_key_init(tty_transfer_caps_key *key, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+    return 0;
+
+  // A tty without a session, like one end of a test pty, is not keyed by
+  // anything that changes when it is reused
+  pid_t sid = tcgetsid(fd);
+  if (sid == -1)
+    return 0;
+
+  const char *term = getenv("TERM");
+  key->rdev = st.st_rdev;
+  key->sid = sid;
+  key->term_hash = hash_str(term ? term : "");
+  return 1;
+}
+
+// Format the path of the cache directory, creating it if asked
+static int caps_dir(char *buf, size_t bufsz, int create) {
+  const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (!(runtime_dir && runtime_dir[0] == '/'))
+    return 0;
+
+  int n = snprintf(buf, bufsz, "%s/tty_transfer", runtime_dir);
+  if (n < 0 || (size_t)n >= bufsz)
+    return 0;
+
+  if (create && mkdir(buf, 0700) == -1 && errno != EEXIST)
+    return 0;
+
+  return 1;
+}
+
+int tty_transfer_caps_path(const tty_transfer_caps_key *key,
+                           const char *kind, char *buf, size_t bufsz,
+                           int create) {
+  char dir[TTY_TRANSFER_CAPS_PATH_SIZE];
+  if (!caps_dir(dir, sizeof(dir), create))
+    return 0;
+
+  int n = snprintf(buf, bufsz, "%s/%s-%llx-%lld-%016llx", dir, kind,
+                   (unsigned long long)key->rdev, (long long)key->sid,
+                   (unsigned long long)key->term_hash);
+  return n > 0 && (size_t)n < bufsz;
+}
+
+tty_transfer_caps
+tty_transfer_caps_lookup_key(const tty_transfer_caps_key *key) {
+  char path[TTY_TRANSFER_CAPS_PATH_SIZE];
+  if (!tty_transfer_caps_path(key, "caps", path, sizeof(path), 0))
+    return TTY_TRANSFER_CAPS_UNKNOWN;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return TTY_TRANSFER_CAPS_UNKNOWN;
+
+  tty_transfer_caps caps = TTY_TRANSFER_CAPS_UNKNOWN;
+
+  // Entries age by their modification time
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return caps;
+  }
+
+  char c;
+  if (time(NULL) - st.st_mtime >= TTY_TRANSFER_CAPS_MAX_AGE_S) {
+    // Remove the expired entry unless it was just replaced by a fresh one
+    struct stat cur;
+    if (stat(path, &cur) == 0 && cur.st_ino == st.st_ino &&
+        cur.st_dev == st.st_dev)
+      unlink(path);
+  } else if (read(fd, &c, 1) == 1) {
+    if (c == '0' + TTY_TRANSFER_CAPS_SUPPORTED)
+      caps = TTY_TRANSFER_CAPS_SUPPORTED;
+    else if (c == '0' + TTY_TRANSFER_CAPS_UNSUPPORTED)
+      caps = TTY_TRANSFER_CAPS_UNSUPPORTED;
+  }
+
+  close(fd);
+  return caps;
+}
+
+int tty_transfer_caps_store_key(const tty_transfer_caps_key *key,
+                                tty_transfer_caps caps) {
+  char path[TTY_TRANSFER_CAPS_PATH_SIZE];
+  int create = caps != TTY_TRANSFER_CAPS_UNKNOWN;
+  if (!tty_transfer_caps_path(key, "caps", path, sizeof(path), create))
+    return 0;
+
+  if (caps == TTY_TRANSFER_CAPS_UNKNOWN)
+    return unlink(path) == 0 || errno == ENOENT;
+
+  // Write a temporary file and rename it over the entry so readers see
+  // either the old or the new entry
+  char tmp_path[TTY_TRANSFER_CAPS_PATH_SIZE + 8];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+
+  int fd = mkstemp(tmp_path);
+  if (fd == -1)
+    return 0;
+
+  char line[2] = {(char)('0' + caps), '\n'};
+  int ok = write(fd, line, sizeof(line)) == sizeof(line);
+  ok = close(fd) == 0 && ok;
+  ok = ok && rename(tmp_path, path) == 0;
+
+  if (!ok)
+    unlink(tmp_path);
+
+  return ok;
+}
+
+tty_transfer_caps tty_transfer_caps_lookup(int fd) {
+  tty_transfer_caps_key key;
+  if (!tty_transfer_caps_key_init(&key, fd))
+    return TTY_TRANSFER_CAPS_UNKNOWN;
+
+  return tty_transfer_caps_lookup_key(&key);
+}
+
+int tty_transfer_caps_store(int fd, tty_transfer_caps caps) {
+  tty_transfer_caps_key key;
+  if (!tty_transfer_caps_key_init(&key, fd))
+    return 0;
+
+  return tty_transfer_caps_store_key(&key, caps);
+}
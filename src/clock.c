@@ -0,0 +1,32 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable clock_gettime
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tty_transfer/private/clock.h"
+
+#include <time.h>
+
+int64_t tty_transfer_monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int64_t
+tty_transfer_options_deadline_ns(const tty_transfer_request_options *opts) {
+  if (opts->deadline.tv_sec || opts->deadline.tv_nsec) {
+    return (int64_t)opts->deadline.tv_sec * 1000000000 +
+           opts->deadline.tv_nsec;
+  }
+
+  return tty_transfer_monotonic_ns() + (int64_t)opts->timeout_ms * 1000000;
+}
@@ -0,0 +1,273 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable SCM_RIGHTS and SOCK_CLOEXEC
+#define _DEFAULT_SOURCE
+#elif defined(__APPLE__)
+// enable CMSG_SPACE
+#define _DARWIN_C_SOURCE
+#endif
+
+#include "tty_transfer/handoff.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// The client sends the formatted token. The host replies with one status
+// byte, carrying the file descriptors as ancillary data when it is OK.
+#define TOKEN_LEN 36
+
+#if defined(SOCK_CLOEXEC)
+#define SOCKET_TYPE (SOCK_STREAM | SOCK_CLOEXEC)
+#else
+#define SOCKET_TYPE SOCK_STREAM
+#endif
+
+#if defined(MSG_CMSG_CLOEXEC)
+#define RECV_FLAGS MSG_CMSG_CLOEXEC
+#else
+#define RECV_FLAGS 0
+#endif
+
+#if defined(MSG_NOSIGNAL)
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static int make_addr(const char *path, struct sockaddr_un *addr,
+                     socklen_t *addr_len) {
+  size_t len = strlen(path);
+  if (!len || len >= sizeof(addr->sun_path))
+    return 0;
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  memcpy(addr->sun_path, path, len);
+
+#if defined(__linux__)
+  // Abstract socket names start with a null byte and are not terminated
+  if (path[0] == '@') {
+    addr->sun_path[0] = '\0';
+    *addr_len = offsetof(struct sockaddr_un, sun_path) + len;
+    return 1;
+  }
+#endif
+
+  *addr_len = sizeof(*addr);
+  return 1;
+}
+
+tty_transfer_errno tty_transfer_handoff_listen(const char *path,
+                                               int *listen_fd) {
+  struct sockaddr_un addr;
+  socklen_t addr_len;
+  if (!make_addr(path, &addr, &addr_len))
+    return TTY_TRANSFER_BAD_OPEN;
+
+  int fd = socket(AF_UNIX, SOCKET_TYPE, 0);
+  if (fd == -1)
+    return TTY_TRANSFER_BAD_OPEN;
+
+  if (bind(fd, (struct sockaddr *)&addr, addr_len) == -1 ||
+      listen(fd, SOMAXCONN) == -1) {
+    close(fd);
+    return TTY_TRANSFER_BAD_OPEN;
+  }
+
+  *listen_fd = fd;
+  return TTY_TRANSFER_OK;
+}
+
+static int recv_all(int fd, char *buf, size_t n) {
+  size_t nread = 0;
+  while (nread < n) {
+    ssize_t ret = recv(fd, buf + nread, n - nread, 0);
+    if (ret == -1 && errno == EINTR)
+      continue;
+    if (ret < 1)
+      return 0;
+
+    nread += ret;
+  }
+
+  return 1;
+}
+
+static int send_all(int fd, const char *buf, size_t n) {
+  size_t nwritten = 0;
+  while (nwritten < n) {
+    ssize_t ret = send(fd, buf + nwritten, n - nwritten, SEND_FLAGS);
+    if (ret == -1 && errno == EINTR)
+      continue;
+    if (ret < 1)
+      return 0;
+
+    nwritten += ret;
+  }
+
+  return 1;
+}
+
+static tty_transfer_errno send_status(int fd, tty_transfer_errno status,
+                                      const int *fds, size_t nfds) {
+  char byte = (char)status;
+  struct iovec iov = {&byte, 1};
+
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int) * TTY_TRANSFER_HANDOFF_MAX_FDS)];
+  } control;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  if (nfds) {
+    memset(&control, 0, sizeof(control));
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+  }
+
+  ssize_t ret;
+  do {
+    ret = sendmsg(fd, &msg, SEND_FLAGS);
+  } while (ret == -1 && errno == EINTR);
+
+  return ret == 1 ? status : TTY_TRANSFER_BAD_WRITE;
+}
+
+tty_transfer_errno
+tty_transfer_handoff_serve(int conn_fd, tty_transfer_handoff_resolve_fn resolve,
+                           void *ctx) {
+  char token_str[TOKEN_LEN + 1];
+  if (!recv_all(conn_fd, token_str, TOKEN_LEN))
+    return TTY_TRANSFER_BAD_READ;
+
+  token_str[TOKEN_LEN] = '\0';
+
+  tty_transfer_uuid token;
+  int fds[TTY_TRANSFER_HANDOFF_MAX_FDS];
+  size_t nfds = 0;
+
+  if (!tty_transfer_uuid_parse(token_str, &token) ||
+      !resolve(ctx, &token, fds, TTY_TRANSFER_HANDOFF_MAX_FDS, &nfds) ||
+      nfds > TTY_TRANSFER_HANDOFF_MAX_FDS) {
+    send_status(conn_fd, TTY_TRANSFER_REJECTED, NULL, 0);
+    return TTY_TRANSFER_REJECTED;
+  }
+
+  return send_status(conn_fd, TTY_TRANSFER_OK, fds, nfds);
+}
+
+tty_transfer_errno tty_transfer_handoff_redeem_fd(int sock_fd,
+                                                  const char *token, int *fds,
+                                                  size_t max_fds,
+                                                  size_t *nfds) {
+  *nfds = 0;
+
+  tty_transfer_uuid uuid;
+  if (!tty_transfer_uuid_parse(token, &uuid))
+    return TTY_TRANSFER_REJECTED;
+
+  if (!send_all(sock_fd, token, TOKEN_LEN))
+    return TTY_TRANSFER_BAD_WRITE;
+
+  char byte;
+  struct iovec iov = {&byte, 1};
+
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int) * TTY_TRANSFER_HANDOFF_MAX_FDS)];
+  } control;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t ret;
+  do {
+    ret = recvmsg(sock_fd, &msg, RECV_FLAGS);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret != 1)
+    return TTY_TRANSFER_BAD_READ;
+
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    const unsigned char *data = CMSG_DATA(cmsg);
+    for (size_t i = 0; i < n; ++i) {
+      int fd;
+      memcpy(&fd, data + i * sizeof(int), sizeof(int));
+
+      if (*nfds < max_fds)
+        fds[(*nfds)++] = fd;
+      else
+        close(fd);
+    }
+  }
+
+  if (byte != TTY_TRANSFER_OK) {
+    for (size_t i = 0; i < *nfds; ++i)
+      close(fds[i]);
+
+    *nfds = 0;
+    return (tty_transfer_errno)byte;
+  }
+
+  return TTY_TRANSFER_OK;
+}
+
+tty_transfer_errno tty_transfer_handoff_redeem(const char *path,
+                                               const char *token, int *fds,
+                                               size_t max_fds, size_t *nfds) {
+  *nfds = 0;
+
+  struct sockaddr_un addr;
+  socklen_t addr_len;
+  if (!make_addr(path, &addr, &addr_len))
+    return TTY_TRANSFER_BAD_OPEN;
+
+  int fd = socket(AF_UNIX, SOCKET_TYPE, 0);
+  if (fd == -1)
+    return TTY_TRANSFER_BAD_OPEN;
+
+  int ret;
+  do {
+    ret = connect(fd, (struct sockaddr *)&addr, addr_len);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret == -1) {
+    close(fd);
+    return TTY_TRANSFER_BAD_OPEN;
+  }
+
+  tty_transfer_errno err =
+      tty_transfer_handoff_redeem_fd(fd, token, fds, max_fds, nfds);
+  close(fd);
+  return err;
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/host.h"
+#include "tty_transfer/private/alloc.h"
+#include "tty_transfer/private/scan.h"
+
+#include <string.h>
+
+// \e]1337;RequestTransferIOToken=<uuid>\e\\ or terminated with BEL
+#define REQUEST_PREFIX "\e]1337;RequestTransferIOToken="
+#define PREFIX_LEN (sizeof(REQUEST_PREFIX) - 1)
+#define KEY_END (PREFIX_LEN + 36)
+
+struct tty_transfer_host_scanner_ {
+  uint64_t offset; // stream offset of the next byte
+  size_t matched;  // bytes of the current candidate request matched
+  int st_esc;      // the ESC of an ST terminator was matched
+  char key[37];
+};
+
+tty_transfer_host_scanner *tty_transfer_host_scanner_alloc() {
+  tty_transfer_host_scanner *s =
+      tty_transfer_malloc(sizeof(tty_transfer_host_scanner));
+  if (s)
+    tty_transfer_host_scanner_reset(s);
+  return s;
+}
+
+void tty_transfer_host_scanner_free(tty_transfer_host_scanner *s) {
+  tty_transfer_free(s);
+}
+
+void tty_transfer_host_scanner_reset(tty_transfer_host_scanner *s) {
+  s->offset = 0;
+  s->matched = 0;
+  s->st_esc = 0;
+}
+
+static int is_uuid_char(size_t i, char c) {
+  if (i == 8 || i == 13 || i == 18 || i == 23)
+    return c == '-';
+
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+         (c >= 'A' && c <= 'F');
+}
+
+// Match one byte of a candidate request. Returns 1 if the request ended.
+static int match_byte(tty_transfer_host_scanner *s, char c) {
+  size_t i = s->matched;
+
+  if (i < PREFIX_LEN) {
+    if (c != REQUEST_PREFIX[i])
+      goto mismatch;
+  } else if (i < KEY_END) {
+    if (!is_uuid_char(i - PREFIX_LEN, c))
+      goto mismatch;
+
+    s->key[i - PREFIX_LEN] = c;
+  } else if (s->st_esc) {
+    if (c != '\\')
+      goto mismatch;
+
+    s->matched = 0;
+    s->st_esc = 0;
+    return 1;
+  } else if (c == '\a') {
+    s->matched = 0;
+    return 1;
+  } else if (c == '\e') {
+    s->st_esc = 1;
+  } else {
+    goto mismatch;
+  }
+
+  ++s->matched;
+  return 0;
+
+mismatch:
+  s->matched = 0;
+  s->st_esc = 0;
+
+  // The mismatched byte may begin the next request
+  if (c == '\e')
+    s->matched = 1;
+
+  return 0;
+}
+
+size_t tty_transfer_host_scanner_feed(tty_transfer_host_scanner *s,
+                                      const void *bytes, size_t nbytes,
+                                      tty_transfer_host_request *reqs,
+                                      size_t max_reqs, size_t *nreqs) {
+  const char *buf = bytes;
+  size_t i = 0;
+  size_t n = 0;
+
+  while (i < nbytes && n < max_reqs) {
+    if (!s->matched) {
+      i += tty_transfer_scan_byte(&buf[i], nbytes - i, '\e');
+      if (i == nbytes)
+        break;
+
+      s->matched = 1;
+      ++i;
+      continue;
+    }
+
+    size_t len = s->matched;
+    if (match_byte(s, buf[i++])) {
+      tty_transfer_host_request *req = &reqs[n++];
+      req->end = s->offset + i;
+      req->start = req->end - (len + 1);
+      memcpy(req->key, s->key, 36);
+      req->key[36] = '\0';
+    }
+  }
+
+  s->offset += i;
+  *nreqs = n;
+  return i;
+}
+
+uint64_t
+tty_transfer_host_scanner_safe_offset(const tty_transfer_host_scanner *s) {
+  return s->offset - s->matched;
+}
+
+size_t tty_transfer_host_format_reply(const char *key, const char *token,
+                                      char *buf, size_t buf_size) {
+  static const char prefix[] = "\e]1337;IOToken=";
+  size_t prefix_len = sizeof(prefix) - 1;
+  size_t key_len = strlen(key);
+  size_t token_len = strlen(token);
+
+  size_t len = prefix_len + key_len + 1 + token_len + 2;
+  if (len + 1 > buf_size)
+    return 0;
+
+  char *it = buf;
+  memcpy(it, prefix, prefix_len);
+  it += prefix_len;
+  memcpy(it, key, key_len);
+  it += key_len;
+  *it++ = ';';
+  memcpy(it, token, token_len);
+  it += token_len;
+  memcpy(it, "\e\\", 3);
+  return len;
+}
@@ -0,0 +1,291 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/parser_pool.h"
+#include "tty_transfer/private/alloc.h"
+#include "tty_transfer/private/osc.h"
+#include "tty_transfer/private/scan.h"
+#include "tty_transfer/private/vtparse.h"
+
+#include <string.h>
+
+// Matchers allocated the first time any stream starts an OSC string
+#define MIN_MATCHERS 16
+
+// Per-stream state is kept in parallel arrays so that feeding a batch only
+// touches a few bytes of each stream. Only streams in an OSC string that may
+// still match hold a matcher, which is returned as soon as it rejects.
+struct tty_transfer_parser_pool_ {
+  size_t nstreams;
+  unsigned char *states; // enum tty_transfer_vt_state of each stream
+  uint32_t *slots;       // index into matchers + 1 of each stream, or 0
+  tty_transfer_osc_matcher *matchers;
+  uint32_t *free_slots; // stack of unused indices into matchers
+  size_t nmatchers;
+  size_t nfree;
+};
+
+struct feed_out {
+  tty_transfer_parser_pool_event *events;
+  size_t max_events;
+  size_t nevents;
+  int bad_alloc;
+};
+
+tty_transfer_parser_pool *tty_transfer_parser_pool_alloc(size_t nstreams) {
+  if (nstreams > UINT32_MAX)
+    return NULL;
+
+  tty_transfer_parser_pool *p =
+      tty_transfer_calloc(1, sizeof(tty_transfer_parser_pool));
+  if (!p)
+    return NULL;
+
+  p->nstreams = nstreams;
+  p->states = tty_transfer_calloc(nstreams ? nstreams : 1, 1);
+  p->slots = tty_transfer_calloc(nstreams ? nstreams : 1, sizeof(uint32_t));
+  if (!(p->states && p->slots)) {
+    tty_transfer_parser_pool_free(p);
+    return NULL;
+  }
+
+  // vt_ground is 0, so every stream starts outside any sequence
+  return p;
+}
+
+void tty_transfer_parser_pool_free(tty_transfer_parser_pool *p) {
+  if (!p)
+    return;
+
+  tty_transfer_free(p->states);
+  tty_transfer_free(p->slots);
+  tty_transfer_free(p->matchers);
+  tty_transfer_free(p->free_slots);
+  tty_transfer_free(p);
+}
+
+static void release_slot(tty_transfer_parser_pool *p, uint32_t *slot) {
+  if (!*slot)
+    return;
+
+  p->free_slots[p->nfree++] = *slot - 1;
+  *slot = 0;
+}
+
+void tty_transfer_parser_pool_reset(tty_transfer_parser_pool *p,
+                                    uint32_t stream) {
+  if (stream >= p->nstreams)
+    return;
+
+  p->states[stream] = vt_ground;
+  release_slot(p, &p->slots[stream]);
+}
+
+// A stream holds at most one matcher, so there are never more than
+// nstreams of them
+static int grow_matchers(tty_transfer_parser_pool *p) {
+  size_t cap = p->nmatchers ? 2 * p->nmatchers : MIN_MATCHERS;
+  if (cap > p->nstreams)
+    cap = p->nstreams;
+
+  tty_transfer_osc_matcher *matchers =
+      tty_transfer_malloc(cap * sizeof(tty_transfer_osc_matcher));
+  uint32_t *free_slots = tty_transfer_malloc(cap * sizeof(uint32_t));
+  if (!(matchers && free_slots)) {
+    tty_transfer_free(matchers);
+    tty_transfer_free(free_slots);
+    return 0;
+  }
+
+  if (p->nmatchers)
+    memcpy(matchers, p->matchers,
+           p->nmatchers * sizeof(tty_transfer_osc_matcher));
+
+  // Only called when every matcher is in use
+  p->nfree = 0;
+  for (size_t i = cap; i > p->nmatchers; --i)
+    free_slots[p->nfree++] = (uint32_t)(i - 1);
+
+  tty_transfer_free(p->matchers);
+  tty_transfer_free(p->free_slots);
+  p->matchers = matchers;
+  p->free_slots = free_slots;
+  p->nmatchers = cap;
+  return 1;
+}
+
+static int acquire_slot(tty_transfer_parser_pool *p, uint32_t *slot) {
+  if (!*slot) {
+    if (!p->nfree && !grow_matchers(p))
+      return 0;
+
+    *slot = p->free_slots[--p->nfree] + 1;
+  }
+
+  tty_transfer_osc_matcher_reset(&p->matchers[*slot - 1]);
+  return 1;
+}
+
+static void put_osc(tty_transfer_parser_pool *p, uint32_t *slot,
+                    const char *s, size_t n) {
+  if (*slot && !tty_transfer_osc_matcher_put(&p->matchers[*slot - 1], s, n))
+    release_slot(p, slot);
+}
+
+static tty_transfer_parser_pool_event *
+push_event(struct feed_out *out, tty_transfer_parser_pool_event_type type,
+           uint32_t stream, size_t input, size_t end) {
+  tty_transfer_parser_pool_event *e = &out->events[out->nevents++];
+  memset(e, 0, sizeof(*e));
+  e->type = type;
+  e->stream = stream;
+  e->input = input;
+  e->end = end;
+  return e;
+}
+
+// Returns 1 if an event was stored
+static int dispatch_osc(tty_transfer_parser_pool *p, uint32_t slot,
+                        uint32_t stream, size_t input, size_t end,
+                        struct feed_out *out) {
+  if (!slot)
+    return 0;
+
+  const tty_transfer_osc_matcher *m = &p->matchers[slot - 1];
+  tty_transfer_parser_pool_event *e;
+
+  switch (tty_transfer_osc_matcher_finish(m)) {
+  case TTY_TRANSFER_OSC_IO_TOKEN:
+    e = push_event(out, TTY_TRANSFER_PARSER_POOL_TOKEN, stream, input, end);
+    e->key = m->key_bin;
+    e->val = m->val_bin;
+    return 1;
+  case TTY_TRANSFER_OSC_REQUEST:
+    e = push_event(out, TTY_TRANSFER_PARSER_POOL_REQUEST, stream, input, end);
+    e->key = m->key_bin;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// Process the byte at offset off of an input. Returns 1 if an event was
+// stored.
+static int step(tty_transfer_parser_pool *p, unsigned char *state,
+                uint32_t *slot, unsigned char c, uint32_t stream,
+                size_t input, size_t off, struct feed_out *out) {
+  unsigned char t =
+      tty_transfer_vt_transitions[*state][tty_transfer_vt_classes[c]];
+  *state = TTY_TRANSFER_VT_STATE(t);
+
+  int stored = 0;
+  switch (TTY_TRANSFER_VT_ACTION(t)) {
+  case vt_osc_start:
+    if (!acquire_slot(p, slot))
+      out->bad_alloc = 1;
+    break;
+  case vt_osc_put:
+    put_osc(p, slot, (const char *)&c, 1);
+    break;
+  case vt_osc_end:
+    stored = dispatch_osc(p, *slot, stream, input, off + 1, out);
+    break;
+  case vt_cpr:
+    push_event(out, TTY_TRANSFER_PARSER_POOL_CPR, stream, input, off + 1);
+    stored = 1;
+    break;
+  default:
+    break;
+  }
+
+  // Ended or abandoned OSC strings return their matcher
+  if (*slot && *state != vt_osc_string && *state != vt_osc_esc)
+    release_slot(p, slot);
+
+  return stored;
+}
+
+// Returns 1 if events filled up before the end of the input
+static int feed_input(tty_transfer_parser_pool *p,
+                      const tty_transfer_parser_pool_input *in, size_t input,
+                      struct feed_out *out) {
+  const char *buf = in->bytes;
+  size_t end = in->nbytes;
+  unsigned char state = p->states[in->stream];
+  uint32_t slot = p->slots[in->stream];
+  int full = 0;
+
+  // Same bulk skips as tty_transfer_parser_feed
+  size_t i = 0;
+  while (i < end) {
+    const char *it = &buf[i];
+    size_t n = end - i;
+
+    switch (state) {
+    case vt_ground:
+      i += tty_transfer_scan_byte(it, n, '\e');
+      break;
+    case vt_osc_string: {
+      size_t len = tty_transfer_scan_range(it, n, 0x00, 0x1f);
+      put_osc(p, &slot, it, len);
+      i += len;
+      break;
+    }
+    case vt_csi_param:
+      i += tty_transfer_scan_csi_params(it, n);
+      break;
+    case vt_dcs_passthrough:
+    case vt_dcs_ignore:
+    case vt_sos_pm_apc_string:
+      i += tty_transfer_scan_range(it, n, 0x18, 0x1b);
+      break;
+    default:
+      break;
+    }
+
+    if (i == end)
+      break;
+
+    int stored = step(p, &state, &slot, (unsigned char)buf[i], in->stream,
+                      input, i, out);
+    ++i;
+
+    if (stored && out->nevents == out->max_events) {
+      full = 1;
+      break;
+    }
+  }
+
+  p->states[in->stream] = state;
+  p->slots[in->stream] = slot;
+  return full;
+}
+
+tty_transfer_errno tty_transfer_parser_pool_feed(
+    tty_transfer_parser_pool *p, const tty_transfer_parser_pool_input *inputs,
+    size_t ninputs, tty_transfer_parser_pool_event *events, size_t max_events,
+    size_t *nevents) {
+  *nevents = 0;
+  if (!max_events)
+    return TTY_TRANSFER_FULL;
+
+  struct feed_out out = {events, max_events, 0, 0};
+  int full = 0;
+
+  for (size_t k = 0; k < ninputs && !full; ++k) {
+    if (inputs[k].stream < p->nstreams)
+      full = feed_input(p, &inputs[k], k, &out);
+  }
+
+  *nevents = out.nevents;
+
+  if (full)
+    return TTY_TRANSFER_FULL;
+
+  return out.bad_alloc ? TTY_TRANSFER_BAD_ALLOC : TTY_TRANSFER_OK;
+}
@@ -0,0 +1,330 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable pthread_rwlock_t
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tty_transfer/registry.h"
+#include "tty_transfer/private/alloc.h"
+#include "tty_transfer/private/clock.h"
+#include "tty_transfer/private/timer_wheel.h"
+#include "tty_transfer/private/uuid.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define NIL UINT32_MAX
+
+// Shards are only used when each can hold at least this many tokens
+#define MIN_SHARD_CAPACITY 64
+#define MAX_SHARDS 64
+
+// Expiry is tracked with 16ms resolution over a ~16s wheel
+#define WHEEL_SLOTS 1024
+#define WHEEL_TICK_NS 16000000
+
+struct tty_transfer_registry_entry_ {
+  tty_transfer_uuid key;
+  uint64_t value;
+  int64_t expires_ns;
+  uint32_t next; // next entry in the bucket, or in the free list
+};
+
+struct tty_transfer_registry_shard_ {
+  pthread_rwlock_t lock;
+  size_t capacity;
+  size_t nbuckets;
+  uint32_t *buckets;
+  uint32_t free_head;
+  struct tty_transfer_registry_entry_ *entries;
+  tty_transfer_timer_wheel *wheel;
+};
+
+struct tty_transfer_registry_ {
+  size_t capacity;
+  size_t nshards;
+  atomic_size_t size;
+  struct tty_transfer_registry_shard_ *shards;
+};
+
+// Tokens are usually random, but mix both halves in case they are not
+static uint64_t hash_uuid(const tty_transfer_uuid *uuid) {
+  uint64_t a, b;
+  memcpy(&a, &uuid->bytes[0], sizeof(a));
+  memcpy(&b, &uuid->bytes[8], sizeof(b));
+
+  uint64_t h = (a ^ (b * 0x9e3779b97f4a7c15ull)) * 0xff51afd7ed558ccdull;
+  return h ^ (h >> 32);
+}
+
+static size_t next_pow2(size_t n) {
+  size_t p = 1;
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+static size_t isqrt(size_t n) {
+  size_t r = 0;
+  while ((r + 1) * (r + 1) <= n)
+    ++r;
+  return r;
+}
+
+static int shard_init(struct tty_transfer_registry_shard_ *s, size_t capacity,
+                      int64_t now_ns) {
+  s->capacity = capacity;
+  s->nbuckets = next_pow2(capacity);
+  s->buckets = tty_transfer_malloc(s->nbuckets * sizeof(uint32_t));
+  s->entries = tty_transfer_malloc(capacity *
+                                   sizeof(struct tty_transfer_registry_entry_));
+  s->wheel = tty_transfer_timer_wheel_alloc(capacity, WHEEL_SLOTS,
+                                            WHEEL_TICK_NS, now_ns);
+
+  if (!(s->buckets && s->entries && s->wheel))
+    return 0;
+
+  for (size_t i = 0; i < s->nbuckets; ++i)
+    s->buckets[i] = NIL;
+
+  for (size_t i = 0; i < capacity; ++i)
+    s->entries[i].next = i + 1 < capacity ? i + 1 : NIL;
+
+  s->free_head = 0;
+  return pthread_rwlock_init(&s->lock, NULL) == 0;
+}
+
+static void shard_destroy(struct tty_transfer_registry_shard_ *s) {
+  tty_transfer_free(s->buckets);
+  tty_transfer_free(s->entries);
+  tty_transfer_timer_wheel_free(s->wheel);
+}
+
+tty_transfer_registry *tty_transfer_registry_alloc(size_t capacity) {
+  if (!capacity || capacity >= NIL)
+    return NULL;
+
+  size_t nshards = 1;
+  while (nshards < MAX_SHARDS && capacity / (2 * nshards) >= MIN_SHARD_CAPACITY)
+    nshards *= 2;
+
+  tty_transfer_registry *r = tty_transfer_malloc(sizeof(tty_transfer_registry));
+  if (!r)
+    return NULL;
+
+  r->capacity = capacity;
+  r->nshards = 0;
+  atomic_init(&r->size, 0);
+  r->shards =
+      tty_transfer_calloc(nshards, sizeof(struct tty_transfer_registry_shard_));
+  if (!r->shards) {
+    tty_transfer_free(r);
+    return NULL;
+  }
+
+  // Random tokens do not spread perfectly evenly, so give each shard slack
+  // of several standard deviations. The size counter still enforces the
+  // total capacity.
+  size_t shard_capacity = (capacity + nshards - 1) / nshards;
+  if (nshards > 1)
+    shard_capacity += 4 * isqrt(shard_capacity) + 8;
+
+  int64_t now_ns = tty_transfer_monotonic_ns();
+  for (size_t i = 0; i < nshards; ++i) {
+    int ok = shard_init(&r->shards[i], shard_capacity, now_ns);
+    if (!ok) {
+      shard_destroy(&r->shards[i]);
+      tty_transfer_registry_free(r);
+      return NULL;
+    }
+
+    ++r->nshards;
+  }
+
+  return r;
+}
+
+void tty_transfer_registry_free(tty_transfer_registry *r) {
+  if (!r)
+    return;
+
+  for (size_t i = 0; i < r->nshards; ++i) {
+    pthread_rwlock_destroy(&r->shards[i].lock);
+    shard_destroy(&r->shards[i]);
+  }
+
+  tty_transfer_free(r->shards);
+  tty_transfer_free(r);
+}
+
+static struct tty_transfer_registry_shard_ *
+shard_for(tty_transfer_registry *r, uint64_t hash) {
+  return &r->shards[(hash >> 48) & (r->nshards - 1)];
+}
+
+static uint32_t *find_link(struct tty_transfer_registry_shard_ *s,
+                           uint64_t hash, const tty_transfer_uuid *key) {
+  uint32_t *link = &s->buckets[hash & (s->nbuckets - 1)];
+  while (*link != NIL) {
+    struct tty_transfer_registry_entry_ *e = &s->entries[*link];
+    if (memcmp(e->key.bytes, key->bytes, sizeof(key->bytes)) == 0)
+      break;
+
+    link = &e->next;
+  }
+
+  return link;
+}
+
+struct expire_ctx_ {
+  tty_transfer_registry *r;
+  struct tty_transfer_registry_shard_ *s;
+};
+
+static void release_entry(tty_transfer_registry *r,
+                          struct tty_transfer_registry_shard_ *s,
+                          uint32_t *link) {
+  uint32_t id = *link;
+  *link = s->entries[id].next;
+  s->entries[id].next = s->free_head;
+  s->free_head = id;
+  atomic_fetch_sub_explicit(&r->size, 1, memory_order_relaxed);
+}
+
+static void expire_entry(void *ctx, uint32_t id) {
+  struct expire_ctx_ *ec = ctx;
+  const tty_transfer_uuid *key = &ec->s->entries[id].key;
+
+  uint32_t *link = find_link(ec->s, hash_uuid(key), key);
+  if (*link == id)
+    release_entry(ec->r, ec->s, link);
+}
+
+// Must hold the shard's write lock
+static size_t shard_expire(tty_transfer_registry *r,
+                           struct tty_transfer_registry_shard_ *s,
+                           int64_t now_ns) {
+  struct expire_ctx_ ctx = {r, s};
+  return tty_transfer_timer_wheel_advance(s->wheel, now_ns, expire_entry, &ctx);
+}
+
+tty_transfer_errno tty_transfer_registry_insert(tty_transfer_registry *r,
+                                                const tty_transfer_uuid *token,
+                                                uint64_t value, int ttl_ms) {
+  uint64_t hash = hash_uuid(token);
+  struct tty_transfer_registry_shard_ *s = shard_for(r, hash);
+  int64_t now_ns = tty_transfer_monotonic_ns();
+  tty_transfer_errno ret = TTY_TRANSFER_OK;
+
+  pthread_rwlock_wrlock(&s->lock);
+  shard_expire(r, s, now_ns);
+
+  uint32_t *link = find_link(s, hash, token);
+  uint32_t id = *link;
+  if (id == NIL) {
+    size_t size = atomic_fetch_add_explicit(&r->size, 1, memory_order_relaxed);
+    if (size >= r->capacity || s->free_head == NIL) {
+      atomic_fetch_sub_explicit(&r->size, 1, memory_order_relaxed);
+      ret = TTY_TRANSFER_FULL;
+      goto unlock;
+    }
+
+    id = s->free_head;
+    s->free_head = s->entries[id].next;
+    s->entries[id].key = *token;
+    s->entries[id].next = NIL;
+    *link = id;
+  }
+
+  struct tty_transfer_registry_entry_ *e = &s->entries[id];
+  e->value = value;
+  e->expires_ns = now_ns + (int64_t)ttl_ms * 1000000;
+  tty_transfer_timer_wheel_schedule(s->wheel, id, e->expires_ns);
+
+unlock:
+  pthread_rwlock_unlock(&s->lock);
+  return ret;
+}
+
+tty_transfer_errno tty_transfer_registry_mint(tty_transfer_registry *r,
+                                              uint64_t value, int ttl_ms,
+                                              tty_transfer_uuid *token) {
+  if (!tty_transfer_uuid_random(token, 1))
+    return TTY_TRANSFER_NO_ENTROPY;
+
+  return tty_transfer_registry_insert(r, token, value, ttl_ms);
+}
+
+int tty_transfer_registry_lookup(tty_transfer_registry *r,
+                                 const tty_transfer_uuid *token,
+                                 uint64_t *value) {
+  uint64_t hash = hash_uuid(token);
+  struct tty_transfer_registry_shard_ *s = shard_for(r, hash);
+  int64_t now_ns = tty_transfer_monotonic_ns();
+  int found = 0;
+
+  pthread_rwlock_rdlock(&s->lock);
+
+  uint32_t id = *find_link(s, hash, token);
+  if (id != NIL && s->entries[id].expires_ns > now_ns) {
+    found = 1;
+    if (value)
+      *value = s->entries[id].value;
+  }
+
+  pthread_rwlock_unlock(&s->lock);
+  return found;
+}
+
+int tty_transfer_registry_take(tty_transfer_registry *r,
+                               const tty_transfer_uuid *token,
+                               uint64_t *value) {
+  uint64_t hash = hash_uuid(token);
+  struct tty_transfer_registry_shard_ *s = shard_for(r, hash);
+  int64_t now_ns = tty_transfer_monotonic_ns();
+  int found = 0;
+
+  pthread_rwlock_wrlock(&s->lock);
+
+  uint32_t *link = find_link(s, hash, token);
+  uint32_t id = *link;
+  if (id != NIL) {
+    if (s->entries[id].expires_ns > now_ns) {
+      found = 1;
+      if (value)
+        *value = s->entries[id].value;
+    }
+
+    tty_transfer_timer_wheel_cancel(s->wheel, id);
+    release_entry(r, s, link);
+  }
+
+  pthread_rwlock_unlock(&s->lock);
+  return found;
+}
+
+size_t tty_transfer_registry_expire(tty_transfer_registry *r) {
+  int64_t now_ns = tty_transfer_monotonic_ns();
+  size_t n = 0;
+
+  for (size_t i = 0; i < r->nshards; ++i) {
+    struct tty_transfer_registry_shard_ *s = &r->shards[i];
+    pthread_rwlock_wrlock(&s->lock);
+    n += shard_expire(r, s, now_ns);
+    pthread_rwlock_unlock(&s->lock);
+  }
+
+  return n;
+}
+
+size_t tty_transfer_registry_size(tty_transfer_registry *r) {
+  return atomic_load_explicit(&r->size, memory_order_relaxed);
+}
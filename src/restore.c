@@ -0,0 +1,102 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable sigaction
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tty_transfer/private/restore.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+enum slot_state { slot_free, slot_filling, slot_active };
+
+struct tty_transfer_restore_slot_ {
+  atomic_int state;
+  int fd;
+  struct termios tattr;
+};
+
+static struct tty_transfer_restore_slot_ slots[TTY_TRANSFER_RESTORE_MAX];
+
+// Signals whose default action terminates the process
+static const int term_signals[] = {SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGABRT};
+
+static pthread_once_t install_once = PTHREAD_ONCE_INIT;
+
+// Only async-signal-safe calls are allowed here
+static void restore_all(void) {
+  for (int i = 0; i < TTY_TRANSFER_RESTORE_MAX; ++i) {
+    struct tty_transfer_restore_slot_ *s = &slots[i];
+    if (atomic_load_explicit(&s->state, memory_order_acquire) == slot_active)
+      tcsetattr(s->fd, TCSANOW, &s->tattr);
+  }
+}
+
+static void on_term_signal(int sig) {
+  int saved_errno = errno;
+  restore_all();
+
+  // The signal is blocked until this returns, then the default action runs
+  struct sigaction dfl;
+  dfl.sa_handler = SIG_DFL;
+  dfl.sa_flags = 0;
+  sigemptyset(&dfl.sa_mask);
+  sigaction(sig, &dfl, NULL);
+  raise(sig);
+
+  errno = saved_errno;
+}
+
+static void install_handlers(void) {
+  atexit(restore_all);
+
+  struct sigaction sa;
+  sa.sa_handler = on_term_signal;
+  sa.sa_flags = 0;
+  sigemptyset(&sa.sa_mask);
+
+  size_t n = sizeof(term_signals) / sizeof(term_signals[0]);
+  for (size_t i = 0; i < n; ++i) {
+    // Leave handlers and ignored signals set by the application alone
+    struct sigaction prev;
+    if (sigaction(term_signals[i], NULL, &prev) == 0 &&
+        !(prev.sa_flags & SA_SIGINFO) && prev.sa_handler == SIG_DFL)
+      sigaction(term_signals[i], &sa, NULL);
+  }
+}
+
+int tty_transfer_restore_register(int fd, const struct termios *tattr) {
+  pthread_once(&install_once, install_handlers);
+
+  for (int i = 0; i < TTY_TRANSFER_RESTORE_MAX; ++i) {
+    struct tty_transfer_restore_slot_ *s = &slots[i];
+
+    int expected = slot_free;
+    if (atomic_compare_exchange_strong(&s->state, &expected, slot_filling)) {
+      s->fd = fd;
+      s->tattr = *tattr;
+      atomic_store_explicit(&s->state, slot_active, memory_order_release);
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void tty_transfer_restore_unregister(int reg) {
+  if (reg < 0 || reg >= TTY_TRANSFER_RESTORE_MAX)
+    return;
+
+  atomic_store_explicit(&slots[reg].state, slot_free, memory_order_release);
+}
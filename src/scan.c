@@ -0,0 +1,139 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/private/scan.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TTY_TRANSFER_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static size_t scan_range_scalar(const unsigned char *buf, size_t n,
+                                unsigned char lo, unsigned char span) {
+  for (size_t i = 0; i < n; ++i) {
+    if ((unsigned char)(buf[i] - lo) <= span)
+      return i;
+  }
+
+  return n;
+}
+
+#ifdef TTY_TRANSFER_SCAN_X86
+
+// SSE2 is part of the x86_64 baseline, so only AVX2 needs a runtime check
+
+static size_t scan_byte_sse2(const unsigned char *buf, size_t n,
+                             unsigned char c) {
+  const __m128i needle = _mm_set1_epi8((char)c);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  const void *hit = memchr(buf + i, c, n - i);
+  return hit ? (size_t)((const unsigned char *)hit - buf) : n;
+}
+
+static size_t scan_range_sse2(const unsigned char *buf, size_t n,
+                              unsigned char lo, unsigned char span) {
+  // (b - lo) <= span as unsigned bytes is equivalent to min(b - lo, span) ==
+  // (b - lo)
+  const __m128i vlo = _mm_set1_epi8((char)lo);
+  const __m128i vspan = _mm_set1_epi8((char)span);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i d = _mm_sub_epi8(v, vlo);
+    __m128i in = _mm_cmpeq_epi8(_mm_min_epu8(d, vspan), d);
+    int mask = _mm_movemask_epi8(in);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  return i + scan_range_scalar(buf + i, n - i, lo, span);
+}
+
+__attribute__((target("avx2"))) static size_t
+scan_byte_avx2(const unsigned char *buf, size_t n, unsigned char c) {
+  const __m256i needle = _mm256_set1_epi8((char)c);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i eq = _mm256_cmpeq_epi8(v, needle);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(eq);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  return i + scan_byte_sse2(buf + i, n - i, c);
+}
+
+__attribute__((target("avx2"))) static size_t
+scan_range_avx2(const unsigned char *buf, size_t n, unsigned char lo,
+                unsigned char span) {
+  const __m256i vlo = _mm256_set1_epi8((char)lo);
+  const __m256i vspan = _mm256_set1_epi8((char)span);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i d = _mm256_sub_epi8(v, vlo);
+    __m256i in = _mm256_cmpeq_epi8(_mm256_min_epu8(d, vspan), d);
+    unsigned mask = (unsigned)_mm256_movemask_epi8(in);
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+
+  return i + scan_range_sse2(buf + i, n - i, lo, span);
+}
+
+static int have_avx2() { return __builtin_cpu_supports("avx2"); }
+
+#endif
+
+size_t tty_transfer_scan_byte(const char *buf, size_t n, unsigned char c) {
+  const unsigned char *ubuf = (const unsigned char *)buf;
+
+#ifdef TTY_TRANSFER_SCAN_X86
+  if (n >= 32 && have_avx2())
+    return scan_byte_avx2(ubuf, n, c);
+
+  return scan_byte_sse2(ubuf, n, c);
+#else
+  // libc memchr is already vectorized on the remaining platforms
+  const void *hit = memchr(ubuf, c, n);
+  return hit ? (size_t)((const unsigned char *)hit - ubuf) : n;
+#endif
+}
+
+size_t tty_transfer_scan_range(const char *buf, size_t n, unsigned char lo,
+                               unsigned char hi) {
+  const unsigned char *ubuf = (const unsigned char *)buf;
+  unsigned char span = hi - lo;
+
+#ifdef TTY_TRANSFER_SCAN_X86
+  if (n >= 32 && have_avx2())
+    return scan_range_avx2(ubuf, n, lo, span);
+
+  return scan_range_sse2(ubuf, n, lo, span);
+#else
+  return scan_range_scalar(ubuf, n, lo, span);
+#endif
+}
+
+size_t tty_transfer_scan_csi_params(const char *buf, size_t n) {
+  size_t i = 0;
+  while (i < n && (unsigned char)(buf[i] - '0') <= ';' - '0')
+    ++i;
+
+  return i;
+}
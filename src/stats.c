@@ -0,0 +1,86 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/private/stats.h"
+
+#include <stdatomic.h>
+
+#define NBUCKETS TTY_TRANSFER_STATS_BUCKETS
+
+static struct {
+  atomic_uint_fast64_t nrequests;
+  atomic_uint_fast64_t nok;
+  atomic_uint_fast64_t ntimeouts;
+  atomic_uint_fast64_t nreads;
+  atomic_uint_fast64_t nbytes;
+  atomic_uint_fast64_t nosc;
+  atomic_uint_fast64_t ncsi;
+  atomic_uint_fast64_t nsyscalls;
+  atomic_uint_fast64_t termios_ns;
+  atomic_uint_fast64_t total_us_log2[NBUCKETS];
+  atomic_uint_fast64_t first_read_us_log2[NBUCKETS];
+} counters;
+
+static void add(atomic_uint_fast64_t *counter, uint64_t n) {
+  atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+static uint64_t load(atomic_uint_fast64_t *counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static int bucket_for_ns(int64_t ns) {
+  uint64_t us = ns > 0 ? (uint64_t)ns / 1000 : 0;
+
+  int b = 0;
+  while (us > 1 && b < NBUCKETS - 1) {
+    us >>= 1;
+    ++b;
+  }
+
+  return b;
+}
+
+void tty_transfer_stats_record(const tty_transfer_request_stats *stats,
+                               tty_transfer_errno result) {
+  add(&counters.nrequests, 1);
+
+  if (result == TTY_TRANSFER_OK) {
+    add(&counters.nok, 1);
+  } else if (result == TTY_TRANSFER_TIMEOUT) {
+    add(&counters.ntimeouts, 1);
+  }
+
+  add(&counters.nreads, stats->nreads);
+  add(&counters.nbytes, stats->nbytes);
+  add(&counters.nosc, stats->nosc);
+  add(&counters.ncsi, stats->ncsi);
+  add(&counters.nsyscalls, stats->nsyscalls);
+  add(&counters.termios_ns, stats->termios_ns);
+  add(&counters.total_us_log2[bucket_for_ns(stats->total_ns)], 1);
+
+  if (stats->first_read_ns)
+    add(&counters.first_read_us_log2[bucket_for_ns(stats->first_read_ns)], 1);
+}
+
+void tty_transfer_stats_snapshot(tty_transfer_stats *stats) {
+  stats->nrequests = load(&counters.nrequests);
+  stats->nok = load(&counters.nok);
+  stats->ntimeouts = load(&counters.ntimeouts);
+  stats->nreads = load(&counters.nreads);
+  stats->nbytes = load(&counters.nbytes);
+  stats->nosc = load(&counters.nosc);
+  stats->ncsi = load(&counters.ncsi);
+  stats->nsyscalls = load(&counters.nsyscalls);
+  stats->termios_ns = load(&counters.termios_ns);
+
+  for (int i = 0; i < NBUCKETS; ++i) {
+    stats->total_us_log2[i] = load(&counters.total_us_log2[i]);
+    stats->first_read_us_log2[i] = load(&counters.first_read_us_log2[i]);
+  }
+}
@@ -0,0 +1,191 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/private/timer_wheel.h"
+#include "tty_transfer/private/alloc.h"
+
+#define NIL UINT32_MAX
+
+struct tty_transfer_timer_ {
+  int64_t deadline_ns;
+  uint32_t prev;
+  uint32_t next;
+  uint32_t slot;
+  int pending;
+};
+
+struct tty_transfer_timer_wheel_ {
+  size_t capacity;
+  size_t nslots;
+  int64_t tick_ns;
+  int64_t cur_tick; // every tick before this one has been processed
+  size_t npending;
+  uint32_t *slots;
+  struct tty_transfer_timer_ *timers;
+};
+
+tty_transfer_timer_wheel *tty_transfer_timer_wheel_alloc(size_t capacity,
+                                                         size_t nslots,
+                                                         int64_t tick_ns,
+                                                         int64_t now_ns) {
+  tty_transfer_timer_wheel *w =
+      tty_transfer_malloc(sizeof(tty_transfer_timer_wheel));
+  if (!w)
+    return NULL;
+
+  w->capacity = capacity;
+  w->nslots = nslots;
+  w->tick_ns = tick_ns;
+  w->cur_tick = now_ns / tick_ns;
+  w->npending = 0;
+  w->slots = tty_transfer_malloc(nslots * sizeof(uint32_t));
+  w->timers = tty_transfer_calloc(capacity ? capacity : 1,
+                                  sizeof(struct tty_transfer_timer_));
+
+  if (!(w->slots && w->timers)) {
+    tty_transfer_timer_wheel_free(w);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < nslots; ++i)
+    w->slots[i] = NIL;
+
+  return w;
+}
+
+void tty_transfer_timer_wheel_free(tty_transfer_timer_wheel *w) {
+  if (!w)
+    return;
+
+  tty_transfer_free(w->slots);
+  tty_transfer_free(w->timers);
+  tty_transfer_free(w);
+}
+
+static size_t slot_for_tick(const tty_transfer_timer_wheel *w, int64_t tick) {
+  return (size_t)tick & (w->nslots - 1);
+}
+
+static void unlink_timer(tty_transfer_timer_wheel *w, uint32_t id) {
+  struct tty_transfer_timer_ *t = &w->timers[id];
+
+  if (t->prev == NIL) {
+    w->slots[t->slot] = t->next;
+  } else {
+    w->timers[t->prev].next = t->next;
+  }
+
+  if (t->next != NIL)
+    w->timers[t->next].prev = t->prev;
+
+  t->pending = 0;
+  --w->npending;
+}
+
+void tty_transfer_timer_wheel_cancel(tty_transfer_timer_wheel *w,
+                                     uint32_t id) {
+  if (id < w->capacity && w->timers[id].pending)
+    unlink_timer(w, id);
+}
+
+void tty_transfer_timer_wheel_schedule(tty_transfer_timer_wheel *w,
+                                       uint32_t id, int64_t deadline_ns) {
+  if (id >= w->capacity)
+    return;
+
+  tty_transfer_timer_wheel_cancel(w, id);
+
+  // Past deadlines go in the slot processed next
+  int64_t tick = deadline_ns / w->tick_ns;
+  if (tick < w->cur_tick) {
+    tick = w->cur_tick;
+    deadline_ns = tick * w->tick_ns;
+  }
+
+  size_t slot = slot_for_tick(w, tick);
+
+  struct tty_transfer_timer_ *t = &w->timers[id];
+  t->deadline_ns = deadline_ns;
+  t->prev = NIL;
+  t->next = w->slots[slot];
+  t->slot = slot;
+  t->pending = 1;
+
+  if (t->next != NIL)
+    w->timers[t->next].prev = id;
+
+  w->slots[slot] = id;
+  ++w->npending;
+}
+
+size_t tty_transfer_timer_wheel_advance(tty_transfer_timer_wheel *w,
+                                        int64_t now_ns,
+                                        tty_transfer_timer_fn fn, void *ctx) {
+  int64_t now_tick = now_ns / w->tick_ns;
+  if (now_tick < w->cur_tick)
+    return 0;
+
+  // Visiting each slot once is enough to see every timer
+  int64_t nticks = now_tick - w->cur_tick + 1;
+  if (nticks > (int64_t)w->nslots)
+    nticks = w->nslots;
+
+  size_t nexpired = 0;
+  for (int64_t tick = w->cur_tick; tick < w->cur_tick + nticks; ++tick) {
+    uint32_t id = w->slots[slot_for_tick(w, tick)];
+    while (id != NIL) {
+      uint32_t next = w->timers[id].next;
+      if (w->timers[id].deadline_ns <= now_ns) {
+        unlink_timer(w, id);
+        ++nexpired;
+        fn(ctx, id);
+      }
+
+      id = next;
+    }
+  }
+
+  // The current tick may still hold timers later in the same tick
+  w->cur_tick = now_tick;
+  return nexpired;
+}
+
+int tty_transfer_timer_wheel_next(const tty_transfer_timer_wheel *w,
+                                  int64_t *deadline_ns) {
+  if (!w->npending)
+    return 0;
+
+  for (int64_t tick = w->cur_tick; tick < w->cur_tick + (int64_t)w->nslots;
+       ++tick) {
+    int found = 0;
+    int64_t earliest = 0;
+
+    uint32_t id = w->slots[slot_for_tick(w, tick)];
+    for (; id != NIL; id = w->timers[id].next) {
+      int64_t deadline = w->timers[id].deadline_ns;
+
+      // Later rounds of the wheel share the slot
+      if (deadline / w->tick_ns > tick)
+        continue;
+
+      if (!found || deadline < earliest)
+        earliest = deadline;
+
+      found = 1;
+    }
+
+    if (found) {
+      *deadline_ns = earliest;
+      return 1;
+    }
+  }
+
+  // Only timers in later rounds remain
+  *deadline_ns = (w->cur_tick + (int64_t)w->nslots) * w->tick_ns;
+  return 1;
+}
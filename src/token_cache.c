@@ -0,0 +1,252 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable flock and ftruncate
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tty_transfer/private/token_cache.h"
+#include "tty_transfer/private/caps.h"
+#include "tty_transfer/private/clock.h"
+#include "tty_transfer/private/uuid.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Readers give up on a torn read after this many tries, like when a writer
+// died mid-update
+#define MAX_READ_TRIES 64
+
+// How often a process waiting on another's request checks for its token
+#define POLL_INTERVAL_MS 5
+
+// Layout of the shared file. A zero filled file holds no token.
+struct shared_token {
+  atomic_uint seq; // odd while a writer is updating the token
+  unsigned reserved;
+  int64_t expires_ns; // CLOCK_MONOTONIC, which is shared by every process
+  char token[40];
+};
+
+static struct shared_token *map_shared(const tty_transfer_caps_key *key,
+                                       int *fd) {
+  char path[TTY_TRANSFER_CAPS_PATH_SIZE];
+  if (!tty_transfer_caps_path(key, "tokens", path, sizeof(path), 1))
+    return NULL;
+
+  *fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (*fd == -1)
+    return NULL;
+
+  // Growing the file is idempotent, so racing creators agree
+  struct stat st;
+  if (fstat(*fd, &st) == -1 ||
+      (st.st_size < (off_t)sizeof(struct shared_token) &&
+       ftruncate(*fd, sizeof(struct shared_token)) == -1)) {
+    close(*fd);
+    return NULL;
+  }
+
+  void *addr = mmap(NULL, sizeof(struct shared_token), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, *fd, 0);
+  if (addr == MAP_FAILED) {
+    close(*fd);
+    return NULL;
+  }
+
+  return addr;
+}
+
+static void unmap_shared(struct shared_token *shared, int fd) {
+  munmap(shared, sizeof(*shared));
+  close(fd);
+}
+
+// Copy an unexpired token without locking
+static int read_token(struct shared_token *shared, char *token) {
+  for (int i = 0; i < MAX_READ_TRIES; ++i) {
+    unsigned seq = atomic_load_explicit(&shared->seq, memory_order_acquire);
+    if (seq & 1)
+      continue;
+
+    int64_t expires_ns = shared->expires_ns;
+    memcpy(token, shared->token, TTY_TRANSFER_UUID_SIZE);
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&shared->seq, memory_order_relaxed) != seq)
+      continue;
+
+    token[TTY_TRANSFER_UUID_SIZE - 1] = '\0';
+    return expires_ns > tty_transfer_monotonic_ns() && strlen(token) == 36;
+  }
+
+  return 0;
+}
+
+// Must hold the flock
+static void write_token(struct shared_token *shared, const char *token,
+                        int64_t expires_ns) {
+  // A writer that died mid-update leaves seq odd
+  unsigned seq =
+      atomic_load_explicit(&shared->seq, memory_order_relaxed) | 1;
+  atomic_store_explicit(&shared->seq, seq, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  shared->expires_ns = expires_ns;
+  memcpy(shared->token, token, TTY_TRANSFER_UUID_SIZE);
+
+  atomic_store_explicit(&shared->seq, seq + 1, memory_order_release);
+}
+
+static tty_transfer_errno copy_token(const char *token, char *token_buf,
+                                     size_t token_buf_size) {
+  strncpy(token_buf, token, token_buf_size);
+
+  if (strlen(token) >= token_buf_size) {
+    token_buf[token_buf_size - 1] = '\0';
+    return TTY_TRANSFER_TOKEN_TRUNCATED;
+  }
+
+  return TTY_TRANSFER_OK;
+}
+
+// Sleep up to timeout_ms, waking early if cancel_fd is readable
+static int wait_for_cancel(int cancel_fd, int timeout_ms) {
+  struct pollfd pfd = {cancel_fd, POLLIN, 0};
+  int ret = poll(&pfd, cancel_fd == -1 ? 0 : 1, timeout_ms);
+  return ret > 0 && pfd.revents;
+}
+
+// Take the lock once no other process is requesting a token for everyone.
+// The holder may take much longer than this request allows, or be stopped,
+// so the lock is polled until the token shows up or the request ends.
+// Returns 1 if the lock is held. Otherwise err is set to the result of the
+// request, or TTY_TRANSFER_IN_PROGRESS if the lock cannot be used.
+static int lock_shared(const tty_transfer_request_options *opts,
+                       int64_t deadline_ns, struct shared_token *shared,
+                       int lock_fd, char *token, tty_transfer_errno *err) {
+  while (flock(lock_fd, LOCK_EX | LOCK_NB) == -1) {
+    if (errno != EWOULDBLOCK && errno != EINTR) {
+      *err = TTY_TRANSFER_IN_PROGRESS;
+      return 0;
+    }
+
+    if (read_token(shared, token)) {
+      *err = TTY_TRANSFER_OK;
+      return 0;
+    }
+
+    int64_t remaining_ns = deadline_ns - tty_transfer_monotonic_ns();
+    if (remaining_ns <= 0) {
+      *err = TTY_TRANSFER_TIMEOUT;
+      return 0;
+    }
+
+    int timeout_ms = POLL_INTERVAL_MS;
+    if (remaining_ns < (int64_t)timeout_ms * 1000000)
+      timeout_ms = (int)((remaining_ns + 999999) / 1000000);
+
+    if (wait_for_cancel(opts->cancel_fd, timeout_ms)) {
+      *err = TTY_TRANSFER_CANCELED;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static tty_transfer_errno
+shared_request(const tty_transfer_request_options *opts, int ttl_ms,
+               struct shared_token *shared, int lock_fd, char *token_buf,
+               size_t token_buf_size) {
+  char token[TTY_TRANSFER_UUID_SIZE];
+  if (read_token(shared, token))
+    return copy_token(token, token_buf, token_buf_size);
+
+  // Time spent waiting for the lock counts against the request
+  tty_transfer_request_options locked = *opts;
+  int64_t deadline_ns = tty_transfer_options_deadline_ns(opts);
+  locked.deadline.tv_sec = deadline_ns / 1000000000;
+  locked.deadline.tv_nsec = deadline_ns % 1000000000;
+
+  tty_transfer_errno err;
+  if (!lock_shared(opts, deadline_ns, shared, lock_fd, token, &err)) {
+    if (err == TTY_TRANSFER_OK)
+      return copy_token(token, token_buf, token_buf_size);
+    else if (err == TTY_TRANSFER_IN_PROGRESS)
+      return tty_transfer_request_io_token_ex(&locked, token_buf,
+                                              token_buf_size);
+    return err;
+  }
+
+  // The token may have been stored while waiting for the lock
+  if (read_token(shared, token)) {
+    err = TTY_TRANSFER_OK;
+  } else {
+    err = tty_transfer_request_io_token_ex(&locked, token, sizeof(token));
+    if (err == TTY_TRANSFER_OK) {
+      int64_t expires_ns =
+          tty_transfer_monotonic_ns() + (int64_t)ttl_ms * 1000000;
+      write_token(shared, token, expires_ns);
+    }
+  }
+
+  flock(lock_fd, LOCK_UN);
+
+  if (err != TTY_TRANSFER_OK)
+    return err;
+
+  return copy_token(token, token_buf, token_buf_size);
+}
+
+tty_transfer_errno
+tty_transfer_token_cache_request(const tty_transfer_request_options *opts,
+                                 char *token_buf, size_t token_buf_size) {
+  // The cache is bypassed by the requests made on its behalf
+  tty_transfer_request_options direct = *opts;
+  direct.token_cache_ms = 0;
+
+  int owned_fd = -1;
+  if (opts->tty_path) {
+    owned_fd = open(opts->tty_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (owned_fd == -1)
+      return TTY_TRANSFER_BAD_OPEN;
+
+    direct.in_fd = direct.out_fd = owned_fd;
+    direct.tty_path = NULL;
+  }
+
+  tty_transfer_errno err;
+  tty_transfer_caps_key key;
+  struct shared_token *shared = NULL;
+  int shared_fd = -1;
+
+  if (isatty(direct.in_fd) && tty_transfer_caps_key_init(&key, direct.in_fd))
+    shared = map_shared(&key, &shared_fd);
+
+  if (shared) {
+    err = shared_request(&direct, opts->token_cache_ms, shared, shared_fd,
+                         token_buf, token_buf_size);
+    unmap_shared(shared, shared_fd);
+  } else {
+    err = tty_transfer_request_io_token_ex(&direct, token_buf, token_buf_size);
+  }
+
+  if (owned_fd != -1)
+    close(owned_fd);
+
+  return err;
+}
@@ -0,0 +1,359 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable madvise
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tty_transfer/transcript.h"
+#include "tty_transfer/private/alloc.h"
+#include "tty_transfer/private/osc.h"
+#include "tty_transfer/private/scan.h"
+#include "tty_transfer/private/vtparse.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Smaller chunks are not worth a thread
+#define MIN_CHUNK_SIZE (256 * 1024)
+#define MAX_THREADS 256
+
+struct scan_state {
+  unsigned char state; // enum tty_transfer_vt_state
+  uint64_t esc_off;    // offset of the last ESC
+  uint64_t seq_start;  // offset of the ESC beginning the OSC or CSI sequence
+  tty_transfer_osc_matcher osc;
+};
+
+struct event_vec {
+  tty_transfer_transcript_event *items;
+  size_t n;
+  size_t cap;
+  int failed;
+};
+
+struct chunk {
+  const char *buf;
+  size_t begin;
+  size_t end;
+  struct scan_state final; // state after scanning as if begin was in ground
+  struct event_vec events;
+};
+
+static void state_init(struct scan_state *st) {
+  st->state = vt_ground;
+  st->esc_off = 0;
+  st->seq_start = 0;
+  tty_transfer_osc_matcher_reset(&st->osc);
+}
+
+static int states_agree(const struct scan_state *a,
+                        const struct scan_state *b) {
+  if (a->state != b->state)
+    return 0;
+
+  if (a->state == vt_ground)
+    return 1;
+
+  // Scans that started the same sequence at the same offset have since seen
+  // the same bytes, so their OSC matchers agree too
+  return a->esc_off == b->esc_off && a->seq_start == b->seq_start;
+}
+
+static void push_event(struct event_vec *v,
+                       const tty_transfer_transcript_event *e) {
+  if (!v || v->failed)
+    return;
+
+  if (v->n == v->cap) {
+    size_t cap = v->cap ? 2 * v->cap : 64;
+    tty_transfer_transcript_event *items =
+        tty_transfer_malloc(cap * sizeof(tty_transfer_transcript_event));
+    if (!items) {
+      v->failed = 1;
+      return;
+    }
+
+    if (v->n)
+      memcpy(items, v->items, v->n * sizeof(tty_transfer_transcript_event));
+
+    tty_transfer_free(v->items);
+    v->items = items;
+    v->cap = cap;
+  }
+
+  v->items[v->n++] = *e;
+}
+
+static void dispatch_osc(struct scan_state *st, uint64_t end,
+                         struct event_vec *out) {
+  tty_transfer_transcript_event e;
+  memset(&e, 0, sizeof(e));
+  e.start = st->seq_start;
+  e.end = end;
+
+  switch (tty_transfer_osc_matcher_finish(&st->osc)) {
+  case TTY_TRANSFER_OSC_IO_TOKEN:
+    e.type = TTY_TRANSFER_TRANSCRIPT_TOKEN;
+    e.key = st->osc.key_bin;
+    e.val = st->osc.val_bin;
+    push_event(out, &e);
+    break;
+  case TTY_TRANSFER_OSC_REQUEST:
+    e.type = TTY_TRANSFER_TRANSCRIPT_REQUEST;
+    e.key = st->osc.key_bin;
+    push_event(out, &e);
+    break;
+  default:
+    break;
+  }
+}
+
+// Process the byte at offset off. Events are discarded if out is NULL.
+static void step(struct scan_state *st, unsigned char c, uint64_t off,
+                 struct event_vec *out) {
+  unsigned char cls = tty_transfer_vt_classes[c];
+  unsigned char t = tty_transfer_vt_transitions[st->state][cls];
+  st->state = TTY_TRANSFER_VT_STATE(t);
+
+  if (cls == vt_class_esc)
+    st->esc_off = off;
+
+  switch (TTY_TRANSFER_VT_ACTION(t)) {
+  case vt_osc_start:
+    st->seq_start = st->esc_off;
+    tty_transfer_osc_matcher_reset(&st->osc);
+    break;
+  case vt_osc_put:
+    tty_transfer_osc_matcher_put(&st->osc, (const char *)&c, 1);
+    break;
+  case vt_osc_end:
+    dispatch_osc(st, off + 1, out);
+    break;
+  case vt_csi_start:
+    st->seq_start = st->esc_off;
+    break;
+  case vt_cpr: {
+    tty_transfer_transcript_event e;
+    memset(&e, 0, sizeof(e));
+    e.type = TTY_TRANSFER_TRANSCRIPT_CPR;
+    e.start = st->seq_start;
+    e.end = off + 1;
+    push_event(out, &e);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// Scan buf from begin to end with the same bulk skips as
+// tty_transfer_parser_feed
+static void scan(struct scan_state *st, const char *buf, size_t begin,
+                 size_t end, struct event_vec *out) {
+  size_t i = begin;
+  while (i < end) {
+    const char *it = &buf[i];
+    size_t n = end - i;
+
+    switch (st->state) {
+    case vt_ground:
+      i += tty_transfer_scan_byte(it, n, '\e');
+      break;
+    case vt_osc_string: {
+      size_t len = tty_transfer_scan_range(it, n, 0x00, 0x1f);
+      tty_transfer_osc_matcher_put(&st->osc, it, len);
+      i += len;
+      break;
+    }
+    case vt_csi_param:
+      i += tty_transfer_scan_csi_params(it, n);
+      break;
+    case vt_dcs_passthrough:
+    case vt_dcs_ignore:
+    case vt_sos_pm_apc_string:
+      i += tty_transfer_scan_range(it, n, 0x18, 0x1b);
+      break;
+    default:
+      break;
+    }
+
+    if (i == end)
+      break;
+
+    step(st, (unsigned char)buf[i], i, out);
+    ++i;
+  }
+}
+
+static void *scan_chunk(void *arg) {
+  struct chunk *c = arg;
+  state_init(&c->final);
+  scan(&c->final, c->buf, c->begin, c->end, &c->events);
+  return NULL;
+}
+
+// Rescan the start of a chunk from the true state until it agrees with the
+// speculative scan that assumed the chunk began in ground. Returns the
+// offset where they agree, or the end of the chunk if they never do.
+static size_t resync(struct scan_state *real, const struct chunk *c,
+                     struct event_vec *out) {
+  struct scan_state spec;
+  state_init(&spec);
+
+  size_t i = c->begin;
+  while (i < c->end && !states_agree(real, &spec)) {
+    step(real, (unsigned char)c->buf[i], i, out);
+    step(&spec, (unsigned char)c->buf[i], i, NULL);
+    ++i;
+  }
+
+  return i;
+}
+
+static size_t online_cpus() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (size_t)n : 1;
+}
+
+tty_transfer_errno tty_transfer_transcript_scan(
+    const void *bytes, size_t nbytes, size_t nthreads,
+    tty_transfer_transcript_event **events, size_t *nevents) {
+  const char *buf = bytes;
+  *events = NULL;
+  *nevents = 0;
+
+  if (!nthreads)
+    nthreads = online_cpus();
+  if (nthreads > MAX_THREADS)
+    nthreads = MAX_THREADS;
+  if (nthreads > nbytes / MIN_CHUNK_SIZE)
+    nthreads = nbytes / MIN_CHUNK_SIZE ? nbytes / MIN_CHUNK_SIZE : 1;
+
+  struct chunk *chunks = tty_transfer_calloc(nthreads, sizeof(struct chunk));
+  pthread_t *threads = tty_transfer_calloc(nthreads, sizeof(pthread_t));
+  int *started = tty_transfer_calloc(nthreads, sizeof(int));
+  if (!(chunks && threads && started)) {
+    tty_transfer_free(chunks);
+    tty_transfer_free(threads);
+    tty_transfer_free(started);
+    return TTY_TRANSFER_BAD_ALLOC;
+  }
+
+  // Split at ESC bytes, where every state but an OSC string agrees
+  size_t begin = 0;
+  for (size_t k = 0; k < nthreads; ++k) {
+    size_t end = nbytes;
+    if (k + 1 < nthreads) {
+      end = (k + 1) * (nbytes / nthreads);
+      if (end < begin)
+        end = begin;
+
+      end += tty_transfer_scan_byte(&buf[end], nbytes - end, '\e');
+    }
+
+    chunks[k].buf = buf;
+    chunks[k].begin = begin;
+    chunks[k].end = end;
+    begin = end;
+  }
+
+  for (size_t k = 1; k < nthreads; ++k) {
+    started[k] =
+        pthread_create(&threads[k], NULL, scan_chunk, &chunks[k]) == 0;
+  }
+
+  scan_chunk(&chunks[0]);
+
+  for (size_t k = 1; k < nthreads; ++k) {
+    if (started[k])
+      pthread_join(threads[k], NULL);
+    else
+      scan_chunk(&chunks[k]);
+  }
+
+  // Merge in order
+  struct event_vec out = {NULL, 0, 0, 0};
+  struct scan_state real;
+  state_init(&real);
+
+  for (size_t k = 0; k < nthreads; ++k) {
+    struct chunk *c = &chunks[k];
+    size_t agreed = resync(&real, c, &out);
+
+    for (size_t i = 0; i < c->events.n; ++i) {
+      if (c->events.items[i].end > agreed)
+        push_event(&out, &c->events.items[i]);
+    }
+
+    if (agreed < c->end)
+      real = c->final;
+
+    out.failed |= c->events.failed;
+    tty_transfer_free(c->events.items);
+  }
+
+  tty_transfer_free(chunks);
+  tty_transfer_free(threads);
+  tty_transfer_free(started);
+
+  if (out.failed) {
+    tty_transfer_free(out.items);
+    return TTY_TRANSFER_BAD_ALLOC;
+  }
+
+  *events = out.items;
+  *nevents = out.n;
+  return TTY_TRANSFER_OK;
+}
+
+tty_transfer_errno tty_transfer_transcript_scan_file(
+    const char *path, size_t nthreads, tty_transfer_transcript_event **events,
+    size_t *nevents) {
+  *events = NULL;
+  *nevents = 0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return TTY_TRANSFER_BAD_OPEN;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return TTY_TRANSFER_BAD_OPEN;
+  }
+
+  size_t size = st.st_size;
+  if (!size) {
+    close(fd);
+    return TTY_TRANSFER_OK;
+  }
+
+  void *bytes = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (bytes == MAP_FAILED)
+    return TTY_TRANSFER_BAD_OPEN;
+
+  madvise(bytes, size, MADV_SEQUENTIAL);
+
+  tty_transfer_errno ret =
+      tty_transfer_transcript_scan(bytes, size, nthreads, events, nevents);
+
+  munmap(bytes, size);
+  return ret;
+}
+
+void tty_transfer_transcript_events_free(
+    tty_transfer_transcript_event *events) {
+  tty_transfer_free(events);
+}
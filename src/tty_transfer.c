@@ -12,268 +12,545 @@
 #endif
 
 #include "tty_transfer.h"
-#include <ctype.h>
+#include "tty_transfer/private/alloc.h"
+#include "tty_transfer/private/osc.h"
+#include "tty_transfer/private/scan.h"
+#include "tty_transfer/private/vtparse.h"
+
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-enum tty_sequence_type { normal, csi, osc };
+// Number of open addressing slots. Must be a power of two.
+#define TOKEN_SLOTS (2 * TTY_TRANSFER_PARSER_MAX_TOKENS)
+
+struct tty_transfer_token_entry_ {
+  tty_transfer_uuid key_bin;
+  tty_transfer_uuid val_bin;
+  char key[37];
+  char val[37];
+};
 
 struct tty_transfer_parser_ {
-  int is_esc;
-  enum tty_sequence_type seq_type;
-  char osc_str[128]; // 1337;IOToken=<uuid-key>;<uuid-val>
-  char *osc_str_back;
-  const char *key;
+  unsigned char state; // enum tty_transfer_vt_state
+  tty_transfer_osc_matcher osc;
+  char key_str[37];
+  char val_str[37];
+  const char *key; // key_str if the last OSC sequence was a token
   const char *val;
+  tty_transfer_uuid key_bin;
+  tty_transfer_uuid val_bin;
+  tty_transfer_parser_mode mode;
+  size_t nosc; // OSC sequences started since reset
+  size_t ncsi; // CSI sequences started since reset
+  size_t nreplies; // IOToken OSC sequences parsed since reset
+  size_t ntokens;
+  unsigned char token_slots[TOKEN_SLOTS]; // index into tokens + 1, 0 if empty
+  struct tty_transfer_token_entry_ tokens[TTY_TRANSFER_PARSER_MAX_TOKENS];
 };
 
-tty_transfer_parser *tty_transfer_parser_alloc() {
-  tty_transfer_parser *p = malloc(sizeof(tty_transfer_parser));
+static void tty_transfer_parser_construct(tty_transfer_parser *p) {
+  p->mode = TTY_TRANSFER_PARSER_LAST_TOKEN;
   tty_transfer_parser_reset(p);
+}
+
+tty_transfer_parser *tty_transfer_parser_alloc() {
+  tty_transfer_parser *p = tty_transfer_malloc(sizeof(tty_transfer_parser));
+  if (p)
+    tty_transfer_parser_construct(p);
   return p;
 }
 
-void tty_transfer_parser_free(tty_transfer_parser *p) { free(p); }
+void tty_transfer_parser_free(tty_transfer_parser *p) { tty_transfer_free(p); }
+
+size_t tty_transfer_parser_sizeof() { return sizeof(tty_transfer_parser); }
+
+size_t tty_transfer_parser_alignof() { return _Alignof(tty_transfer_parser); }
+
+tty_transfer_parser *tty_transfer_parser_init(void *storage,
+                                              size_t storage_size) {
+  if (storage_size < sizeof(tty_transfer_parser))
+    return NULL;
+
+  if ((uintptr_t)storage % _Alignof(tty_transfer_parser))
+    return NULL;
+
+  tty_transfer_parser *p = storage;
+  tty_transfer_parser_construct(p);
+  return p;
+}
 
 void tty_transfer_parser_reset(tty_transfer_parser *p) {
-  p->osc_str[0] = '\0';
-  p->osc_str_back = &p->osc_str[0];
-  p->is_esc = 0;
-  p->seq_type = normal;
+  tty_transfer_osc_matcher_reset(&p->osc);
+  p->state = vt_ground;
   p->key = NULL;
   p->val = NULL;
+  p->nosc = 0;
+  p->ncsi = 0;
+  p->nreplies = 0;
+  p->ntokens = 0;
+  memset(p->token_slots, 0, sizeof(p->token_slots));
+}
+
+void tty_transfer_parser_set_mode(tty_transfer_parser *p,
+                                  tty_transfer_parser_mode mode) {
+  p->mode = mode;
+  tty_transfer_parser_reset(p);
+}
+
+// Hex digit value + 1, or 0 for bytes that are not hex digits
+static const unsigned char hex_table[256] = {
+    ['0'] = 1,  ['1'] = 2,  ['2'] = 3,  ['3'] = 4,  ['4'] = 5,  ['5'] = 6,
+    ['6'] = 7,  ['7'] = 8,  ['8'] = 9,  ['9'] = 10, ['a'] = 11, ['b'] = 12,
+    ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16, ['A'] = 11, ['B'] = 12,
+    ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+};
+
+// Whitespace in the C locale, regardless of the current locale
+static int is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+
+static char ascii_lower(char c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
 }
 
-static const char *parse_literal_nocase(const char *start, const char *end,
-                                        const char *lower_literal) {
-  const char *it = start;
-  while (it < end && isspace(*it)) {
-    ++it;
+// Decode the 36 chars of a formatted UUID. This stops at the first invalid
+// char, so it never reads past the terminator of a shorter string.
+static int decode_uuid_chars(const char *s, tty_transfer_uuid *uuid) {
+  static const int group_bytes[] = {4, 2, 2, 2, 6};
+
+  unsigned char *bin = uuid->bytes;
+  for (int g = 0; g < 5; ++g) {
+    if (g && *s++ != '-')
+      return 0;
+
+    for (int i = 0; i < group_bytes[g]; ++i) {
+      unsigned hi = hex_table[(unsigned char)s[0]];
+      if (!hi)
+        return 0;
+
+      unsigned lo = hex_table[(unsigned char)s[1]];
+      if (!lo)
+        return 0;
+
+      *bin++ = ((hi - 1) << 4) | (lo - 1);
+      s += 2;
+    }
   }
 
-  int len = strlen(lower_literal);
-  for (int i = 0; i < len; ++i) {
-    if (it >= end)
-      return NULL;
-    if (tolower(*it) != lower_literal[i])
-      return NULL;
-    ++it;
+  return 1;
+}
+
+int tty_transfer_uuid_parse(const char *str, tty_transfer_uuid *uuid) {
+  return decode_uuid_chars(str, uuid) && str[36] == '\0';
+}
+
+// Lowercase hex digit pairs for every byte value
+static const char hex_pairs[] = "000102030405060708090a0b0c0d0e0f"
+                                "101112131415161718191a1b1c1d1e1f"
+                                "202122232425262728292a2b2c2d2e2f"
+                                "303132333435363738393a3b3c3d3e3f"
+                                "404142434445464748494a4b4c4d4e4f"
+                                "505152535455565758595a5b5c5d5e5f"
+                                "606162636465666768696a6b6c6d6e6f"
+                                "707172737475767778797a7b7c7d7e7f"
+                                "808182838485868788898a8b8c8d8e8f"
+                                "909192939495969798999a9b9c9d9e9f"
+                                "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+                                "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+                                "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+                                "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+                                "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+                                "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+void tty_transfer_uuid_format(const tty_transfer_uuid *uuid, char *buf) {
+  for (int i = 0; i < 16; ++i) {
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      *buf++ = '-';
+
+    memcpy(buf, &hex_pairs[2 * uuid->bytes[i]], 2);
+    buf += 2;
   }
 
-  return it;
+  *buf = '\0';
+}
+
+// Compare with two 64 bit loads instead of a byte loop
+static int uuid_eq(const tty_transfer_uuid *a, const tty_transfer_uuid *b) {
+  uint64_t a0, a1, b0, b1;
+  memcpy(&a0, a->bytes, sizeof(a0));
+  memcpy(&a1, a->bytes + sizeof(a0), sizeof(a1));
+  memcpy(&b0, b->bytes, sizeof(b0));
+  memcpy(&b1, b->bytes + sizeof(b0), sizeof(b1));
+  return ((a0 ^ b0) | (a1 ^ b1)) == 0;
 }
 
-static const char *parse_literal(const char *start, const char *end,
-                                 const char *literal) {
-  const char *it = start;
-  while (it < end && isspace(*it)) {
-    ++it;
+static size_t token_slot_hash(const tty_transfer_uuid *key_bin) {
+  uint64_t a, b;
+  memcpy(&a, key_bin->bytes, sizeof(a));
+  memcpy(&b, key_bin->bytes + sizeof(a), sizeof(b));
+  return (size_t)(((a ^ b) * 0x9e3779b97f4a7c15ull) >> 32) & (TOKEN_SLOTS - 1);
+}
+
+// Find the slot holding key_bin, or the empty slot where it belongs
+static unsigned char *
+tty_transfer_parser_find_slot(const tty_transfer_parser *p,
+                              const tty_transfer_uuid *key_bin) {
+  size_t i = token_slot_hash(key_bin);
+  while (1) {
+    const unsigned char *slot = &p->token_slots[i];
+    if (!*slot || uuid_eq(&p->tokens[*slot - 1].key_bin, key_bin))
+      return (unsigned char *)slot;
+
+    // The table is never more than half full, so this terminates
+    i = (i + 1) & (TOKEN_SLOTS - 1);
   }
+}
 
-  int len = strlen(literal);
-  for (int i = 0; i < len; ++i) {
-    if (it >= end)
-      return NULL;
-    if (*it != literal[i])
-      return NULL;
-    ++it;
+// Record the last parsed token in the table
+static void tty_transfer_parser_record_token(tty_transfer_parser *p) {
+  unsigned char *slot = tty_transfer_parser_find_slot(p, &p->key_bin);
+  if (!*slot) {
+    if (p->ntokens >= TTY_TRANSFER_PARSER_MAX_TOKENS)
+      return;
+
+    *slot = ++p->ntokens;
+    struct tty_transfer_token_entry_ *e = &p->tokens[*slot - 1];
+    e->key_bin = p->key_bin;
+    memcpy(e->key, p->key, 36);
+    e->key[36] = '\0';
   }
 
-  return it;
+  struct tty_transfer_token_entry_ *e = &p->tokens[*slot - 1];
+  e->val_bin = p->val_bin;
+  memcpy(e->val, p->val, 36);
+  e->val[36] = '\0';
 }
 
-static const char *parse_xdigits(const char *start, const char *end,
-                                 int ndigits) {
-  const char *it = start;
-  for (int i = 0; i < ndigits; ++i) {
-    if (it >= end)
-      return NULL;
-    if (!isxdigit(*it))
-      return NULL;
-    ++it;
-  }
+void tty_transfer_osc_matcher_reset(tty_transfer_osc_matcher *m) {
+  m->field = tty_transfer_osc_1337;
+  m->pos = 0;
+  m->kind = TTY_TRANSFER_OSC_NONE;
+}
+
+static void end_uuid(tty_transfer_osc_matcher *m) {
+  if (m->field == tty_transfer_osc_key &&
+      m->kind == TTY_TRANSFER_OSC_IO_TOKEN)
+    m->field = tty_transfer_osc_key_semi;
+  else
+    m->field = tty_transfer_osc_end;
 
-  return it;
+  m->pos = 0;
 }
 
-static const char *parse_char(const char *start, const char *end, char c) {
-  if (start >= end)
-    return NULL;
-  if (*start != c)
-    return NULL;
-  return start + 1;
+// Collect the chars of a UUID, decoding them once all 36 have arrived. Sets
+// n to the number of chars used.
+static int match_uuid(tty_transfer_osc_matcher *m, const char *s, size_t *n) {
+  int is_key = m->field == tty_transfer_osc_key;
+  char *str = is_key ? m->key : m->val;
+
+  size_t len = 36 - m->pos;
+  if (len > *n)
+    len = *n;
+
+  memcpy(&str[m->pos], s, len);
+  m->pos += len;
+  *n = len;
+  if (m->pos < 36)
+    return 1;
+
+  str[36] = '\0';
+  if (!decode_uuid_chars(str, is_key ? &m->key_bin : &m->val_bin))
+    return 0;
+
+  end_uuid(m);
+  return 1;
 }
 
-static const char *parse_uuid(const char *start, const char *end,
-                              const char **uuid_start) {
-  const char *it = start;
-  while (it < end && isspace(*it)) {
-    ++it;
+static int match_char(tty_transfer_osc_matcher *m, char c) {
+  if (m->pos == 0 && is_space(c))
+    return 1;
+
+  switch (m->field) {
+  case tty_transfer_osc_1337:
+    if (c != "1337"[m->pos])
+      return 0;
+
+    if (++m->pos == 4) {
+      m->field = tty_transfer_osc_semi;
+      m->pos = 0;
+    }
+    return 1;
+  case tty_transfer_osc_semi:
+  case tty_transfer_osc_key_semi:
+    if (c != ';')
+      return 0;
+
+    ++m->field;
+    return 1;
+  case tty_transfer_osc_name: {
+    c = ascii_lower(c);
+    if (m->pos == 0) {
+      if (c == 'i')
+        m->kind = TTY_TRANSFER_OSC_IO_TOKEN;
+      else if (c == 'r')
+        m->kind = TTY_TRANSFER_OSC_REQUEST;
+      else
+        return 0;
+    }
+
+    const char *name = m->kind == TTY_TRANSFER_OSC_IO_TOKEN
+                           ? "iotoken"
+                           : "requesttransferiotoken";
+    if (c != name[m->pos])
+      return 0;
+
+    if (!name[++m->pos]) {
+      m->field = tty_transfer_osc_eq;
+      m->pos = 0;
+    }
+    return 1;
+  }
+  case tty_transfer_osc_eq:
+    if (c != '=')
+      return 0;
+
+    m->field = tty_transfer_osc_key;
+    return 1;
+  default:
+    // Only whitespace follows the last field. UUIDs are matched by
+    // match_uuid.
+    return 0;
   }
+}
 
-  if (uuid_start)
-    *uuid_start = it;
+int tty_transfer_osc_matcher_put(tty_transfer_osc_matcher *m, const char *s,
+                                 size_t n) {
+  if (m->field == tty_transfer_osc_reject)
+    return 0;
+
+  size_t i = 0;
+  while (i < n) {
+    int ok;
+    if ((m->field == tty_transfer_osc_key ||
+         m->field == tty_transfer_osc_val) &&
+        !(m->pos == 0 && is_space(s[i]))) {
+      size_t len = n - i;
+      ok = match_uuid(m, &s[i], &len);
+      i += len;
+    } else {
+      ok = match_char(m, s[i++]);
+    }
 
-  if (!(it = parse_xdigits(it, end, 8)))
-    return NULL;
-  if (!(it = parse_char(it, end, '-')))
-    return NULL;
-  if (!(it = parse_xdigits(it, end, 4)))
-    return NULL;
-  if (!(it = parse_char(it, end, '-')))
-    return NULL;
-  if (!(it = parse_xdigits(it, end, 4)))
-    return NULL;
-  if (!(it = parse_char(it, end, '-')))
-    return NULL;
-  if (!(it = parse_xdigits(it, end, 4)))
-    return NULL;
-  if (!(it = parse_char(it, end, '-')))
-    return NULL;
-  if (!(it = parse_xdigits(it, end, 12)))
-    return NULL;
+    if (!ok) {
+      m->field = tty_transfer_osc_reject;
+      return 0;
+    }
+  }
 
-  return it;
+  return 1;
 }
 
-static const char *parse_end_ws(const char *start, const char *end) {
-  const char *it = start;
-  while (it < end && isspace(*it))
-    ++it;
+tty_transfer_osc_kind
+tty_transfer_osc_matcher_finish(const tty_transfer_osc_matcher *m) {
+  if (m->field != tty_transfer_osc_end)
+    return TTY_TRANSFER_OSC_NONE;
 
-  if (it != end)
-    return NULL;
-  return it;
+  return (tty_transfer_osc_kind)m->kind;
 }
 
 static void tty_transfer_parser_parse_io_token(tty_transfer_parser *p) {
   p->key = NULL;
   p->val = NULL;
 
-  const char *key = NULL;
-  const char *val = NULL;
-
-  const char *it = p->osc_str;
-  const char *end = p->osc_str_back;
-  if (!(it = parse_literal(it, end, "1337")))
+  const tty_transfer_osc_matcher *m = &p->osc;
+  if (tty_transfer_osc_matcher_finish(m) != TTY_TRANSFER_OSC_IO_TOKEN)
     return;
 
-  if (!(it = parse_literal(it, end, ";")))
-    return;
+  ++p->nreplies;
 
-  if (!(it = parse_literal_nocase(it, end, "iotoken")))
-    return;
+  // Copy out of the matcher so the token outlives the next OSC sequence
+  memcpy(p->key_str, m->key, sizeof(p->key_str));
+  memcpy(p->val_str, m->val, sizeof(p->val_str));
+  p->key_bin = m->key_bin;
+  p->val_bin = m->val_bin;
+  p->key = p->key_str;
+  p->val = p->val_str;
 
-  if (!(it = parse_literal(it, end, "=")))
-    return;
+  if (p->mode == TTY_TRANSFER_PARSER_ALL_TOKENS)
+    tty_transfer_parser_record_token(p);
+}
 
-  if (!(it = parse_uuid(it, end, &key)))
-    return;
+static int tty_transfer_parser_feed_char(tty_transfer_parser *p,
+                                         unsigned char c) {
+  unsigned char t =
+      tty_transfer_vt_transitions[p->state][tty_transfer_vt_classes[c]];
+  p->state = TTY_TRANSFER_VT_STATE(t);
+
+  switch (TTY_TRANSFER_VT_ACTION(t)) {
+  case vt_osc_start:
+    ++p->nosc;
+    tty_transfer_osc_matcher_reset(&p->osc);
+    break;
+  case vt_osc_put:
+    tty_transfer_osc_matcher_put(&p->osc, (const char *)&c, 1);
+    break;
+  case vt_osc_end:
+    tty_transfer_parser_parse_io_token(p);
+    break;
+  case vt_csi_start:
+    ++p->ncsi;
+    break;
+  case vt_cpr:
+    return 1; // end of cursor position report
+  default:
+    break;
+  }
 
-  if (!(it = parse_literal(it, end, ";")))
-    return;
+  return 0;
+}
 
-  if (!(it = parse_uuid(it, end, &val)))
-    return;
+int tty_transfer_parser_feed(tty_transfer_parser *p, const void *bytes,
+                             size_t nbytes) {
+  const char *buf = (const char *)bytes;
+  size_t i = 0;
+
+  while (i < nbytes) {
+    // Skip straight to the next byte that can change the parser state. Only
+    // bytes in escape and control sequences go through the transition table.
+    const char *it = &buf[i];
+    size_t n = nbytes - i;
+
+    switch (p->state) {
+    case vt_ground:
+      i += tty_transfer_scan_byte(it, n, '\e');
+      break;
+    case vt_osc_string: {
+      // Once the string cannot be a token, only look for its end
+      size_t len = tty_transfer_scan_range(it, n, 0x00, 0x1f);
+      tty_transfer_osc_matcher_put(&p->osc, it, len);
+      i += len;
+      break;
+    }
+    case vt_csi_param:
+      // Parameters keep the state until an intermediate or final byte
+      i += tty_transfer_scan_csi_params(it, n);
+      break;
+    case vt_dcs_passthrough:
+    case vt_dcs_ignore:
+    case vt_sos_pm_apc_string:
+      // Only CAN, SUB and ESC end these strings
+      i += tty_transfer_scan_range(it, n, 0x18, 0x1b);
+      break;
+    default:
+      break;
+    }
 
-  if (!(it = parse_end_ws(it, end)))
-    return;
+    if (i == nbytes)
+      break;
 
-  p->key = key;
-  p->val = val;
+    if (tty_transfer_parser_feed_char(p, (unsigned char)buf[i++]))
+      return i;
+  }
 
-  int offset = p->val - p->osc_str;
-  p->osc_str[offset + 36] = '\0'; // terminate val UUID str
+  return 0;
 }
 
-static void tty_transfer_parser_push_strchr(tty_transfer_parser *p, char c) {
-  if (p->osc_str_back - &p->osc_str[0] + 1 >=
-      (sizeof(p->osc_str) / sizeof(char))) {
-    return;
+// The table entry holding the token for key, or NULL
+static const struct tty_transfer_token_entry_ *
+tty_transfer_parser_find_token(const tty_transfer_parser *p,
+                               const tty_transfer_uuid *key) {
+  unsigned char slot = *tty_transfer_parser_find_slot(p, key);
+  return slot ? &p->tokens[slot - 1] : NULL;
+}
+
+// Whether the last parsed sequence was the token for key
+static int tty_transfer_parser_is_last_token(const tty_transfer_parser *p,
+                                             const tty_transfer_uuid *key) {
+  return p->key && p->val && uuid_eq(&p->key_bin, key);
+}
+
+const tty_transfer_uuid *
+tty_transfer_parser_token_for_uuid(const tty_transfer_parser *p,
+                                   const tty_transfer_uuid *key) {
+  if (p->mode == TTY_TRANSFER_PARSER_ALL_TOKENS) {
+    const struct tty_transfer_token_entry_ *e =
+        tty_transfer_parser_find_token(p, key);
+    return e ? &e->val_bin : NULL;
   }
 
-  *p->osc_str_back = c;
-  ++p->osc_str_back;
-  *p->osc_str_back = '\0';
+  return tty_transfer_parser_is_last_token(p, key) ? &p->val_bin : NULL;
 }
 
-static int tty_transfer_parser_feed_char(tty_transfer_parser *p, char c) {
-  if (p->seq_type == osc) {
-    if (p->is_esc) {
-      // ST
-      if (c == '\\') {
-        tty_transfer_parser_parse_io_token(p);
-        p->seq_type = normal;
-      } else {
-        tty_transfer_parser_push_strchr(p, '\e');
-        tty_transfer_parser_push_strchr(p, c);
-      }
-      p->is_esc = 0;
-    } else {
-      if (c == '\e') {
-        p->is_esc = 1;
-      } else {
-        tty_transfer_parser_push_strchr(p, c);
-      }
-    }
-  } else if (p->seq_type == csi) {
-    // See ECMA 48 Section 5.4 d). Final byte is 04/00 to 07/14
-    if (c >= 0x40 && c <= 0x7e) {
-      p->seq_type = normal;
-      return c == 'R'; // end of cursor position report
-    }
-  } else {
-    if (p->is_esc) {
-      if (c == ']') {
-        p->seq_type = osc;
-        p->osc_str_back = &p->osc_str[0];
-        p->osc_str[0] = '\0';
-      } else if (c == '[') {
-        p->seq_type = csi;
-      }
-
-      p->is_esc = 0;
-    } else {
-      if (c == '\e') {
-        p->is_esc = 1;
-      }
-    }
+size_t tty_transfer_parser_tokens_for_uuids(const tty_transfer_parser *p,
+                                            const tty_transfer_uuid *keys,
+                                            const tty_transfer_uuid **tokens,
+                                            size_t nkeys) {
+  size_t nfound = 0;
+  for (size_t i = 0; i < nkeys; ++i) {
+    tokens[i] = tty_transfer_parser_token_for_uuid(p, &keys[i]);
+    nfound += tokens[i] != NULL;
   }
 
-  return 0;
+  return nfound;
 }
 
-int tty_transfer_parser_feed(tty_transfer_parser *p, const void *bytes,
-                             size_t nbytes) {
-  for (int i = 0; i < nbytes; ++i) {
-    char c = ((const char *)bytes)[i];
-    if (tty_transfer_parser_feed_char(p, c))
-      return i + 1;
+// The token for key as it was formatted in the parsed sequence, or NULL
+static const char *
+tty_transfer_parser_token_str_for_uuid(const tty_transfer_parser *p,
+                                       const tty_transfer_uuid *key) {
+  if (p->mode == TTY_TRANSFER_PARSER_ALL_TOKENS) {
+    const struct tty_transfer_token_entry_ *e =
+        tty_transfer_parser_find_token(p, key);
+    return e ? e->val : NULL;
   }
 
-  return 0;
+  return tty_transfer_parser_is_last_token(p, key) ? p->val : NULL;
 }
 
 const char *tty_transfer_parser_token_for_key(const tty_transfer_parser *p,
                                               const char *key) {
-  if (!(p->key && p->val))
+  tty_transfer_uuid key_bin;
+  if (!tty_transfer_uuid_parse(key, &key_bin))
     return NULL;
 
-  // expect 36 char UUID key
-  if (strlen(key) != 36)
-    return NULL;
+  return tty_transfer_parser_token_str_for_uuid(p, &key_bin);
+}
+
+size_t tty_transfer_parser_token_count(const tty_transfer_parser *p) {
+  if (p->mode == TTY_TRANSFER_PARSER_ALL_TOKENS)
+    return p->ntokens;
 
-  if (p->osc_str_back - p->key < 36)
+  return p->key && p->val;
+}
+
+const char *tty_transfer_parser_token_at(const tty_transfer_parser *p,
+                                         size_t i, const char **key) {
+  if (i >= tty_transfer_parser_token_count(p))
     return NULL;
 
-  for (int i = 0; i < 36; ++i) {
-    if (tolower(key[i]) != tolower(p->key[i]))
-      return NULL;
+  if (p->mode == TTY_TRANSFER_PARSER_ALL_TOKENS) {
+    if (key)
+      *key = p->tokens[i].key;
+    return p->tokens[i].val;
   }
 
+  if (key)
+    *key = p->key;
   return p->val;
 }
 
+size_t tty_transfer_parser_tokens_for_keys(const tty_transfer_parser *p,
+                                           const char *const *keys,
+                                           const char **tokens, size_t nkeys) {
+  size_t nfound = 0;
+  for (size_t i = 0; i < nkeys; ++i) {
+    tokens[i] = tty_transfer_parser_token_for_key(p, keys[i]);
+    nfound += tokens[i] != NULL;
+  }
+
+  return nfound;
+}
+
 #if defined(__APPLE__) || defined(__linux__)
 #include "tty_transfer/private/impl/tty_transfer_posix.c"
 #else
@@ -6,24 +6,121 @@
  * https://opensource.org/licenses/MIT.
  */
 
+#if defined(__APPLE__)
+// enable getentropy
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "tty_transfer/private/uuid.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
 #if defined(__linux__)
-#include <uuid/uuid.h>
+#include <sys/random.h>
 #elif defined(__APPLE__)
-#include <uuid/uuid.h>
+#include <unistd.h>
 #else
 #error "Platform not supported!"
 #endif
 
-#if defined(__linux__) || defined(__APPLE__)
+// Random bytes fetched per system call. getentropy allows at most 256.
+#define POOL_SIZE 256
+#define UUID_BYTES 16
+
+struct tty_transfer_uuid_pool_ {
+  unsigned fork_gen;
+  size_t avail; // unused bytes at the end of bytes
+  unsigned char bytes[POOL_SIZE];
+};
+
+static _Thread_local struct tty_transfer_uuid_pool_ pool;
+
+// A child must not mint the same keys as its parent from a copied pool, so
+// forking bumps the generation to invalidate every pool
+static atomic_uint fork_gen = 1;
+static pthread_once_t atfork_once = PTHREAD_ONCE_INIT;
+
+static void on_fork_child(void) {
+  atomic_fetch_add_explicit(&fork_gen, 1, memory_order_relaxed);
+}
+
+static void register_atfork(void) { pthread_atfork(NULL, NULL, on_fork_child); }
+
+static int fill_random(unsigned char *buf, size_t n) {
+#if defined(__linux__)
+  while (n) {
+    ssize_t nread = getrandom(buf, n, 0);
+    if (nread < 0) {
+      if (errno == EINTR)
+        continue;
+
+      return 0;
+    }
+
+    buf += nread;
+    n -= nread;
+  }
+
+  return 1;
+#else
+  return getentropy(buf, n) == 0;
+#endif
+}
+
+int tty_transfer_uuid_random(tty_transfer_uuid *uuids, size_t n) {
+  pthread_once(&atfork_once, register_atfork);
+
+  unsigned gen = atomic_load_explicit(&fork_gen, memory_order_relaxed);
+  if (pool.fork_gen != gen) {
+    pool.fork_gen = gen;
+    pool.avail = 0;
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    if (pool.avail < UUID_BYTES) {
+      if (!fill_random(pool.bytes, POOL_SIZE))
+        return 0;
+
+      pool.avail = POOL_SIZE;
+    }
+
+    unsigned char *bytes = uuids[i].bytes;
+    memcpy(bytes, pool.bytes + POOL_SIZE - pool.avail, UUID_BYTES);
+    pool.avail -= UUID_BYTES;
+
+    // RFC 9562 version 4 and variant 10xx
+    bytes[6] = (bytes[6] & 0x0f) | 0x40;
+    bytes[8] = (bytes[8] & 0x3f) | 0x80;
+  }
+
+  return 1;
+}
+
+int tty_transfer_uuid_generate_batch(char *bufs, size_t n) {
+  tty_transfer_uuid uuids[POOL_SIZE / UUID_BYTES];
+
+  while (n) {
+    size_t nchunk = n < POOL_SIZE / UUID_BYTES ? n : POOL_SIZE / UUID_BYTES;
+    if (!tty_transfer_uuid_random(uuids, nchunk))
+      return 0;
+
+    for (size_t i = 0; i < nchunk; ++i) {
+      tty_transfer_uuid_format(&uuids[i], bufs);
+      bufs += TTY_TRANSFER_UUID_SIZE;
+    }
+
+    n -= nchunk;
+  }
+
+  return 1;
+}
+
 int tty_transfer_uuid_generate(char *buf, size_t bufsz) {
   if (bufsz < TTY_TRANSFER_UUID_SIZE)
     return 0;
 
-  uuid_t uuid;
-  uuid_generate_random(uuid);
-  uuid_unparse(uuid, buf);
-  return 1;
+  return tty_transfer_uuid_generate_batch(buf, 1);
 }
-#endif
@@ -0,0 +1,226 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include "tty_transfer/private/vtparse.h"
+
+// clang-format off
+#define VT_CLASS(b)                                                           \
+  ((b) == 0x07 ? vt_class_bel                                                 \
+   : (b) == 0x18 || (b) == 0x1a ? vt_class_can                                \
+   : (b) == 0x1b ? vt_class_esc                                               \
+   : (b) < 0x20 ? vt_class_c0                                                 \
+   : (b) < 0x30 ? vt_class_inter                                              \
+   : (b) == ':' ? vt_class_colon                                              \
+   : (b) < 0x3c ? vt_class_param                                              \
+   : (b) < 0x40 ? vt_class_priv                                               \
+   : (b) == '[' ? vt_class_csi                                                \
+   : (b) == ']' ? vt_class_osc                                                \
+   : (b) == 'P' ? vt_class_dcs                                                \
+   : (b) == 'X' || (b) == '^' || (b) == '_' ? vt_class_sos                    \
+   : (b) == '\\' ? vt_class_st                                                \
+   : (b) == 'R' ? vt_class_cpr                                                \
+   : (b) < 0x7f ? vt_class_final                                              \
+   : (b) == 0x7f ? vt_class_del                                               \
+   : vt_class_high)
+// clang-format on
+
+#define VT_CLASS4(b)                                                           \
+  VT_CLASS(b), VT_CLASS((b) + 1), VT_CLASS((b) + 2), VT_CLASS((b) + 3)
+#define VT_CLASS16(b)                                                          \
+  VT_CLASS4(b), VT_CLASS4((b) + 4), VT_CLASS4((b) + 8), VT_CLASS4((b) + 12)
+#define VT_CLASS64(b)                                                          \
+  VT_CLASS16(b), VT_CLASS16((b) + 16), VT_CLASS16((b) + 32),                   \
+      VT_CLASS16((b) + 48)
+
+const unsigned char tty_transfer_vt_classes[256] = {
+    VT_CLASS64(0), VT_CLASS64(64), VT_CLASS64(128), VT_CLASS64(192)};
+
+#define T(action, state) ((vt_##action << 4) | vt_##state)
+
+// Bytes from 0x30 to 0x7e end escape and control sequences
+#define FINALS(t)                                                              \
+  [vt_class_param] = t, [vt_class_colon] = t, [vt_class_priv] = t,             \
+  [vt_class_csi] = t, [vt_class_osc] = t, [vt_class_dcs] = t,                  \
+  [vt_class_sos] = t, [vt_class_st] = t, [vt_class_cpr] = t,                   \
+  [vt_class_final] = t
+
+// Bytes from 0x40 to 0x7e end CSI and DCS parameters
+#define CSI_FINALS(t)                                                          \
+  [vt_class_csi] = t, [vt_class_osc] = t, [vt_class_dcs] = t,                  \
+  [vt_class_sos] = t, [vt_class_st] = t, [vt_class_final] = t
+
+#define ESCAPE_ROW(st)                                                         \
+  {                                                                            \
+    [vt_class_c0] = T(none, escape), [vt_class_bel] = T(none, escape),         \
+    [vt_class_can] = T(none, ground), [vt_class_esc] = T(none, escape),        \
+    [vt_class_inter] = T(none, escape_intermediate),                           \
+    [vt_class_param] = T(none, ground), [vt_class_colon] = T(none, ground),    \
+    [vt_class_priv] = T(none, ground),                                        \
+    [vt_class_csi] = T(csi_start, csi_entry),                                  \
+    [vt_class_osc] = T(osc_start, osc_string),                                 \
+    [vt_class_dcs] = T(none, dcs_entry),                                       \
+    [vt_class_sos] = T(none, sos_pm_apc_string), [vt_class_st] = st,           \
+    [vt_class_cpr] = T(none, ground), [vt_class_final] = T(none, ground),      \
+    [vt_class_del] = T(none, escape), [vt_class_high] = T(none, ground),       \
+  }
+
+// Sequences that ignore everything but their end
+#define STRING_ROW(state)                                                      \
+  {                                                                            \
+    [vt_class_c0] = T(none, state), [vt_class_bel] = T(none, state),           \
+    [vt_class_can] = T(none, ground), [vt_class_esc] = T(none, escape),        \
+    [vt_class_inter] = T(none, state), FINALS(T(none, state)),                 \
+    [vt_class_del] = T(none, state), [vt_class_high] = T(none, state),         \
+  }
+
+const unsigned char tty_transfer_vt_transitions[vt_nstates][vt_nclasses] = {
+    [vt_ground] =
+        {
+            [vt_class_c0] = T(none, ground),
+            [vt_class_bel] = T(none, ground),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, ground),
+            FINALS(T(none, ground)),
+            [vt_class_del] = T(none, ground),
+            [vt_class_high] = T(none, ground),
+        },
+    [vt_escape] = ESCAPE_ROW(T(none, ground)),
+    [vt_escape_intermediate] =
+        {
+            [vt_class_c0] = T(none, escape_intermediate),
+            [vt_class_bel] = T(none, escape_intermediate),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, escape_intermediate),
+            FINALS(T(none, ground)),
+            [vt_class_del] = T(none, escape_intermediate),
+            [vt_class_high] = T(none, ground),
+        },
+    [vt_csi_entry] =
+        {
+            [vt_class_c0] = T(none, csi_entry),
+            [vt_class_bel] = T(none, csi_entry),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, csi_intermediate),
+            [vt_class_param] = T(none, csi_param),
+            [vt_class_colon] = T(none, csi_param),
+            [vt_class_priv] = T(none, csi_param),
+            CSI_FINALS(T(none, ground)),
+            [vt_class_cpr] = T(cpr, ground),
+            [vt_class_del] = T(none, csi_entry),
+            [vt_class_high] = T(none, csi_ignore),
+        },
+    [vt_csi_param] =
+        {
+            [vt_class_c0] = T(none, csi_param),
+            [vt_class_bel] = T(none, csi_param),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, csi_intermediate),
+            [vt_class_param] = T(none, csi_param),
+            [vt_class_colon] = T(none, csi_param),
+            [vt_class_priv] = T(none, csi_ignore),
+            CSI_FINALS(T(none, ground)),
+            [vt_class_cpr] = T(cpr, ground),
+            [vt_class_del] = T(none, csi_param),
+            [vt_class_high] = T(none, csi_ignore),
+        },
+    [vt_csi_intermediate] =
+        {
+            [vt_class_c0] = T(none, csi_intermediate),
+            [vt_class_bel] = T(none, csi_intermediate),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, csi_intermediate),
+            [vt_class_param] = T(none, csi_ignore),
+            [vt_class_colon] = T(none, csi_ignore),
+            [vt_class_priv] = T(none, csi_ignore),
+            CSI_FINALS(T(none, ground)),
+            [vt_class_cpr] = T(cpr, ground),
+            [vt_class_del] = T(none, csi_intermediate),
+            [vt_class_high] = T(none, csi_ignore),
+        },
+    [vt_csi_ignore] =
+        {
+            [vt_class_c0] = T(none, csi_ignore),
+            [vt_class_bel] = T(none, csi_ignore),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, csi_ignore),
+            [vt_class_param] = T(none, csi_ignore),
+            [vt_class_colon] = T(none, csi_ignore),
+            [vt_class_priv] = T(none, csi_ignore),
+            CSI_FINALS(T(none, ground)),
+            [vt_class_cpr] = T(none, ground),
+            [vt_class_del] = T(none, csi_ignore),
+            [vt_class_high] = T(none, csi_ignore),
+        },
+    [vt_dcs_entry] =
+        {
+            [vt_class_c0] = T(none, dcs_entry),
+            [vt_class_bel] = T(none, dcs_entry),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, dcs_intermediate),
+            [vt_class_param] = T(none, dcs_param),
+            [vt_class_colon] = T(none, dcs_param),
+            [vt_class_priv] = T(none, dcs_param),
+            CSI_FINALS(T(none, dcs_passthrough)),
+            [vt_class_cpr] = T(none, dcs_passthrough),
+            [vt_class_del] = T(none, dcs_entry),
+            [vt_class_high] = T(none, dcs_ignore),
+        },
+    [vt_dcs_param] =
+        {
+            [vt_class_c0] = T(none, dcs_param),
+            [vt_class_bel] = T(none, dcs_param),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, dcs_intermediate),
+            [vt_class_param] = T(none, dcs_param),
+            [vt_class_colon] = T(none, dcs_param),
+            [vt_class_priv] = T(none, dcs_ignore),
+            CSI_FINALS(T(none, dcs_passthrough)),
+            [vt_class_cpr] = T(none, dcs_passthrough),
+            [vt_class_del] = T(none, dcs_param),
+            [vt_class_high] = T(none, dcs_ignore),
+        },
+    [vt_dcs_intermediate] =
+        {
+            [vt_class_c0] = T(none, dcs_intermediate),
+            [vt_class_bel] = T(none, dcs_intermediate),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, escape),
+            [vt_class_inter] = T(none, dcs_intermediate),
+            [vt_class_param] = T(none, dcs_ignore),
+            [vt_class_colon] = T(none, dcs_ignore),
+            [vt_class_priv] = T(none, dcs_ignore),
+            CSI_FINALS(T(none, dcs_passthrough)),
+            [vt_class_cpr] = T(none, dcs_passthrough),
+            [vt_class_del] = T(none, dcs_intermediate),
+            [vt_class_high] = T(none, dcs_ignore),
+        },
+    [vt_dcs_passthrough] = STRING_ROW(dcs_passthrough),
+    [vt_dcs_ignore] = STRING_ROW(dcs_ignore),
+    [vt_osc_string] =
+        {
+            [vt_class_c0] = T(none, osc_string),
+            [vt_class_bel] = T(osc_end, ground),
+            [vt_class_can] = T(none, ground),
+            [vt_class_esc] = T(none, osc_esc),
+            [vt_class_inter] = T(osc_put, osc_string),
+            FINALS(T(osc_put, osc_string)),
+            [vt_class_del] = T(osc_put, osc_string),
+            [vt_class_high] = T(osc_put, osc_string),
+        },
+    // Anything but ST abandons the OSC string and starts a new sequence
+    [vt_osc_esc] = ESCAPE_ROW(T(osc_end, ground)),
+    [vt_sos_pm_apc_string] = STRING_ROW(sos_pm_apc_string),
+};
@@ -0,0 +1,161 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// for forkpty
+#if defined(__APPLE__)
+#include <util.h>
+#elif defined(__linux__)
+#include <pty.h>
+#endif
+
+#include "tty_transfer.h"
+
+#define UUID_VAL "f81d4fae-7dec-11d0-a765-00a0c91e6bf6"
+#define UUID_RE "[[:xdigit:]]{8}-([[:xdigit:]]{4}-){3}[[:xdigit:]]{12}"
+
+// This binary interposes the C allocator so that every heap allocation in the
+// process, including those inside the library, can be counted
+static std::atomic<bool> counting{false};
+static std::atomic<int> nallocs{0};
+
+#if defined(__GLIBC__)
+#define HAVE_MALLOC_INTERPOSE 1
+
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void __libc_free(void *);
+
+void *malloc(size_t n) {
+  if (counting)
+    ++nallocs;
+  return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size) {
+  if (counting)
+    ++nallocs;
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t n) {
+  if (counting)
+    ++nallocs;
+  return __libc_realloc(ptr, n);
+}
+
+void free(void *ptr) { __libc_free(ptr); }
+}
+#endif
+
+struct counting_allocator {
+  int nalloc = 0;
+  int nfree = 0;
+
+  static void *alloc(void *ctx, size_t size) {
+    ++static_cast<counting_allocator *>(ctx)->nalloc;
+    return std::malloc(size);
+  }
+
+  static void free(void *ctx, void *ptr) {
+    ++static_cast<counting_allocator *>(ctx)->nfree;
+    std::free(ptr);
+  }
+};
+
+static std::string read_until_csi6n(int fd) {
+  std::string out;
+  char buf[256];
+  while (out.find("\e[6n") == std::string::npos) {
+    int nread = ::read(fd, buf, sizeof(buf));
+    if (nread < 1)
+      return "";
+
+    out.append(buf, nread);
+  }
+
+  return out;
+}
+
+TEST(TtyTransferAlloc, ParserUsesAllocatorHooks) {
+  counting_allocator counter;
+  tty_transfer_allocator a = {counting_allocator::alloc,
+                              counting_allocator::free, &counter};
+  tty_transfer_set_allocator(&a);
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+  EXPECT_TRUE(p);
+  tty_transfer_parser_free(p);
+
+  tty_transfer_set_allocator(nullptr);
+
+  EXPECT_EQ(counter.nalloc, 1);
+  EXPECT_EQ(counter.nfree, 1);
+}
+
+TEST(TtyTransferAlloc, ParserAllocReportsFailure) {
+  tty_transfer_allocator a = {[](void *, size_t) -> void * { return nullptr; },
+                              [](void *, void *) {}, nullptr};
+  tty_transfer_set_allocator(&a);
+
+  EXPECT_FALSE(tty_transfer_parser_alloc());
+
+  tty_transfer_set_allocator(nullptr);
+}
+
+TEST(TtyTransferAlloc, RequestIoTokenDoesNotAllocate) {
+#ifndef HAVE_MALLOC_INTERPOSE
+  GTEST_SKIP() << "malloc can only be interposed with glibc";
+#else
+  int pty_master;
+  pid_t pid = forkpty(&pty_master, nullptr, nullptr, nullptr);
+  ASSERT_NE(pid, -1);
+
+  if (pid == 0) {
+    char token[37];
+
+    counting = true;
+    auto ret = tty_transfer_request_io_token(token, sizeof(token));
+    counting = false;
+
+    if (ret != TTY_TRANSFER_OK)
+      std::_Exit(ret);
+
+    std::_Exit(nallocs == 0 ? 0 : 100 + nallocs);
+  } else {
+    auto out = read_until_csi6n(pty_master);
+
+    std::regex re("RequestTransferIOToken=(" UUID_RE ")");
+    std::smatch m;
+    ASSERT_TRUE(std::regex_search(out, m, re)) << "Did not match RE";
+
+    std::ostringstream os;
+    os << "\e]1337;IOToken=" << m[1].str() << ';' << UUID_VAL
+       << "\e\\"
+          "\e[1;2R";
+    auto data = os.str();
+    ::write(pty_master, data.data(), data.size());
+
+    int exit_info;
+    EXPECT_EQ(::waitpid(pid, &exit_info, 0), pid);
+    EXPECT_EQ(WEXITSTATUS(exit_info), 0)
+        << "Child allocated " << WEXITSTATUS(exit_info) - 100 << " times";
+    ::close(pty_master);
+  }
+#endif
+}
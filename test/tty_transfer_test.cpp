@@ -5,14 +5,33 @@
  * license that can be found in the LICENSE file or at
  * https://opensource.org/licenses/MIT.
  */
+#include "tty_transfer/private/caps.h"
+#include "tty_transfer/private/osc.h"
 #include "tty_transfer/private/uuid.h"
+#include "tty_transfer/private/vtparse.h"
 
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <csignal>
+#include <cstddef>
 #include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <gtest/gtest.h>
+#include <poll.h>
+#include <random>
 #include <regex>
+#include <set>
 #include <sstream>
 #include <string>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <thread>
+#include <vector>
 
 // for forkpty
 #if defined(__APPLE__)
@@ -22,6 +41,19 @@
 #endif
 
 #include "tty_transfer.h"
+#include "tty_transfer/broker.h"
+#include "tty_transfer/caps.h"
+#include "tty_transfer/handoff.h"
+#include "tty_transfer/host.h"
+#include "tty_transfer/parser_pool.h"
+#include "tty_transfer/registry.h"
+#include "tty_transfer/session.h"
+#include "tty_transfer/transcript.h"
+#include "tty_transfer.hpp"
+
+#if defined(__linux__)
+#include "tty_transfer/epoll_reactor.hpp"
+#endif
 
 // https://www.rfc-editor.org/rfc/rfc9562.html
 #define UUID_KEY "68338148-030e-436c-89eb-9f905860f83b"
@@ -33,6 +65,19 @@
 
 std::string read_until_csi6n(int fd);
 void send_token(int fd, const std::string &token_key, const char *token_val);
+std::string request_key(const std::string &out);
+tty_transfer_errno poll_request(tty_transfer_request *req);
+
+// Coroutine that runs until its first suspension when called
+struct detached_task {
+  struct promise_type {
+    detached_task get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
 
 TEST(TtyTransferParser, ParsesToken) {
   const char *input = "foo"
@@ -271,6 +316,332 @@ TEST(TtyTransferParser, IgnoresExtraCSI) {
   tty_transfer_parser_free(p);
 }
 
+TEST(TtyTransferParser, AcceptsBelTerminatedOsc) {
+  const char *input = "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\a"
+                      "\e[2;1R";
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+
+  int nused = tty_transfer_parser_feed(p, input, std::strlen(input));
+  EXPECT_EQ(nused, std::strlen(input));
+
+  const char *tok = tty_transfer_parser_token_for_key(p, UUID_KEY);
+  ASSERT_TRUE(tok);
+  EXPECT_STREQ(tok, UUID_VAL);
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferParser, SkipsOtherStringSequences) {
+  // Replies like DECRQSS and kitty graphics may arrive alongside the token
+  const char *input = "\eP1$r0;1R\e\\"
+                      "\e_Gi=1;OK\e\\"
+                      "\e(R"
+                      "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\"
+                      "\e[?1;2R";
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+
+  int nused = tty_transfer_parser_feed(p, input, std::strlen(input));
+  EXPECT_EQ(nused, std::strlen(input));
+
+  const char *tok = tty_transfer_parser_token_for_key(p, UUID_KEY);
+  ASSERT_TRUE(tok);
+  EXPECT_STREQ(tok, UUID_VAL);
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferParser, CancelAbandonsOsc) {
+  const char *input = "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\x18"
+                      "\e[2;1R";
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+
+  int nused = tty_transfer_parser_feed(p, input, std::strlen(input));
+  EXPECT_EQ(nused, std::strlen(input));
+  EXPECT_FALSE(tty_transfer_parser_token_for_key(p, UUID_KEY));
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferParser, ParsesTokenAfterHugeOsc) {
+  std::string input = "\e]52;c;" + std::string(1 << 20, 'Q') + "\a" +
+                      "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\"
+                      "\e[2;1R";
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+
+  int nused = tty_transfer_parser_feed(p, input.data(), input.size());
+  EXPECT_EQ(nused, input.size());
+  EXPECT_STREQ(tty_transfer_parser_token_for_key(p, UUID_KEY), UUID_VAL);
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferParser, ValidatesWholeOscAfterLongWhitespace) {
+  std::string token = "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL;
+  std::string spaces(200, ' ');
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+
+  std::string input = token + spaces + "\e\\\e[2;1R";
+  EXPECT_EQ(tty_transfer_parser_feed(p, input.data(), input.size()),
+            input.size());
+  EXPECT_STREQ(tty_transfer_parser_token_for_key(p, UUID_KEY), UUID_VAL);
+
+  tty_transfer_parser_reset(p);
+  input = token + spaces + "x\e\\\e[2;1R";
+  EXPECT_EQ(tty_transfer_parser_feed(p, input.data(), input.size()),
+            input.size());
+  EXPECT_FALSE(tty_transfer_parser_token_for_key(p, UUID_KEY));
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferOscMatcher, RejectsOnceThePrefixCannotMatch) {
+  tty_transfer_osc_matcher m;
+  tty_transfer_osc_matcher_reset(&m);
+
+  EXPECT_TRUE(tty_transfer_osc_matcher_put(&m, " 13", 3));
+  EXPECT_FALSE(tty_transfer_osc_matcher_put(&m, "5", 1));
+  EXPECT_EQ(m.field, tty_transfer_osc_reject);
+  EXPECT_FALSE(tty_transfer_osc_matcher_put(&m, ";IOToken=", 9));
+  EXPECT_EQ(tty_transfer_osc_matcher_finish(&m), TTY_TRANSFER_OSC_NONE);
+}
+
+TEST(TtyTransferOscMatcher, MatchesOneCharAtATime) {
+  std::string token = "1337; iotoken = " UUID_KEY " ; " UUID_VAL " ";
+  std::string request = "1337;RequestTransferIOToken=" UUID_KEY2;
+
+  tty_transfer_osc_matcher m;
+  tty_transfer_osc_matcher_reset(&m);
+  for (char c : token)
+    ASSERT_TRUE(tty_transfer_osc_matcher_put(&m, &c, 1)) << c;
+
+  ASSERT_EQ(tty_transfer_osc_matcher_finish(&m), TTY_TRANSFER_OSC_IO_TOKEN);
+  EXPECT_STREQ(m.key, UUID_KEY);
+  EXPECT_STREQ(m.val, UUID_VAL);
+
+  tty_transfer_osc_matcher_reset(&m);
+  for (char c : request)
+    ASSERT_TRUE(tty_transfer_osc_matcher_put(&m, &c, 1)) << c;
+
+  ASSERT_EQ(tty_transfer_osc_matcher_finish(&m), TTY_TRANSFER_OSC_REQUEST);
+  EXPECT_STREQ(m.key, UUID_KEY2);
+
+  // A request is not complete without its key
+  tty_transfer_osc_matcher_reset(&m);
+  ASSERT_TRUE(tty_transfer_osc_matcher_put(&m, request.data(), 30));
+  EXPECT_EQ(tty_transfer_osc_matcher_finish(&m), TTY_TRANSFER_OSC_NONE);
+}
+
+TEST(TtyTransferParser, BulkFeedMatchesByteAtATimeFeed) {
+  // Long runs of text, CSI parameters and OSC payload so that the vectorized
+  // scans cross several block boundaries at every alignment
+  std::string text(100, 'x');
+  std::string params(70, ';');
+  std::string payload(300, 'p');
+
+  for (int pad = 0; pad < 40; ++pad) {
+    std::string input = std::string(pad, 'a') + text +
+                        "\e[" + params + "1m" + text +
+                        "\e]52;c;" + payload + "\e\\" +
+                        "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\" +
+                        text + "\e[2;1R" + text;
+
+    tty_transfer_parser *bulk = tty_transfer_parser_alloc();
+    tty_transfer_parser *slow = tty_transfer_parser_alloc();
+
+    int nbulk = tty_transfer_parser_feed(bulk, input.data(), input.size());
+
+    int nslow = 0;
+    for (size_t i = 0; i < input.size() && !nslow; ++i) {
+      if (tty_transfer_parser_feed(slow, &input[i], 1))
+        nslow = i + 1;
+    }
+
+    EXPECT_EQ(nbulk, input.size() - text.size()) << "pad " << pad;
+    EXPECT_EQ(nbulk, nslow) << "pad " << pad;
+
+    const char *tok = tty_transfer_parser_token_for_key(bulk, UUID_KEY);
+    ASSERT_TRUE(tok) << "pad " << pad;
+    EXPECT_EQ(std::string{tok}, UUID_VAL);
+
+    tty_transfer_parser_free(slow);
+    tty_transfer_parser_free(bulk);
+  }
+}
+
+TEST(TtyTransferParser, InitializesInCallerStorage) {
+  const char *input = "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\"
+                      "\e[2;1R";
+
+  std::vector<std::max_align_t> storage(
+      tty_transfer_parser_sizeof() / sizeof(std::max_align_t) + 1);
+  ASSERT_LE(tty_transfer_parser_alignof(), alignof(std::max_align_t));
+
+  EXPECT_FALSE(tty_transfer_parser_init(storage.data(), 1));
+
+  tty_transfer_parser *p = tty_transfer_parser_init(
+      storage.data(), storage.size() * sizeof(std::max_align_t));
+  ASSERT_TRUE(p);
+
+  int nused = tty_transfer_parser_feed(p, input, std::strlen(input));
+  EXPECT_EQ(nused, std::strlen(input));
+
+  std::string tok = tty_transfer_parser_token_for_key(p, UUID_KEY);
+  EXPECT_EQ(tok, UUID_VAL);
+}
+
+TEST(TtyTransferParser, AllTokensModeKeepsEveryToken) {
+  const char *input = "foo"
+                      "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\"
+                      "\e]1337;AnothaOne\e\\"
+                      "\e]1337;IOToken=" UUID_KEY2 ";" UUID_KEY "\e\\"
+                      "\e[2;1R";
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+  tty_transfer_parser_set_mode(p, TTY_TRANSFER_PARSER_ALL_TOKENS);
+
+  int nused = tty_transfer_parser_feed(p, input, std::strlen(input));
+  EXPECT_EQ(nused, std::strlen(input));
+
+  const char *keys[] = {UUID_KEY_UPPER, UUID_VAL, UUID_KEY2};
+  const char *toks[3];
+  EXPECT_EQ(tty_transfer_parser_tokens_for_keys(p, keys, toks, 3), 2);
+
+  ASSERT_TRUE(toks[0]);
+  EXPECT_EQ(std::string{toks[0]}, UUID_VAL);
+  EXPECT_FALSE(toks[1]);
+  ASSERT_TRUE(toks[2]);
+  EXPECT_EQ(std::string{toks[2]}, UUID_KEY);
+
+  ASSERT_EQ(tty_transfer_parser_token_count(p), 2);
+  const char *key;
+  std::string tok = tty_transfer_parser_token_at(p, 1, &key);
+  EXPECT_EQ(std::string{key}, UUID_KEY2);
+  EXPECT_EQ(tok, UUID_KEY);
+
+  tty_transfer_parser_reset(p);
+  EXPECT_EQ(tty_transfer_parser_token_count(p), 0);
+  EXPECT_FALSE(tty_transfer_parser_token_for_key(p, UUID_KEY));
+
+  // mode survives reset
+  tty_transfer_parser_feed(p, input, std::strlen(input));
+  EXPECT_EQ(tty_transfer_parser_token_count(p), 2);
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferParser, AllTokensModeDropsKeysPastCapacity) {
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+  tty_transfer_parser_set_mode(p, TTY_TRANSFER_PARSER_ALL_TOKENS);
+
+  std::vector<std::string> keys;
+  for (int i = 0; i <= TTY_TRANSFER_PARSER_MAX_TOKENS; ++i) {
+    char key[TTY_TRANSFER_UUID_SIZE];
+    tty_transfer_uuid_generate(key, sizeof(key));
+    keys.emplace_back(key);
+
+    std::string seq = "\e]1337;IOToken=" + keys.back() + ";" UUID_VAL "\e\\";
+    EXPECT_EQ(tty_transfer_parser_feed(p, seq.data(), seq.size()), 0);
+  }
+
+  EXPECT_EQ(tty_transfer_parser_token_count(p), TTY_TRANSFER_PARSER_MAX_TOKENS);
+  EXPECT_TRUE(tty_transfer_parser_token_for_key(p, keys.front().c_str()));
+  EXPECT_FALSE(tty_transfer_parser_token_for_key(p, keys.back().c_str()));
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferParser, LooksUpTokenByBinaryKey) {
+  const char *input = "\e]1337;IOToken=" UUID_KEY_UPPER ";" UUID_VAL "\e\\"
+                      "\e[2;1R";
+
+  tty_transfer_uuid key, key2;
+  ASSERT_TRUE(tty_transfer_uuid_parse(UUID_KEY, &key));
+  ASSERT_TRUE(tty_transfer_uuid_parse(UUID_KEY2, &key2));
+
+  for (auto mode :
+       {TTY_TRANSFER_PARSER_LAST_TOKEN, TTY_TRANSFER_PARSER_ALL_TOKENS}) {
+    tty_transfer_parser *p = tty_transfer_parser_alloc();
+    tty_transfer_parser_set_mode(p, mode);
+    tty_transfer_parser_feed(p, input, std::strlen(input));
+
+    const tty_transfer_uuid *tok = tty_transfer_parser_token_for_uuid(p, &key);
+    ASSERT_TRUE(tok);
+
+    char tok_str[37];
+    tty_transfer_uuid_format(tok, tok_str);
+    EXPECT_EQ(std::string{tok_str}, UUID_VAL);
+
+    tty_transfer_uuid keys[] = {key2, key};
+    const tty_transfer_uuid *toks[2];
+    EXPECT_EQ(tty_transfer_parser_tokens_for_uuids(p, keys, toks, 2), 1);
+    EXPECT_FALSE(toks[0]);
+    EXPECT_EQ(toks[1], tok);
+
+    tty_transfer_parser_free(p);
+  }
+}
+
+TEST(TtyTransferUuid, RejectsMalformedUuids) {
+  tty_transfer_uuid uuid;
+  EXPECT_TRUE(tty_transfer_uuid_parse(UUID_KEY_UPPER, &uuid));
+  EXPECT_FALSE(tty_transfer_uuid_parse("", &uuid));
+  EXPECT_FALSE(tty_transfer_uuid_parse(UUID_KEY "0", &uuid));
+  EXPECT_FALSE(
+      tty_transfer_uuid_parse("68338148-030e-436c-89eb-9f905860f83", &uuid));
+  EXPECT_FALSE(
+      tty_transfer_uuid_parse("68338148-030e-436c-89eb_9f905860f83b", &uuid));
+  EXPECT_FALSE(
+      tty_transfer_uuid_parse("68338148-030g-436c-89eb-9f905860f83b", &uuid));
+}
+
+TEST(TtyTransferUuid, GeneratesDistinctVersion4Uuids) {
+  // More than one pool refill
+  constexpr size_t n = 100;
+  std::vector<char> bufs(n * TTY_TRANSFER_UUID_SIZE);
+  ASSERT_TRUE(tty_transfer_uuid_generate_batch(bufs.data(), n));
+
+  std::set<std::string> seen;
+  std::regex re("[[:xdigit:]]{8}-[[:xdigit:]]{4}-4[[:xdigit:]]{3}-[89ab]"
+                "[[:xdigit:]]{3}-[[:xdigit:]]{12}");
+  for (size_t i = 0; i < n; ++i) {
+    std::string uuid = &bufs[i * TTY_TRANSFER_UUID_SIZE];
+    EXPECT_TRUE(std::regex_match(uuid, re)) << uuid;
+    seen.insert(uuid);
+  }
+
+  EXPECT_EQ(seen.size(), n);
+}
+
+TEST(TtyTransferUuid, ForkedChildDoesNotRepeatParentUuids) {
+  char uuid[TTY_TRANSFER_UUID_SIZE];
+  ASSERT_TRUE(tty_transfer_uuid_generate(uuid, sizeof(uuid)));
+
+  int fds[2];
+  ASSERT_EQ(::pipe(fds), 0);
+
+  pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    tty_transfer_uuid_generate(uuid, sizeof(uuid));
+    ::write(fds[1], uuid, sizeof(uuid));
+    std::_Exit(0);
+  }
+
+  char child_uuid[TTY_TRANSFER_UUID_SIZE] = {0};
+  EXPECT_EQ(::read(fds[0], child_uuid, sizeof(child_uuid)), sizeof(uuid));
+  ::waitpid(pid, nullptr, 0);
+  ::close(fds[0]);
+  ::close(fds[1]);
+
+  ASSERT_TRUE(tty_transfer_uuid_generate(uuid, sizeof(uuid)));
+  EXPECT_NE(std::string{uuid}, std::string{child_uuid});
+}
+
 TEST(TtyTransferRequestIoToken, ParsesTokenWhenAvailable) {
   char host_token[TTY_TRANSFER_UUID_SIZE];
   tty_transfer_uuid_generate(host_token, TTY_TRANSFER_UUID_SIZE);
@@ -311,6 +682,1514 @@ TEST(TtyTransferRequestIoToken, ParsesTokenWhenAvailable) {
   }
 }
 
+TEST(TtyTransferRequest, CompletesFromCallerEventLoop) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  tty_transfer_request *req;
+  auto ret = tty_transfer_request_begin(slave, slave, 1000, &req);
+  ASSERT_EQ(ret, TTY_TRANSFER_IN_PROGRESS);
+
+  EXPECT_EQ(tty_transfer_request_fd(req), slave);
+  EXPECT_EQ(tty_transfer_request_events(req), TTY_TRANSFER_EVENT_WRITE);
+  EXPECT_EQ(tty_transfer_request_step(req, TTY_TRANSFER_EVENT_WRITE),
+            TTY_TRANSFER_IN_PROGRESS);
+  EXPECT_EQ(tty_transfer_request_events(req), TTY_TRANSFER_EVENT_READ);
+
+  auto key = request_key(read_until_csi6n(master));
+  send_token(master, key, UUID_VAL);
+
+  EXPECT_EQ(poll_request(req), TTY_TRANSFER_OK);
+
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_finish(req, token, sizeof(token)),
+            TTY_TRANSFER_OK);
+  EXPECT_EQ(std::string{token}, UUID_VAL);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferRequest, AcceptsBytesReadByCaller) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  tty_transfer_request *req;
+  ASSERT_EQ(tty_transfer_request_begin(slave, slave, 1000, &req),
+            TTY_TRANSFER_IN_PROGRESS);
+  tty_transfer_request_step(req, TTY_TRANSFER_EVENT_WRITE);
+
+  auto key = request_key(read_until_csi6n(master));
+  std::string reply = "\e]1337;IOToken=" + key + ";" UUID_VAL "\e\\\e[1;2R";
+
+  tty_transfer_errno ret = TTY_TRANSFER_IN_PROGRESS;
+  for (char c : reply) {
+    EXPECT_EQ(ret, TTY_TRANSFER_IN_PROGRESS);
+    ret = tty_transfer_request_feed(req, &c, 1);
+  }
+
+  EXPECT_EQ(ret, TTY_TRANSFER_OK);
+  EXPECT_EQ(tty_transfer_request_events(req), 0);
+
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_finish(req, token, sizeof(token)),
+            TTY_TRANSFER_OK);
+  EXPECT_EQ(std::string{token}, UUID_VAL);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferRequest, TimesOutWithoutReply) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  tty_transfer_request *req;
+  ASSERT_EQ(tty_transfer_request_begin(slave, slave, 20, &req),
+            TTY_TRANSFER_IN_PROGRESS);
+  EXPECT_LE(tty_transfer_request_timeout_ms(req), 20);
+
+  EXPECT_EQ(poll_request(req), TTY_TRANSFER_TIMEOUT);
+
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_finish(req, token, sizeof(token)),
+            TTY_TRANSFER_TIMEOUT);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferRequest, DoesNotWaitForOutputToDrain) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  // Nobody reads the master, so the output never drains
+  ASSERT_NE(::fcntl(slave, F_SETFL, O_NONBLOCK), -1);
+  char fill[1024] = {};
+  while (::write(slave, fill, sizeof(fill)) > 0)
+    ;
+  ASSERT_EQ(errno, EAGAIN);
+
+  pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    ::alarm(5);
+
+    tty_transfer_request *req;
+    if (tty_transfer_request_begin(slave, slave, 20, &req) !=
+        TTY_TRANSFER_IN_PROGRESS)
+      std::_Exit(1);
+
+    tty_transfer_request_finish(req, nullptr, 0);
+    std::_Exit(0);
+  }
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferRequest, RejectsNonTtyFds) {
+  int fds[2];
+  ASSERT_EQ(::pipe(fds), 0);
+
+  tty_transfer_request *req;
+  EXPECT_EQ(tty_transfer_request_begin(fds[0], fds[1], 20, &req),
+            TTY_TRANSFER_STDIN_NOT_TTY);
+  EXPECT_FALSE(req);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(TtyTransferRequestIoTokenEx, UsesGivenFds) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  std::thread responder{[&] {
+    auto key = request_key(read_until_csi6n(master));
+    send_token(master, key, UUID_VAL);
+  }};
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = opts.out_fd = slave;
+  opts.timeout_ms = 2000;
+
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_io_token_ex(&opts, token, sizeof(token)),
+            TTY_TRANSFER_OK);
+  EXPECT_EQ(std::string{token}, UUID_VAL);
+
+  responder.join();
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferRequestIoTokenEx, ReportsStats) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  std::thread responder{[&] {
+    auto key = request_key(read_until_csi6n(master));
+    send_token(master, key, UUID_VAL);
+  }};
+
+  tty_transfer_stats before;
+  tty_transfer_stats_snapshot(&before);
+
+  tty_transfer_request_stats stats;
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = opts.out_fd = slave;
+  opts.timeout_ms = 2000;
+  opts.stats = &stats;
+
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_io_token_ex(&opts, token, sizeof(token)),
+            TTY_TRANSFER_OK);
+
+  responder.join();
+  ::close(slave);
+  ::close(master);
+
+  EXPECT_GT(stats.written_ns, 0);
+  EXPECT_GE(stats.first_read_ns, stats.written_ns);
+  EXPECT_GE(stats.token_ns, stats.first_read_ns);
+  EXPECT_GE(stats.cpr_ns, stats.token_ns);
+  EXPECT_GE(stats.total_ns, stats.cpr_ns);
+  EXPECT_GE(stats.nreads, 1);
+  EXPECT_GE(stats.nsyscalls, 1);
+  EXPECT_EQ(stats.nosc, 1);
+  EXPECT_EQ(stats.ncsi, 1);
+
+  tty_transfer_stats after;
+  tty_transfer_stats_snapshot(&after);
+  EXPECT_EQ(after.nrequests - before.nrequests, 1);
+  EXPECT_EQ(after.nok - before.nok, 1);
+  EXPECT_EQ(after.nosc - before.nosc, 1);
+
+  uint64_t nbucketed = 0;
+  for (int i = 0; i < TTY_TRANSFER_STATS_BUCKETS; ++i)
+    nbucketed += after.total_us_log2[i] - before.total_us_log2[i];
+  EXPECT_EQ(nbucketed, 1);
+}
+
+TEST(TtyTransferRequestIoTokensEx, RequestsManyTokensInOneRoundTrip) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  int ncsi6n = 0;
+  std::thread responder{[&] {
+    auto out = read_until_csi6n(master);
+    for (auto pos = out.find("\e[6n"); pos != std::string::npos;
+         pos = out.find("\e[6n", pos + 1))
+      ++ncsi6n;
+
+    // Answer all but the last key
+    std::regex re("RequestTransferIOToken=(" UUID_RE ")");
+    std::vector<std::string> keys;
+    for (std::sregex_iterator it{out.begin(), out.end(), re}, end; it != end;
+         ++it)
+      keys.push_back((*it)[1].str());
+
+    std::ostringstream os;
+    for (size_t i = 0; i + 1 < keys.size(); ++i)
+      os << "\e]1337;IOToken=" << keys[i] << ';' << UUID_VAL << "\e\\";
+
+    os << "\e[1;2R";
+    auto data = os.str();
+    ::write(master, data.data(), data.size());
+  }};
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = opts.out_fd = slave;
+  opts.timeout_ms = 2000;
+
+  char tokens[3][TTY_TRANSFER_UUID_SIZE];
+  tty_transfer_errno results[3];
+  EXPECT_EQ(tty_transfer_request_io_tokens_ex(&opts, &tokens[0][0],
+                                              TTY_TRANSFER_UUID_SIZE, results,
+                                              3),
+            TTY_TRANSFER_NO_TOKEN);
+
+  responder.join();
+  ::close(slave);
+  ::close(master);
+
+  EXPECT_EQ(ncsi6n, 1);
+  EXPECT_EQ(results[0], TTY_TRANSFER_OK);
+  EXPECT_EQ(std::string{tokens[0]}, UUID_VAL);
+  EXPECT_EQ(results[1], TTY_TRANSFER_OK);
+  EXPECT_EQ(std::string{tokens[1]}, UUID_VAL);
+  EXPECT_EQ(results[2], TTY_TRANSFER_NO_TOKEN);
+}
+
+TEST(TtyTransferRequestIoTokenEx, OpensTtyPath) {
+  int master, slave;
+  char path[256];
+  ASSERT_EQ(openpty(&master, &slave, path, nullptr, nullptr), 0);
+
+  std::thread responder{[&] {
+    auto key = request_key(read_until_csi6n(master));
+    send_token(master, key, UUID_VAL);
+  }};
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.tty_path = path;
+  opts.timeout_ms = 2000;
+
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_io_token_ex(&opts, token, sizeof(token)),
+            TTY_TRANSFER_OK);
+  EXPECT_EQ(std::string{token}, UUID_VAL);
+
+  responder.join();
+
+  opts.tty_path = "/nonexistent/tty";
+  EXPECT_EQ(tty_transfer_request_io_token_ex(&opts, token, sizeof(token)),
+            TTY_TRANSFER_BAD_OPEN);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferRequestIoTokenEx, HonorsAbsoluteDeadline) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = opts.out_fd = slave;
+  clock_gettime(CLOCK_MONOTONIC, &opts.deadline);
+  opts.deadline.tv_nsec += 30000000;
+  if (opts.deadline.tv_nsec >= 1000000000) {
+    opts.deadline.tv_sec += 1;
+    opts.deadline.tv_nsec -= 1000000000;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_io_token_ex(&opts, token, sizeof(token)),
+            TTY_TRANSFER_TIMEOUT);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_GE(elapsed, std::chrono::milliseconds(25));
+  EXPECT_LT(elapsed, std::chrono::milliseconds(400));
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferRequestIoTokenEx, AbortsWhenCancelFdIsReadable) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  int cancel[2];
+  ASSERT_EQ(::pipe(cancel), 0);
+
+  std::thread canceler{[&] {
+    read_until_csi6n(master);
+    ::write(cancel[1], "x", 1);
+  }};
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = opts.out_fd = slave;
+  opts.timeout_ms = 5000;
+  opts.cancel_fd = cancel[0];
+
+  auto start = std::chrono::steady_clock::now();
+  char token[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_request_io_token_ex(&opts, token, sizeof(token)),
+            TTY_TRANSFER_CANCELED);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+
+  canceler.join();
+  ::close(cancel[0]);
+  ::close(cancel[1]);
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferSession, KeepsRawModeAcrossRequests) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  std::thread responder{[&] {
+    for (int i = 0; i < 3; ++i) {
+      auto key = request_key(read_until_csi6n(master));
+      send_token(master, key, UUID_VAL);
+    }
+  }};
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = opts.out_fd = slave;
+  opts.timeout_ms = 2000;
+
+  tty_transfer_session *session;
+  ASSERT_EQ(tty_transfer_session_open(&opts, TTY_TRANSFER_DRAIN_OUTPUT,
+                                      &session),
+            TTY_TRANSFER_OK);
+
+  struct termios tattr;
+  ::tcgetattr(slave, &tattr);
+  EXPECT_FALSE(tattr.c_lflag & ICANON);
+
+  for (int i = 0; i < 3; ++i) {
+    char token[TTY_TRANSFER_UUID_SIZE];
+    EXPECT_EQ(tty_transfer_session_request_io_token(session, token,
+                                                    sizeof(token)),
+              TTY_TRANSFER_OK);
+    EXPECT_EQ(std::string{token}, UUID_VAL);
+  }
+
+  tty_transfer_session_close(session);
+  responder.join();
+
+  ::tcgetattr(slave, &tattr);
+  EXPECT_TRUE(tattr.c_lflag & ICANON);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferSession, RestoresTtyWhenKilledBySignal) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    tty_transfer_request_options opts;
+    tty_transfer_request_options_init(&opts);
+    opts.in_fd = opts.out_fd = slave;
+
+    tty_transfer_session *session;
+    if (tty_transfer_session_open(&opts, TTY_TRANSFER_DRAIN_NONE, &session) !=
+        TTY_TRANSFER_OK)
+      std::_Exit(1);
+
+    std::raise(SIGTERM);
+    std::_Exit(2);
+  }
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFSIGNALED(status));
+  EXPECT_EQ(WTERMSIG(status), SIGTERM);
+
+  struct termios tattr;
+  ::tcgetattr(slave, &tattr);
+  EXPECT_TRUE(tattr.c_lflag & ICANON);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferCaps, FailsFastOnceTerminalIsKnownNotToReply) {
+  char dir[] = "/tmp/tty_transfer_capsXXXXXX";
+  ASSERT_TRUE(::mkdtemp(dir));
+
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  pid_t pid = ::fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0) {
+    // Only the controlling terminal of a session is cached
+    if (tty_transfer_caps_store(slave, TTY_TRANSFER_CAPS_SUPPORTED))
+      std::_Exit(1);
+
+    ::setsid();
+    if (::ioctl(slave, TIOCSCTTY, 0) == -1)
+      std::_Exit(2);
+
+    ::setenv("XDG_RUNTIME_DIR", dir, 1);
+    ::setenv("TERM", "tty-transfer-test", 1);
+    if (tty_transfer_caps_lookup(slave) != TTY_TRANSFER_CAPS_UNKNOWN)
+      std::_Exit(3);
+
+    tty_transfer_request_options opts;
+    tty_transfer_request_options_init(&opts);
+    opts.in_fd = opts.out_fd = slave;
+    opts.timeout_ms = 20;
+    opts.caps_mode = TTY_TRANSFER_CAPS_CACHE;
+
+    // A reply without a token says nothing about the terminal
+    char token[TTY_TRANSFER_UUID_SIZE];
+    const char cpr[] = "\e[1;1R";
+    if (::write(master, cpr, sizeof(cpr) - 1) != (ssize_t)sizeof(cpr) - 1 ||
+        tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+            TTY_TRANSFER_NO_TOKEN ||
+        tty_transfer_caps_lookup(slave) != TTY_TRANSFER_CAPS_UNKNOWN)
+      std::_Exit(11);
+
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+        TTY_TRANSFER_TIMEOUT)
+      std::_Exit(4);
+
+    if (tty_transfer_caps_lookup(slave) != TTY_TRANSFER_CAPS_UNSUPPORTED)
+      std::_Exit(5);
+
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+        TTY_TRANSFER_UNSUPPORTED)
+      std::_Exit(6);
+
+    opts.caps_mode = TTY_TRANSFER_CAPS_REFRESH;
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+        TTY_TRANSFER_TIMEOUT)
+      std::_Exit(7);
+
+    // Another TERM is another terminal
+    ::setenv("TERM", "tty-transfer-test-2", 1);
+    if (tty_transfer_caps_lookup(slave) != TTY_TRANSFER_CAPS_UNKNOWN)
+      std::_Exit(8);
+
+    ::setenv("TERM", "tty-transfer-test", 1);
+    if (!tty_transfer_caps_store(slave, TTY_TRANSFER_CAPS_SUPPORTED) ||
+        tty_transfer_caps_lookup(slave) != TTY_TRANSFER_CAPS_SUPPORTED)
+      std::_Exit(9);
+
+    if (!tty_transfer_caps_store(slave, TTY_TRANSFER_CAPS_UNKNOWN) ||
+        tty_transfer_caps_lookup(slave) != TTY_TRANSFER_CAPS_UNKNOWN)
+      std::_Exit(10);
+
+    // Expired entries are removed when they are looked up
+    if (!tty_transfer_caps_store(slave, TTY_TRANSFER_CAPS_SUPPORTED))
+      std::_Exit(12);
+
+    auto caps_dir = std::filesystem::path{dir} / "tty_transfer";
+    for (const auto &entry : std::filesystem::directory_iterator{caps_dir}) {
+      auto mtime = entry.last_write_time() - std::chrono::hours{2};
+      std::filesystem::last_write_time(entry.path(), mtime);
+    }
+
+    if (tty_transfer_caps_lookup(slave) != TTY_TRANSFER_CAPS_UNKNOWN ||
+        !std::filesystem::is_empty(caps_dir))
+      std::_Exit(13);
+
+    std::_Exit(0);
+  }
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  std::filesystem::remove_all(dir);
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferTokenCache, SharesOneRoundTripAcrossProcesses) {
+  char dir[] = "/tmp/tty_transfer_tokensXXXXXX";
+  ASSERT_TRUE(::mkdtemp(dir));
+
+  int pty_master;
+  pid_t pid = forkpty(&pty_master, nullptr, nullptr, nullptr);
+  ASSERT_NE(pid, -1);
+
+  if (pid == 0) {
+    ::setenv("XDG_RUNTIME_DIR", dir, 1);
+    ::setenv("TERM", "tty-transfer-test", 1);
+
+    tty_transfer_request_options opts;
+    tty_transfer_request_options_init(&opts);
+    opts.timeout_ms = 2000;
+    opts.token_cache_ms = 60000;
+
+    // Both processes start at once and only one writes a request
+    pid_t other = ::fork();
+
+    char token[TTY_TRANSFER_UUID_SIZE];
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+            TTY_TRANSFER_OK ||
+        std::strcmp(token, UUID_VAL) != 0)
+      std::_Exit(1);
+
+    if (other == 0)
+      std::_Exit(0);
+
+    int status;
+    if (::waitpid(other, &status, 0) != other || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0)
+      std::_Exit(2);
+
+    // The host does not reply again, so this must not make a round trip
+    opts.timeout_ms = 50;
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+            TTY_TRANSFER_OK ||
+        std::strcmp(token, UUID_VAL) != 0)
+      std::_Exit(3);
+
+    std::_Exit(0);
+  }
+
+  auto out = read_until_csi6n(pty_master);
+  auto key = request_key(out);
+  ASSERT_FALSE(key.empty()) << out;
+  send_token(pty_master, key, UUID_VAL);
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  std::filesystem::remove_all(dir);
+  ::close(pty_master);
+}
+
+TEST(TtyTransferTokenCache, WaitersDoNotOutlastTheirOwnDeadline) {
+  char dir[] = "/tmp/tty_transfer_tokensXXXXXX";
+  ASSERT_TRUE(::mkdtemp(dir));
+
+  int pty_master;
+  pid_t pid = forkpty(&pty_master, nullptr, nullptr, nullptr);
+  ASSERT_NE(pid, -1);
+
+  if (pid == 0) {
+    ::setenv("XDG_RUNTIME_DIR", dir, 1);
+    ::setenv("TERM", "tty-transfer-test", 1);
+
+    // Hold the lock like a writer that was stopped mid-request
+    tty_transfer_caps_key key;
+    char path[TTY_TRANSFER_CAPS_PATH_SIZE];
+    if (!tty_transfer_caps_key_init(&key, STDIN_FILENO) ||
+        !tty_transfer_caps_path(&key, "tokens", path, sizeof(path), 1))
+      std::_Exit(1);
+
+    int lock_fd = ::open(path, O_RDWR | O_CREAT, 0600);
+    if (lock_fd == -1 || ::flock(lock_fd, LOCK_EX) == -1)
+      std::_Exit(2);
+
+    tty_transfer_request_options opts;
+    tty_transfer_request_options_init(&opts);
+    opts.timeout_ms = 50;
+    opts.token_cache_ms = 60000;
+
+    char token[TTY_TRANSFER_UUID_SIZE];
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+        TTY_TRANSFER_TIMEOUT)
+      std::_Exit(3);
+
+    int cancel[2];
+    if (::pipe(cancel) == -1 || ::write(cancel[1], "x", 1) != 1)
+      std::_Exit(4);
+
+    opts.timeout_ms = 60000;
+    opts.cancel_fd = cancel[0];
+    if (tty_transfer_request_io_token_ex(&opts, token, sizeof(token)) !=
+        TTY_TRANSFER_CANCELED)
+      std::_Exit(5);
+
+    std::_Exit(0);
+  }
+
+  int status;
+  ASSERT_EQ(::waitpid(pid, &status, 0), pid);
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(WEXITSTATUS(status), 0);
+
+  std::filesystem::remove_all(dir);
+  ::close(pty_master);
+}
+
+TEST(TtyTransferBroker, RequestsTokensOnManyTtysConcurrently) {
+  const int n = 16;
+  int masters[n], slaves[n];
+  std::string host_tokens[n];
+
+  tty_transfer_broker *b = tty_transfer_broker_alloc(n + 2);
+  ASSERT_TRUE(b);
+
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(openpty(&masters[i], &slaves[i], nullptr, nullptr, nullptr), 0);
+    EXPECT_EQ(tty_transfer_broker_add(b, slaves[i], slaves[i], 2000), i);
+
+    char tok[TTY_TRANSFER_UUID_SIZE];
+    tty_transfer_uuid_generate(tok, sizeof(tok));
+    host_tokens[i] = tok;
+  }
+
+  // a tty that never replies and an fd that is not a tty
+  int silent_master, silent_slave;
+  ASSERT_EQ(openpty(&silent_master, &silent_slave, nullptr, nullptr, nullptr),
+            0);
+  int silent = tty_transfer_broker_add(b, silent_slave, silent_slave, 50);
+
+  int pipe_fds[2];
+  ASSERT_EQ(::pipe(pipe_fds), 0);
+  int not_tty = tty_transfer_broker_add(b, pipe_fds[0], pipe_fds[1], 50);
+
+  EXPECT_EQ(tty_transfer_broker_add(b, slaves[0], slaves[0], 50), -1)
+      << "Broker should be full";
+
+  std::thread responder{[&] {
+    for (int i = n - 1; i >= 0; --i) {
+      auto key = request_key(read_until_csi6n(masters[i]));
+      send_token(masters[i], key, host_tokens[i].c_str());
+    }
+  }};
+
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_EQ(tty_transfer_broker_run(b), TTY_TRANSFER_OK);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  responder.join();
+
+  EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+
+  for (int i = 0; i < n; ++i) {
+    char tok[TTY_TRANSFER_UUID_SIZE];
+    EXPECT_EQ(tty_transfer_broker_result(b, i, tok, sizeof(tok)),
+              TTY_TRANSFER_OK);
+    EXPECT_EQ(std::string{tok}, host_tokens[i]);
+  }
+
+  char tok[TTY_TRANSFER_UUID_SIZE];
+  EXPECT_EQ(tty_transfer_broker_result(b, silent, tok, sizeof(tok)),
+            TTY_TRANSFER_TIMEOUT);
+  EXPECT_EQ(tty_transfer_broker_result(b, not_tty, tok, sizeof(tok)),
+            TTY_TRANSFER_STDIN_NOT_TTY);
+
+  tty_transfer_broker_free(b);
+
+  for (int i = 0; i < n; ++i) {
+    ::close(slaves[i]);
+    ::close(masters[i]);
+  }
+
+  ::close(silent_slave);
+  ::close(silent_master);
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+}
+
+TEST(TtyTransferHpp, TransitionTablesMatchC) {
+  for (int b = 0; b < 256; ++b)
+    EXPECT_EQ(tty_transfer::detail::vt_classes[b], tty_transfer_vt_classes[b])
+        << "byte " << b;
+
+  for (int s = 0; s < vt_nstates; ++s) {
+    for (int c = 0; c < vt_nclasses; ++c) {
+      EXPECT_EQ(tty_transfer::detail::vt_transitions[s][c],
+                tty_transfer_vt_transitions[s][c])
+          << "state " << s << " class " << c;
+    }
+  }
+}
+
+TEST(TtyTransferHpp, ParserMatchesCParser) {
+  const char *inputs[] = {
+      "\e[999;888k\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\\e[2;1R",
+      "\e] 1337\t;\nIOToken  =\v" UUID_KEY "  ;\n" UUID_VAL "  \a\e[2;1R",
+      "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\\e]0;title\e\\\e[2;1R",
+      "\eP1$r0;1R\e\\\e]1337;iotoken=" UUID_KEY ";" UUID_VAL "\e\\\e[?1R",
+      "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\x18\e[2;1R",
+  };
+
+  for (const char *input : inputs) {
+    std::string_view in{input};
+
+    tty_transfer_parser *p = tty_transfer_parser_alloc();
+    tty_transfer::parser cpp;
+
+    // Split the input to exercise incremental parsing
+    std::size_t half = in.size() / 2;
+    EXPECT_EQ(cpp.feed(in.substr(0, half)), 0) << input;
+    EXPECT_EQ(cpp.feed(in.substr(half)), in.size() - half) << input;
+    EXPECT_EQ(tty_transfer_parser_feed(p, in.data(), in.size()), in.size());
+
+    const char *tok = tty_transfer_parser_token_for_key(p, UUID_KEY);
+    tty_transfer::token cpp_tok;
+    ASSERT_EQ(cpp.token_for(UUID_KEY, cpp_tok), tok != nullptr) << input;
+    if (tok) {
+      EXPECT_STREQ(cpp_tok.data(), tok);
+    }
+
+    tty_transfer_parser_free(p);
+  }
+}
+
+TEST(TtyTransferHpp, PolicyTracksManyKeys) {
+  tty_transfer::basic_parser<tty_transfer::all_tokens_parser_policy> p;
+
+  std::string input = "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\"
+                      "\e]0;title\a"
+                      "\e]1337;IOToken=" UUID_KEY2 ";" UUID_KEY "\e\\"
+                      "\e[2;1R";
+
+  EXPECT_EQ(p.feed(input), input.size());
+  EXPECT_EQ(p.token_count(), 2);
+  EXPECT_EQ(p.osc_count(), 3);
+  EXPECT_EQ(p.csi_count(), 1);
+
+  tty_transfer::token tok;
+  ASSERT_TRUE(p.token_for(UUID_KEY, tok));
+  EXPECT_STREQ(tok.data(), UUID_VAL);
+  ASSERT_TRUE(p.token_for(UUID_KEY2, tok));
+  EXPECT_STREQ(tok.data(), UUID_KEY);
+}
+
+struct strict_policy : tty_transfer::default_parser_policy {
+  static constexpr bool tolerate_whitespace = false;
+};
+
+TEST(TtyTransferHpp, PolicyRejectsWhitespace) {
+  tty_transfer::basic_parser<strict_policy> p;
+  tty_transfer::token tok;
+
+  std::string_view spaced = "\e]1337; IOToken=" UUID_KEY ";" UUID_VAL "\a";
+  p.feed(spaced);
+  EXPECT_FALSE(p.token_for(UUID_KEY, tok));
+
+  std::string_view exact = "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\a";
+  p.feed(exact);
+  EXPECT_TRUE(p.token_for(UUID_KEY, tok));
+}
+
+TEST(TtyTransferHpp, RequestRestoresTtyWhenDestroyed) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  termios before;
+  ASSERT_EQ(tcgetattr(slave, &before), 0);
+
+  tty_transfer_request_options opts;
+  tty_transfer_request_options_init(&opts);
+  opts.in_fd = slave;
+  opts.out_fd = slave;
+  opts.timeout_ms = 1000;
+
+  {
+    tty_transfer::request req;
+    ASSERT_EQ(req.begin(&opts), TTY_TRANSFER_IN_PROGRESS);
+    EXPECT_EQ(req.fd(), slave);
+    EXPECT_EQ(req.step(TTY_TRANSFER_EVENT_WRITE), TTY_TRANSFER_IN_PROGRESS);
+
+    termios raw;
+    ASSERT_EQ(tcgetattr(slave, &raw), 0);
+    EXPECT_FALSE(raw.c_lflag & ICANON);
+
+    // Abandoned without finish
+  }
+
+  termios after;
+  ASSERT_EQ(tcgetattr(slave, &after), 0);
+  EXPECT_EQ(after.c_lflag, before.c_lflag);
+
+  ::close(slave);
+  ::close(master);
+}
+
+#define HOST_REQ(key) "\e]1337;RequestTransferIOToken=" key
+
+static std::vector<tty_transfer_host_request>
+scan_all(tty_transfer_host_scanner *s, std::string_view in, size_t chunk) {
+  std::vector<tty_transfer_host_request> out;
+  for (size_t i = 0; i < in.size(); i += chunk) {
+    auto part = in.substr(i, chunk);
+    tty_transfer_host_request reqs[4];
+    size_t n;
+    EXPECT_EQ(tty_transfer_host_scanner_feed(s, part.data(), part.size(), reqs,
+                                             4, &n),
+              part.size());
+    out.insert(out.end(), reqs, reqs + n);
+  }
+
+  return out;
+}
+
+TEST(TtyTransferHostScanner, FindsRequestsAtEveryChunking) {
+  std::string head = "hello \e[1m";
+  std::string req1 = HOST_REQ(UUID_KEY) "\e\\";
+  std::string mid = "\e]0;title\a\e";
+  std::string req2 = HOST_REQ(UUID_KEY2) "\a";
+  std::string input = head + req1 + mid + req2 + "\e[6n";
+
+  for (size_t chunk = 1; chunk <= input.size(); ++chunk) {
+    tty_transfer_host_scanner *s = tty_transfer_host_scanner_alloc();
+
+    auto reqs = scan_all(s, input, chunk);
+    ASSERT_EQ(reqs.size(), 2) << "chunk " << chunk;
+
+    EXPECT_EQ(reqs[0].start, head.size());
+    EXPECT_EQ(reqs[0].end, head.size() + req1.size());
+    EXPECT_STREQ(reqs[0].key, UUID_KEY);
+
+    // A stray ESC right before the request does not hide it
+    EXPECT_EQ(reqs[1].start, reqs[0].end + mid.size());
+    EXPECT_EQ(reqs[1].end, reqs[1].start + req2.size());
+    EXPECT_STREQ(reqs[1].key, UUID_KEY2);
+
+    EXPECT_EQ(tty_transfer_host_scanner_safe_offset(s), input.size());
+    tty_transfer_host_scanner_free(s);
+  }
+}
+
+TEST(TtyTransferHostScanner, HoldsBackPartialRequest) {
+  tty_transfer_host_scanner *s = tty_transfer_host_scanner_alloc();
+
+  std::string text = "text";
+  std::string partial = HOST_REQ("68338148-030e");
+  std::string input = text + partial;
+  EXPECT_TRUE(scan_all(s, input, input.size()).empty());
+  EXPECT_EQ(tty_transfer_host_scanner_safe_offset(s), text.size());
+
+  // A malformed key releases the held bytes
+  EXPECT_TRUE(scan_all(s, "zz", 2).empty());
+  EXPECT_EQ(tty_transfer_host_scanner_safe_offset(s), input.size() + 2);
+
+  tty_transfer_host_scanner_free(s);
+}
+
+TEST(TtyTransferHostScanner, StopsWhenRequestsAreFull) {
+  tty_transfer_host_scanner *s = tty_transfer_host_scanner_alloc();
+
+  std::string req = HOST_REQ(UUID_KEY) "\e\\";
+  std::string input = req + req;
+
+  tty_transfer_host_request out;
+  size_t n;
+  size_t used = tty_transfer_host_scanner_feed(s, input.data(), input.size(),
+                                               &out, 1, &n);
+  EXPECT_EQ(used, req.size());
+  EXPECT_EQ(n, 1);
+
+  used = tty_transfer_host_scanner_feed(s, &input[used], input.size() - used,
+                                        &out, 1, &n);
+  EXPECT_EQ(used, req.size());
+  ASSERT_EQ(n, 1);
+  EXPECT_EQ(out.start, req.size());
+
+  tty_transfer_host_scanner_free(s);
+}
+
+TEST(TtyTransferHostScanner, FormatsReplyForClientParser) {
+  char reply[128];
+  size_t len = tty_transfer_host_format_reply(UUID_KEY, UUID_VAL, reply, 128);
+  ASSERT_GT(len, 0);
+  EXPECT_EQ(len, std::strlen(reply));
+  EXPECT_EQ(tty_transfer_host_format_reply(UUID_KEY, UUID_VAL, reply, len), 0);
+
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+  tty_transfer_host_format_reply(UUID_KEY, UUID_VAL, reply, sizeof(reply));
+  EXPECT_EQ(tty_transfer_parser_feed(p, reply, len), 0);
+  EXPECT_GT(tty_transfer_parser_feed(p, "\e[1;1R", 6), 0);
+
+  const char *tok = tty_transfer_parser_token_for_key(p, UUID_KEY);
+  ASSERT_TRUE(tok);
+  EXPECT_STREQ(tok, UUID_VAL);
+
+  tty_transfer_parser_free(p);
+}
+
+TEST(TtyTransferRegistry, ResolvesMintedTokens) {
+  tty_transfer_registry *r = tty_transfer_registry_alloc(1000);
+  ASSERT_TRUE(r);
+
+  std::vector<tty_transfer_uuid> tokens(1000);
+  for (uint64_t i = 0; i < tokens.size(); ++i) {
+    ASSERT_EQ(tty_transfer_registry_mint(r, i, 60000, &tokens[i]),
+              TTY_TRANSFER_OK);
+  }
+
+  EXPECT_EQ(tty_transfer_registry_size(r), 1000);
+
+  // Bounded by capacity
+  tty_transfer_uuid extra;
+  EXPECT_EQ(tty_transfer_registry_mint(r, 0, 60000, &extra), TTY_TRANSFER_FULL);
+
+  for (uint64_t i = 0; i < tokens.size(); ++i) {
+    uint64_t value;
+    ASSERT_TRUE(tty_transfer_registry_lookup(r, &tokens[i], &value));
+    EXPECT_EQ(value, i);
+  }
+
+  uint64_t value;
+  EXPECT_TRUE(tty_transfer_registry_take(r, &tokens[7], &value));
+  EXPECT_EQ(value, 7);
+  EXPECT_FALSE(tty_transfer_registry_lookup(r, &tokens[7], &value));
+  EXPECT_FALSE(tty_transfer_registry_take(r, &tokens[7], &value));
+  EXPECT_EQ(tty_transfer_registry_size(r), 999);
+
+  tty_transfer_registry_free(r);
+}
+
+TEST(TtyTransferRegistry, ExpiresTokens) {
+  tty_transfer_registry *r = tty_transfer_registry_alloc(4);
+  ASSERT_TRUE(r);
+
+  tty_transfer_uuid short_lived, long_lived;
+  ASSERT_EQ(tty_transfer_registry_mint(r, 1, 20, &short_lived),
+            TTY_TRANSFER_OK);
+  ASSERT_EQ(tty_transfer_registry_mint(r, 2, 60000, &long_lived),
+            TTY_TRANSFER_OK);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds{60});
+
+  EXPECT_FALSE(tty_transfer_registry_lookup(r, &short_lived, nullptr));
+  EXPECT_TRUE(tty_transfer_registry_lookup(r, &long_lived, nullptr));
+
+  EXPECT_EQ(tty_transfer_registry_expire(r), 1);
+  EXPECT_EQ(tty_transfer_registry_size(r), 1);
+
+  // Reinserting a token refreshes it instead of adding another
+  ASSERT_EQ(tty_transfer_registry_insert(r, &long_lived, 3, 60000),
+            TTY_TRANSFER_OK);
+  uint64_t value;
+  ASSERT_TRUE(tty_transfer_registry_lookup(r, &long_lived, &value));
+  EXPECT_EQ(value, 3);
+  EXPECT_EQ(tty_transfer_registry_size(r), 1);
+
+  tty_transfer_registry_free(r);
+}
+
+TEST(TtyTransferRegistry, HandlesConcurrentMintAndLookup) {
+  tty_transfer_registry *r = tty_transfer_registry_alloc(8 * 1000);
+  ASSERT_TRUE(r);
+
+  std::vector<std::thread> threads;
+  std::atomic<int> nfailed{0};
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      std::vector<tty_transfer_uuid> tokens(1000);
+      for (uint64_t i = 0; i < tokens.size(); ++i) {
+        uint64_t value = t * 1000 + i;
+        if (tty_transfer_registry_mint(r, value, 60000, &tokens[i]))
+          ++nfailed;
+      }
+
+      for (uint64_t i = 0; i < tokens.size(); ++i) {
+        uint64_t value;
+        if (!tty_transfer_registry_lookup(r, &tokens[i], &value) ||
+            value != t * 1000 + i)
+          ++nfailed;
+      }
+    });
+  }
+
+  for (auto &th : threads)
+    th.join();
+
+  EXPECT_EQ(nfailed, 0);
+  EXPECT_EQ(tty_transfer_registry_size(r), 8 * 1000);
+  tty_transfer_registry_free(r);
+}
+
+// Grants the fd stored as the token's registry value, once
+static int resolve_from_registry(void *ctx, const tty_transfer_uuid *token,
+                                 int *fds, size_t max_fds, size_t *nfds) {
+  uint64_t value;
+  if (max_fds == 0 ||
+      !tty_transfer_registry_take(static_cast<tty_transfer_registry *>(ctx),
+                                  token, &value))
+    return 0;
+
+  fds[0] = static_cast<int>(value);
+  *nfds = 1;
+  return 1;
+}
+
+TEST(TtyTransferHandoff, PassesFdsForValidToken) {
+  int pipe_fds[2];
+  ASSERT_EQ(::pipe(pipe_fds), 0);
+
+  tty_transfer_registry *r = tty_transfer_registry_alloc(4);
+  tty_transfer_uuid token;
+  ASSERT_EQ(tty_transfer_registry_mint(r, pipe_fds[1], 60000, &token),
+            TTY_TRANSFER_OK);
+  char token_str[TTY_TRANSFER_UUID_SIZE];
+  tty_transfer_uuid_format(&token, token_str);
+
+  int sv[2];
+  ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+  tty_transfer_errno served;
+  std::thread host{[&] {
+    served = tty_transfer_handoff_serve(sv[0], resolve_from_registry, r);
+  }};
+
+  int fds[2];
+  size_t nfds;
+  EXPECT_EQ(tty_transfer_handoff_redeem_fd(sv[1], token_str, fds, 2, &nfds),
+            TTY_TRANSFER_OK);
+  host.join();
+  EXPECT_EQ(served, TTY_TRANSFER_OK);
+  ASSERT_EQ(nfds, 1);
+
+  // The received fd is the pipe itself, so no relay is needed
+  ASSERT_EQ(::write(fds[0], "hi", 2), 2);
+  char buf[2];
+  ASSERT_EQ(::read(pipe_fds[0], buf, 2), 2);
+  EXPECT_EQ(std::string(buf, 2), "hi");
+  ::close(fds[0]);
+
+  // Tokens are single use
+  host = std::thread{[&] {
+    served = tty_transfer_handoff_serve(sv[0], resolve_from_registry, r);
+  }};
+  EXPECT_EQ(tty_transfer_handoff_redeem_fd(sv[1], token_str, fds, 2, &nfds),
+            TTY_TRANSFER_REJECTED);
+  host.join();
+  EXPECT_EQ(served, TTY_TRANSFER_REJECTED);
+  EXPECT_EQ(nfds, 0);
+
+  ::close(sv[0]);
+  ::close(sv[1]);
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+  tty_transfer_registry_free(r);
+}
+
+#if defined(__linux__)
+TEST(TtyTransferHandoff, RedeemsOverAbstractSocket) {
+  std::string path = "@tty_transfer_test_" + std::to_string(::getpid());
+
+  int listen_fd;
+  ASSERT_EQ(tty_transfer_handoff_listen(path.c_str(), &listen_fd),
+            TTY_TRANSFER_OK);
+
+  int pipe_fds[2];
+  ASSERT_EQ(::pipe(pipe_fds), 0);
+
+  tty_transfer_registry *r = tty_transfer_registry_alloc(4);
+  tty_transfer_uuid token;
+  ASSERT_EQ(tty_transfer_registry_mint(r, pipe_fds[0], 60000, &token),
+            TTY_TRANSFER_OK);
+  char token_str[TTY_TRANSFER_UUID_SIZE];
+  tty_transfer_uuid_format(&token, token_str);
+
+  std::thread host{[&] {
+    int conn = ::accept(listen_fd, nullptr, nullptr);
+    tty_transfer_handoff_serve(conn, resolve_from_registry, r);
+    ::close(conn);
+  }};
+
+  int fd;
+  size_t nfds;
+  EXPECT_EQ(tty_transfer_handoff_redeem(path.c_str(), token_str, &fd, 1,
+                                        &nfds),
+            TTY_TRANSFER_OK);
+  host.join();
+  ASSERT_EQ(nfds, 1);
+
+  ASSERT_EQ(::write(pipe_fds[1], "ok", 2), 2);
+  char buf[2];
+  ASSERT_EQ(::read(fd, buf, 2), 2);
+  EXPECT_EQ(std::string(buf, 2), "ok");
+
+  ::close(fd);
+  ::close(listen_fd);
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+  tty_transfer_registry_free(r);
+}
+#endif
+
+#if defined(__linux__)
+detached_task await_token(tty_transfer::reactor &r, int fd, int timeout_ms,
+                          tty_transfer::token_result &out) {
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds{timeout_ms};
+  out = co_await tty_transfer::request_token(r, fd, deadline);
+}
+
+TEST(TtyTransferCoro, ResumesWithTokens) {
+  int master[2], slave[2];
+  for (int i = 0; i < 2; ++i)
+    ASSERT_EQ(openpty(&master[i], &slave[i], nullptr, nullptr, nullptr), 0);
+
+  std::thread responder{[&] {
+    for (int i = 0; i < 2; ++i) {
+      auto key = request_key(read_until_csi6n(master[i]));
+      send_token(master[i], key, i ? UUID_KEY : UUID_VAL);
+    }
+  }};
+
+  tty_transfer::epoll_reactor r;
+  ASSERT_TRUE(r);
+
+  tty_transfer::token_result results[2];
+  for (int i = 0; i < 2; ++i)
+    await_token(r, slave[i], 2000, results[i]);
+
+  // Both requests suspend on the reactor instead of blocking
+  EXPECT_EQ(r.pending(), 2);
+  EXPECT_TRUE(r.run());
+  responder.join();
+
+  EXPECT_EQ(results[0].error, TTY_TRANSFER_OK);
+  EXPECT_STREQ(results[0].value.data(), UUID_VAL);
+  EXPECT_EQ(results[1].error, TTY_TRANSFER_OK);
+  EXPECT_STREQ(results[1].value.data(), UUID_KEY);
+
+  for (int i = 0; i < 2; ++i) {
+    ::close(slave[i]);
+    ::close(master[i]);
+  }
+}
+
+TEST(TtyTransferCoro, ResumesWithTimeout) {
+  int master, slave;
+  ASSERT_EQ(openpty(&master, &slave, nullptr, nullptr, nullptr), 0);
+
+  tty_transfer::epoll_reactor r;
+  tty_transfer::token_result result;
+  await_token(r, slave, 50, result);
+
+  EXPECT_EQ(result.error, TTY_TRANSFER_IN_PROGRESS);
+  EXPECT_TRUE(r.run());
+  EXPECT_EQ(result.error, TTY_TRANSFER_TIMEOUT);
+
+  ::close(slave);
+  ::close(master);
+}
+
+TEST(TtyTransferCoro, CompletesWithoutSuspendingOnError) {
+  tty_transfer::epoll_reactor r;
+  tty_transfer::token_result result;
+
+  int fds[2];
+  ASSERT_EQ(::pipe(fds), 0);
+  await_token(r, fds[0], 50, result);
+
+  EXPECT_EQ(r.pending(), 0);
+  EXPECT_NE(result.error, TTY_TRANSFER_OK);
+  EXPECT_NE(result.error, TTY_TRANSFER_IN_PROGRESS);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+#endif
+
+static std::vector<tty_transfer_transcript_event>
+scan_transcript(const std::string &in, size_t nthreads) {
+  tty_transfer_transcript_event *events;
+  size_t n;
+  EXPECT_EQ(tty_transfer_transcript_scan(in.data(), in.size(), nthreads,
+                                         &events, &n),
+            TTY_TRANSFER_OK);
+
+  std::vector<tty_transfer_transcript_event> out{events, events + n};
+  tty_transfer_transcript_events_free(events);
+  return out;
+}
+
+static void expect_same_events(
+    const std::vector<tty_transfer_transcript_event> &actual,
+    const std::vector<tty_transfer_transcript_event> &expected) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < actual.size(); ++i) {
+    const auto &a = actual[i], &e = expected[i];
+    EXPECT_EQ(a.type, e.type) << "event " << i;
+    EXPECT_EQ(a.start, e.start) << "event " << i;
+    EXPECT_EQ(a.end, e.end) << "event " << i;
+    EXPECT_EQ(std::memcmp(&a.key, &e.key, sizeof(a.key)), 0) << "event " << i;
+    EXPECT_EQ(std::memcmp(&a.val, &e.val, sizeof(a.val)), 0) << "event " << i;
+  }
+}
+
+TEST(TtyTransferTranscript, ParallelScanFindsEveryEvent) {
+  const char *uuids[] = {UUID_KEY, UUID_KEY_UPPER, UUID_KEY2, UUID_VAL};
+  std::mt19937 rng{1234};
+  std::string in;
+  std::vector<tty_transfer_transcript_event> expected;
+
+  auto add = [&](tty_transfer_transcript_event_type type,
+                 const std::string &seq, const char *key, const char *val) {
+    tty_transfer_transcript_event e{};
+    e.type = type;
+    e.start = in.size();
+    e.end = in.size() + seq.size();
+    if (key) {
+      ASSERT_TRUE(tty_transfer_uuid_parse(key, &e.key));
+    }
+    if (val) {
+      ASSERT_TRUE(tty_transfer_uuid_parse(val, &e.val));
+    }
+
+    expected.push_back(e);
+    in += seq;
+  };
+
+  while (in.size() < 2 * 1024 * 1024) {
+    const char *key = uuids[rng() % 4];
+    const char *val = uuids[rng() % 4];
+    const char *st = rng() % 2 ? "\e\\" : "\a";
+
+    switch (rng() % 9) {
+    case 0:
+      in.append(rng() % 200, 'a' + rng() % 26);
+      break;
+    case 1:
+      in += "\e[1;31m";
+      break;
+    case 2:
+      add(TTY_TRANSFER_TRANSCRIPT_TOKEN,
+          std::string{"\e]1337;IOToken="} + key + ";" + val + st, key, val);
+      break;
+    case 3:
+      add(TTY_TRANSFER_TRANSCRIPT_REQUEST,
+          std::string{"\e]1337;RequestTransferIOToken="} + key + st, key,
+          nullptr);
+      break;
+    case 4:
+      add(TTY_TRANSFER_TRANSCRIPT_CPR, "\e[12;40R", nullptr, nullptr);
+      break;
+    case 5:
+      // Longer than the OSC buffer
+      in += "\e]0;" + std::string(rng() % 600, 'T') + st;
+      break;
+    case 6:
+      in += "\eP1$r0m\e\\";
+      break;
+    case 7:
+      in += "\ex";
+      break;
+    case 8:
+      // Trailing garbage makes the token invalid
+      in += std::string{"\e]1337;IOToken="} + key + ";" + val +
+            std::string(200, 'z') + st;
+      break;
+    }
+  }
+
+  for (size_t nthreads : {1, 2, 3, 4, 7, 8}) {
+    SCOPED_TRACE(nthreads);
+    expect_same_events(scan_transcript(in, nthreads), expected);
+  }
+}
+
+TEST(TtyTransferTranscript, ResyncsChunkSplitInsideOsc) {
+  std::string token = "\e]1337;IOToken=" UUID_KEY ";" UUID_VAL "\e\\";
+  std::string cpr = "\e[1;2R";
+
+  // Two chunks split at the ST of the token, which looks like the start of
+  // a sequence to the second chunk
+  size_t pad = 300000;
+  std::string in = std::string(pad, 'x') + token;
+  in += std::string(pad + token.size() - 40 - cpr.size(), 'y') + cpr;
+  ASSERT_GT(in.size() / 2, pad);
+  ASSERT_LT(in.size() / 2, pad + token.size() - 2);
+
+  auto events = scan_transcript(in, 2);
+  ASSERT_EQ(events.size(), 2);
+
+  EXPECT_EQ(events[0].type, TTY_TRANSFER_TRANSCRIPT_TOKEN);
+  EXPECT_EQ(events[0].start, pad);
+  EXPECT_EQ(events[0].end, pad + token.size());
+
+  char key[TTY_TRANSFER_UUID_SIZE], val[TTY_TRANSFER_UUID_SIZE];
+  tty_transfer_uuid_format(&events[0].key, key);
+  tty_transfer_uuid_format(&events[0].val, val);
+  EXPECT_STREQ(key, UUID_KEY);
+  EXPECT_STREQ(val, UUID_VAL);
+
+  // Same as one sequential pass of the parser
+  tty_transfer_parser *p = tty_transfer_parser_alloc();
+  EXPECT_EQ(tty_transfer_parser_feed(p, in.data(), in.size()), in.size());
+  EXPECT_STREQ(tty_transfer_parser_token_for_key(p, UUID_KEY), UUID_VAL);
+  tty_transfer_parser_free(p);
+
+  EXPECT_EQ(events[1].type, TTY_TRANSFER_TRANSCRIPT_CPR);
+  EXPECT_EQ(events[1].start, in.size() - cpr.size());
+  EXPECT_EQ(events[1].end, in.size());
+}
+
+TEST(TtyTransferTranscript, ScansFile) {
+  char path[] = "/tmp/tty_transfer_transcriptXXXXXX";
+  int fd = ::mkstemp(path);
+  ASSERT_NE(fd, -1);
+
+  std::string in = "$ ls\r\n\e]1337;RequestTransferIOToken=" UUID_KEY "\a";
+  ASSERT_EQ(::write(fd, in.data(), in.size()), in.size());
+  ::close(fd);
+
+  tty_transfer_transcript_event *events;
+  size_t n;
+  EXPECT_EQ(tty_transfer_transcript_scan_file(path, 0, &events, &n),
+            TTY_TRANSFER_OK);
+  ::unlink(path);
+
+  ASSERT_EQ(n, 1);
+  EXPECT_EQ(events[0].type, TTY_TRANSFER_TRANSCRIPT_REQUEST);
+  EXPECT_EQ(events[0].start, 6);
+  EXPECT_EQ(events[0].end, in.size());
+  tty_transfer_transcript_events_free(events);
+
+  EXPECT_EQ(tty_transfer_transcript_scan_file(path, 0, &events, &n),
+            TTY_TRANSFER_BAD_OPEN);
+}
+
+TEST(TtyTransferParserPool, MatchesTranscriptScanOfEachStream) {
+  const char *uuids[] = {UUID_KEY, UUID_KEY_UPPER, UUID_KEY2, UUID_VAL};
+  const size_t nstreams = 5;
+  std::mt19937 rng{4321};
+
+  // Token traffic in each stream with sequences that abandon OSC strings
+  std::string streams[nstreams];
+  for (auto &in : streams) {
+    while (in.size() < 64 * 1024) {
+      const char *key = uuids[rng() % 4];
+      const char *st = rng() % 2 ? "\e\\" : "\a";
+
+      switch (rng() % 7) {
+      case 0:
+        in.append(rng() % 200, 'a' + rng() % 26);
+        break;
+      case 1:
+        in += std::string{"\e]1337;IOToken="} + key + ";" UUID_VAL + st;
+        break;
+      case 2:
+        in += std::string{"\e]1337;RequestTransferIOToken="} + key + st;
+        break;
+      case 3:
+        in += "\e[12;40R";
+        break;
+      case 4:
+        in += "\e]0;" + std::string(rng() % 600, 'T') + st;
+        break;
+      case 5:
+        // Abandoned by CAN and by a new sequence
+        in += std::string{"\e]1337;IOToken="} + key + "\x18";
+        in += "\e]1337;RequestTransferIOToken=\e[0m";
+        break;
+      case 6:
+        in += "\eP1$r0m\e\\";
+        break;
+      }
+    }
+  }
+
+  tty_transfer_parser_pool *p = tty_transfer_parser_pool_alloc(nstreams);
+  ASSERT_TRUE(p);
+
+  // Feed chunks of every stream in small batches, with too few events to
+  // hold a batch's worth so that feeding is resumed
+  std::vector<tty_transfer_transcript_event> actual[nstreams];
+  size_t offsets[nstreams] = {};
+  tty_transfer_parser_pool_event events[3];
+
+  while (true) {
+    std::vector<tty_transfer_parser_pool_input> batch;
+    std::vector<uint64_t> starts;
+    for (size_t i = 0; i < 8; ++i) {
+      uint32_t s = rng() % nstreams;
+      size_t n = std::min<size_t>(1 + rng() % 300,
+                                  streams[s].size() - offsets[s]);
+      if (!n)
+        continue;
+
+      batch.push_back({s, streams[s].data() + offsets[s], n});
+      starts.push_back(offsets[s]);
+      offsets[s] += n;
+    }
+
+    if (batch.empty())
+      break;
+
+    size_t next = 0;
+    while (next < batch.size()) {
+      size_t n;
+      auto ret = tty_transfer_parser_pool_feed(p, &batch[next],
+                                               batch.size() - next, events,
+                                               std::size(events), &n);
+      ASSERT_NE(ret, TTY_TRANSFER_BAD_ALLOC);
+
+      for (size_t i = 0; i < n; ++i) {
+        const auto &pe = events[i];
+        size_t k = next + pe.input;
+
+        tty_transfer_transcript_event e{};
+        e.type = static_cast<tty_transfer_transcript_event_type>(pe.type);
+        e.end = starts[k] + pe.end;
+        e.key = pe.key;
+        e.val = pe.val;
+        actual[pe.stream].push_back(e);
+      }
+
+      if (ret == TTY_TRANSFER_OK)
+        break;
+
+      ASSERT_EQ(ret, TTY_TRANSFER_FULL);
+      ASSERT_EQ(n, std::size(events));
+
+      // Resume right after the last event
+      const auto &last = events[n - 1];
+      next += last.input;
+      auto &in = batch[next];
+      starts[next] += last.end;
+      in.bytes = static_cast<const char *>(in.bytes) + last.end;
+      in.nbytes -= last.end;
+    }
+  }
+
+  tty_transfer_parser_pool_free(p);
+
+  for (size_t s = 0; s < nstreams; ++s) {
+    SCOPED_TRACE(s);
+    auto expected = scan_transcript(streams[s], 1);
+    ASSERT_GT(expected.size(), 0);
+
+    // The pool reports where sequences end, not where they start
+    for (auto &e : expected)
+      e.start = 0;
+
+    expect_same_events(actual[s], expected);
+  }
+}
+
+TEST(TtyTransferParserPool, ResetDiscardsUnfinishedSequence) {
+  tty_transfer_parser_pool *p = tty_transfer_parser_pool_alloc(2);
+  ASSERT_TRUE(p);
+
+  std::string head = "\e]1337;IOToken=" UUID_KEY;
+  std::string tail = ";" UUID_VAL "\a";
+  tty_transfer_parser_pool_input inputs[] = {
+      {0, head.data(), head.size()},
+      {1, head.data(), head.size()},
+      {7, tail.data(), tail.size()},
+  };
+
+  tty_transfer_parser_pool_event events[4];
+  size_t n;
+  EXPECT_EQ(tty_transfer_parser_pool_feed(p, inputs, std::size(inputs),
+                                          events, std::size(events), &n),
+            TTY_TRANSFER_OK);
+  EXPECT_EQ(n, 0);
+
+  tty_transfer_parser_pool_reset(p, 0);
+
+  inputs[0] = {0, tail.data(), tail.size()};
+  inputs[1] = {1, tail.data(), tail.size()};
+  EXPECT_EQ(tty_transfer_parser_pool_feed(p, inputs, 2, events,
+                                          std::size(events), &n),
+            TTY_TRANSFER_OK);
+
+  ASSERT_EQ(n, 1);
+  EXPECT_EQ(events[0].type, TTY_TRANSFER_PARSER_POOL_TOKEN);
+  EXPECT_EQ(events[0].stream, 1);
+  EXPECT_EQ(events[0].input, 1);
+  EXPECT_EQ(events[0].end, tail.size());
+
+  char key[TTY_TRANSFER_UUID_SIZE], val[TTY_TRANSFER_UUID_SIZE];
+  tty_transfer_uuid_format(&events[0].key, key);
+  tty_transfer_uuid_format(&events[0].val, val);
+  EXPECT_STREQ(key, UUID_KEY);
+  EXPECT_STREQ(val, UUID_VAL);
+
+  tty_transfer_parser_pool_free(p);
+}
+
 std::string read_until_csi6n(int fd) {
   std::string csi6n = "\e[6n";
   char buf[256];
@@ -342,3 +2221,31 @@ void send_token(int fd, const std::string &token_key, const char *token_val) {
   auto data = os.str();
   ::write(fd, data.data(), data.size());
 }
+
+std::string request_key(const std::string &out) {
+  std::regex re("RequestTransferIOToken=(" UUID_RE ")");
+  std::smatch m;
+  if (!std::regex_search(out, m, re))
+    return "";
+
+  return m[1].str();
+}
+
+tty_transfer_errno poll_request(tty_transfer_request *req) {
+  tty_transfer_errno ret = TTY_TRANSFER_IN_PROGRESS;
+  while (ret == TTY_TRANSFER_IN_PROGRESS) {
+    int events = tty_transfer_request_events(req);
+
+    pollfd pfd;
+    pfd.fd = tty_transfer_request_fd(req);
+    pfd.events = (events & TTY_TRANSFER_EVENT_READ) ? POLLIN : POLLOUT;
+    pfd.revents = 0;
+
+    if (::poll(&pfd, 1, tty_transfer_request_timeout_ms(req)) == -1)
+      return TTY_TRANSFER_BAD_READ;
+
+    ret = tty_transfer_request_step(req, pfd.revents ? events : 0);
+  }
+
+  return ret;
+}
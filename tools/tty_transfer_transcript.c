@@ -0,0 +1,82 @@
+/**
+ * Copyright 2025 Nicholas Gulachek
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#if defined(__linux__)
+// enable getopt
+#define _DEFAULT_SOURCE
+#endif
+
+#include "tty_transfer/transcript.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void usage(FILE *f) {
+  fprintf(f, "usage: tty_transfer_transcript [-j threads] transcript\n");
+}
+
+int main(int argc, char **argv) {
+  size_t nthreads = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "hj:")) != -1) {
+    switch (opt) {
+    case 'h':
+      usage(stdout);
+      return 0;
+    case 'j':
+      nthreads = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(stderr);
+      return 2;
+    }
+  }
+
+  if (optind + 1 != argc) {
+    usage(stderr);
+    return 2;
+  }
+
+  const char *path = argv[optind];
+  tty_transfer_transcript_event *events;
+  size_t nevents;
+  tty_transfer_errno err =
+      tty_transfer_transcript_scan_file(path, nthreads, &events, &nevents);
+  if (err != TTY_TRANSFER_OK) {
+    fprintf(stderr, "tty_transfer_transcript: failed to scan %s (error %d)\n",
+            path, (int)err);
+    return 1;
+  }
+
+  char key[37], val[37];
+  for (size_t i = 0; i < nevents; ++i) {
+    const tty_transfer_transcript_event *e = &events[i];
+    printf("%" PRIu64 " %" PRIu64, e->start, e->end);
+
+    switch (e->type) {
+    case TTY_TRANSFER_TRANSCRIPT_TOKEN:
+      tty_transfer_uuid_format(&e->key, key);
+      tty_transfer_uuid_format(&e->val, val);
+      printf(" token %s %s\n", key, val);
+      break;
+    case TTY_TRANSFER_TRANSCRIPT_REQUEST:
+      tty_transfer_uuid_format(&e->key, key);
+      printf(" request %s\n", key);
+      break;
+    case TTY_TRANSFER_TRANSCRIPT_CPR:
+      printf(" cpr\n");
+      break;
+    }
+  }
+
+  tty_transfer_transcript_events_free(events);
+  return 0;
+}